@@ -43,10 +43,15 @@ dtt.addBranches({'B0'    : '[^(B0 -> K*(892)0 (J/psi(1S) -> e- e+ ))]CC',
                  'E2': '[B0 -> K*(892)0 (J/psi(1S) -> e- ^e+ )]CC',
                  'JPs': '[B0 -> K*(892)0 ^(J/psi(1S) -> e- e+ )]CC'})
 
+# One call per candidate and variable. For large productions the same values
+# come for the whole container in one batched pass from a Bender algorithm:
+#   LoKiPhys.columns.Filler(('BPVHOPM', 'BPVHOPALPHA', 'BPVHOPEM', 'BPVCORRM'))
 b0_hybrid = dtt.B0.addTupleTool('LoKi::Hybrid::TupleTool/LoKi_B0')
 
 b0_hybrid.Variables = {
     'hop_mass': 'BPVHOPM',
+    'hop_alpha': 'BPVHOPALPHA',
+    'hop_electron_mass': 'BPVHOPEM',
     'corr_mass': 'BPVCORRM'
 }
 
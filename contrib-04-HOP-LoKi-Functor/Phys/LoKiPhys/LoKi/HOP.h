@@ -0,0 +1,1609 @@
+// ============================================================================
+#ifndef LOKI_HOP_H
+#define LOKI_HOP_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+// ============================================================================
+// Boost
+// ============================================================================
+#include "boost/container/small_vector.hpp"
+// ============================================================================
+/** @file LoKi/HOP.h
+ *
+ *  Framework-independent core of the 'corrected mass' and 'HOP mass'
+ *  computations. The header has no dependency on Gaudi, LoKi or the
+ *  LHCb event model, and can be used on any decay tree, e.g. from
+ *  ROOT macros, on plain structures or on MC-truth trees.
+ *
+ *  The decay tree is accessed through the traits class
+ *  LoKi::HOP::NodeTraits, that needs to be specialised for the node type:
+ *  @code
+ *
+ *  namespace LoKi { namespace HOP {
+ *    template <>
+ *    struct NodeTraits<LHCb::MCParticle>
+ *    {
+ *      static P4 momentum ( const LHCb::MCParticle& p )
+ *      { const auto& v = p.momentum() ; return { v.Px() , v.Py() , v.Pz() , v.E() } ; }
+ *      static unsigned           abspid    ( const LHCb::MCParticle& p )
+ *      { return p.particleID().abspid() ; }
+ *      static bool               isBasic   ( const LHCb::MCParticle& p )
+ *      { return p.endVertices().empty() ; }
+ *      static std::size_t        nDaughters ( const LHCb::MCParticle& p ) ;
+ *      static const LHCb::MCParticle* daughter ( const LHCb::MCParticle& p ,
+ *                                                std::size_t i ) ;
+ *    } ;
+ *  } }
+ *
+ *  @endcode
+ *
+ *  For the HOP mass see
+ *  <a href="https://cds.cern.ch/record/2102345?ln=en">LHCb-INT-2015-037</a>
+ *
+ *  This file is a part of
+ *  <a href="http://cern.ch/lhcb-comp/Analysis/LoKi/index.html">LoKi project:</a>
+ *  ``C++ ToolKit for Smart and Friendly Physics Analysis''
+ *
+ *  @see LoKi::Particles::PtFlight
+ *  @see LoKi::Particles::MCorrected
+ *  @see LoKi::Particles::BremMCorrected
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace HOP
+  {
+    // ========================================================================
+    /// the electron mass used for the HOP correction of the electrons
+    constexpr double s_electronMass = 0.510998910 ;
+    // ========================================================================
+    /** @struct P4
+     *  Plain 4-momentum
+     */
+    struct P4
+    {
+      // ======================================================================
+      double px = 0 ;
+      double py = 0 ;
+      double pz = 0 ;
+      double e  = 0 ;
+      // ======================================================================
+      P4& operator+= ( const P4& right )
+      {
+        px += right.px ; py += right.py ; pz += right.pz ; e += right.e ;
+        return *this ;
+      }
+      P4 operator+ ( const P4& right ) const
+      { P4 result ( *this ) ; result += right ; return result ; }
+      /// the squared invariant mass
+      double m2 () const { return e * e - ( px * px + py * py + pz * pz ) ; }
+      /// the invariant mass, negative for space-like momenta
+      double m  () const
+      {
+        const double v = m2 () ;
+        return 0 <= v ? std::sqrt ( v ) : -std::sqrt ( -v ) ;
+      }
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @struct Info
+     *  All quantities from one HOP evaluation of the candidate.
+     *  They are evaluated together and shared by the whole HOP family
+     */
+    struct Info
+    {
+      // ======================================================================
+      /// HOP ratio \f$ \alpha_{HOP} = p_T^{h} / p_T^{e} \f$
+      double alpha ;
+      /// transverse momentum of the electronic part w.r.t. the flight direction
+      double ptE   ;
+      /// transverse momentum of the hadronic part w.r.t. the flight direction
+      double ptH   ;
+      /// the HOP mass
+      double mass  ;
+      /// the mass of the corrected electronic system
+      double eMass ;
+      /// the squared 4-momentum of the corrected electronic system
+      double q2      ;
+      /// the uncertainty of the HOP mass, NaN if not evaluated
+      double massErr ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @struct NodeTraits
+     *  Access to the decay tree. It must be specialised for each node type,
+     *  providing the static functions:
+     *   - <code>P4 momentum ( const NODE& )</code>
+     *   - <code>unsigned abspid ( const NODE& )</code>
+     *   - <code>bool isBasic ( const NODE& )</code>
+     *   - <code>std::size_t nDaughters ( const NODE& )</code>
+     *   - <code>const NODE* daughter ( const NODE& , std::size_t )</code>
+     *  and, for the uncertainties only,
+     *   - <code>double momCov ( const NODE& , int i , int j )</code>,
+     *     the covariance of the 4-momentum (px,py,pz,E)
+     */
+    template <class NODE> struct NodeTraits ;
+    // ========================================================================
+    /** @struct NodeShape
+     *  The shape of one node of the decay tree, as seen by the HOP
+     *  classification: the number of daughters, is it basic, is it electron
+     */
+    struct NodeShape
+    {
+      // ======================================================================
+      std::size_t nDaughters ;
+      bool        basic      ;
+      bool        electron   ;
+      // ======================================================================
+      bool operator== ( const NodeShape& right ) const
+      {
+        return nDaughters == right.nDaughters
+          &&   basic      == right.basic
+          &&   electron   == right.electron   ;
+      }
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** the transverse momentum with respect to the direction
+     *  @param px,py,pz the momentum
+     *  @param dx,dy,dz the direction, not necessarily normalised
+     *  @return the transverse momentum, the full momentum for null direction
+     */
+    inline double ptDir
+    ( const double px , const double py , const double pz ,
+      const double dx , const double dy , const double dz )
+    {
+      const double d2 = dx * dx + dy * dy + dz * dz ;
+      const double pd = px * dx + py * dy + pz * dz ;
+      // a null direction gives pd = 0: the division is unconditional,
+      // thus the loops over the candidates or vertices are vectorised
+      const double f  = pd / ( d2 + ( 0 == d2 ) ) ;
+      const double tx = px - f * dx ;
+      const double ty = py - f * dy ;
+      const double tz = pz - f * dz ;
+      return std::sqrt ( tx * tx + ty * ty + tz * tz ) ;
+    }
+    // ========================================================================
+    /** the corrected mass
+     *  \f$ m_{corr} = \sqrt{ m^2 + p_T^2 } + p_T \f$
+     *  @param m2 the squared invariant mass
+     *  @param pt the transverse momentum with respect to the flight direction
+     */
+    inline double mCorr ( const double m2 , const double pt )
+    { return std::sqrt ( m2 + pt * pt ) + pt ; }
+    // ========================================================================
+    /** the transverse momentum with respect to the flight direction
+     *  @param p      the momentum
+     *  @param dx,dy,dz the flight direction
+     */
+    inline double ptDir
+    ( const P4& p , const double dx , const double dy , const double dz )
+    { return ptDir ( p.px , p.py , p.pz , dx , dy , dz ) ; }
+    // ========================================================================
+    /** the corrected mass with respect to the flight direction
+     *  @param p      the momentum
+     *  @param dx,dy,dz the flight direction
+     */
+    inline double mCorrDir
+    ( const P4& p , const double dx , const double dy , const double dz )
+    { return mCorr ( p.m2 () , ptDir ( p , dx , dy , dz ) ) ; }
+    // ========================================================================
+    // Bounds
+    // ========================================================================
+    /// the relative widening of the bounds, to cover the rounding errors
+    constexpr double s_boundTolerance = 1.e-9 ;
+    // ========================================================================
+    /** the bounds of the corrected mass for any flight direction.
+     *  From \f$ 0 \le p_T \le \left|\vec{p}\right| \f$ one gets
+     *  \f$ m \le m_{corr} \le \sqrt{ m^2 + \vec{p}^2 } + \left|\vec{p}\right| \f$
+     *  @param p  (INPUT)  the momentum
+     *  @param lo (OUTPUT) the lower bound
+     *  @param hi (OUTPUT) the upper bound
+     *  @return false for space-like momentum, where there are no bounds
+     */
+    inline bool mCorrBounds ( const P4& p , double& lo , double& hi )
+    {
+      const double m2 = p.m2 () ;
+      if ( !( 0 <= m2 ) ) { return false ; }
+      const double p2 = p.px * p.px + p.py * p.py + p.pz * p.pz ;
+      lo = std::sqrt ( m2 ) ;
+      hi = mCorr ( m2 , std::sqrt ( p2 ) ) * ( 1 + s_boundTolerance ) ;
+      return true ;
+    }
+    // ========================================================================
+    /** the lower bound of the HOP mass for any flight direction.
+     *  The corrected electrons form a time-like system, thus the HOP mass
+     *  is not smaller than the mass of the hadronic part
+     *  (it is equal to it for candidates without electrons).
+     *  The bound does not hold for the degenerate \f$ p_T^e = 0 \f$
+     *  with electrons, where the HOP mass is not a number
+     *  @param P_h (INPUT) the hadronic 4-momentum
+     *  @return the lower bound, negative infinity for space-like P_h
+     */
+    inline double hopMassLowerBound ( const P4& P_h )
+    {
+      const double m2 = P_h.m2 () ;
+      if ( !( 0 <= m2 ) || P_h.e < 0 )
+      { return -std::numeric_limits<double>::infinity () ; }
+      return std::sqrt ( m2 ) * ( 1 - s_boundTolerance ) ;
+    }
+    // ========================================================================
+    // Single precision
+    // ========================================================================
+    /** the transverse momentum with respect to the flight direction,
+     *  single precision and branch-free, for coarse selections
+     *  @param px,py,pz the momentum
+     *  @param ux,uy,uz the flight direction, normalised to unit length
+     */
+    inline float ptDirFast
+    ( const float px , const float py , const float pz ,
+      const float ux , const float uy , const float uz )
+    {
+      const float pu = px * ux + py * uy + pz * uz ;
+      const float tx = px - pu * ux ;
+      const float ty = py - pu * uy ;
+      const float tz = pz - pu * uz ;
+      return std::sqrt ( tx * tx + ty * ty + tz * tz ) ;
+    }
+    // ========================================================================
+    /** the invariant mass in single precision, branch-free,
+     *  negative for space-like momenta
+     */
+    inline float massFast
+    ( const float px , const float py , const float pz , const float e )
+    {
+      const float v = ( e - pz ) * ( e + pz ) - ( px * px + py * py ) ;
+      return std::copysign ( std::sqrt ( std::fabs ( v ) ) , v ) ;
+    }
+    // ========================================================================
+    /** the corrected mass in single precision, branch-free.
+     *  With the squared mass taken in double precision and the transverse
+     *  momentum from ptDirFast, the relative deviation from mCorrDir is
+     *  below 1e-5
+     *  @param m2 the squared invariant mass
+     *  @param pt the transverse momentum with respect to the flight direction
+     */
+    inline float mCorrFast ( const float m2 , const float pt )
+    { return std::sqrt ( m2 + pt * pt ) + pt ; }
+    // ========================================================================
+    /** the HOP mass in single precision, branch-free
+     *
+     *  The relative deviation from the double precision evaluation is
+     *  below 5e-3 (below 3e-3 for masses above 4 GeV) for B -> K e+ e-
+     *  with momenta up to 200 GeV. It is dominated by the rounding of
+     *  the electron transverse momentum for large alpha, and by the
+     *  cancellation in the invariant mass of the boosted system.
+     *  Non-finite alpha (pT_e = 0) gives a non-finite mass
+     *
+     *  @param hx,hy,hz,he the hadronic 4-momentum
+     *  @param ex,ey,ez    the electronic 3-momentum
+     *  @param ux,uy,uz    the flight direction, normalised to unit length
+     *  @param lx,ly,lz    the momenta of the electrons to be corrected
+     *  @param n           the number of the electrons to be corrected
+     */
+    inline float hopMassFast
+    ( const float hx , const float hy , const float hz , const float he ,
+      const float ex , const float ey , const float ez ,
+      const float ux , const float uy , const float uz ,
+      const float* lx , const float* ly , const float* lz , const std::size_t n )
+    {
+      const float alpha =
+        ptDirFast ( hx , hy , hz , ux , uy , uz ) /
+        ptDirFast ( ex , ey , ez , ux , uy , uz ) ;
+      const float m2e = static_cast<float> ( s_electronMass * s_electronMass ) ;
+      float px = hx , py = hy , pz = hz , e = he ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        const float cx = alpha * lx [ i ] ;
+        const float cy = alpha * ly [ i ] ;
+        const float cz = alpha * lz [ i ] ;
+        px += cx ; py += cy ; pz += cz ;
+        e  += std::sqrt ( cx * cx + cy * cy + cz * cz + m2e ) ;
+      }
+      return massFast ( px , py , pz , e ) ;
+    }
+    // ========================================================================
+    /** @struct Scratch
+     *  Reusable scratch storage for the single-pass HOP tree walk:
+     *  the explicit traversal stack and the electrons to be corrected.
+     *  Only views of the nodes are kept, valid until the next walk.
+     *  The in-place buffers cover the typical B-decay topologies,
+     *  thus the walk does not touch the heap
+     */
+    template <class NODE>
+    struct Scratch
+    {
+      // ======================================================================
+      /// traversal frame: the node and the partial sums of its subtree
+      struct Frame
+      {
+        /// the node itself
+        const NODE* node          ;
+        /// the index of the next daughter to be visited
+        std::size_t next          ;
+        /// the first entry in the electron list that belongs to the node
+        std::size_t first         ;
+        /// is there any electron in the subtree?
+        bool        electron      ;
+        /// are all (direct) daughters electrons?
+        bool        onlyElectrons ;
+        /// the hadronic 4-momentum of the subtree
+        P4          hadrons       ;
+        /// the electronic 4-momentum of the subtree
+        P4          electrons     ;
+      } ;
+      // ======================================================================
+      /// the traversal stack
+      boost::container::small_vector<Frame,8>        stack     ;
+      /// all electrons to be corrected (not filled by the walk with partials)
+      boost::container::small_vector<const NODE*,8>  electrons ;
+      /// the momenta of all electrons to be corrected (filled by all walks)
+      boost::container::small_vector<P4,8>           leptons   ;
+      /// all nodes contributing to P_h (filled by the plans only)
+      boost::container::small_vector<const NODE*,8>  hadrons   ;
+      /// all nodes contributing to P_e (filled by the plans only)
+      boost::container::small_vector<const NODE*,8>  electronic ;
+      /// the nodes of the tree in pre-order, their mothers and shapes (for the plans)
+      boost::container::small_vector<const NODE*,16> nodes     ;
+      boost::container::small_vector<std::size_t,16> parents   ;
+      boost::container::small_vector<NodeShape,16>   shapes    ;
+      /// the pre-order traversal: the node, its index and the next daughter
+      struct Cursor { const NODE* node ; std::size_t index ; std::size_t next ; } ;
+      boost::container::small_vector<Cursor,8>       cursors   ;
+      /// the squared momenta of the electrons (for the scan over vertices)
+      boost::container::small_vector<double,8>       norms     ;
+      /// the energies of the scaled electrons, one per vertex (for the scan)
+      boost::container::small_vector<double,16>      energies  ;
+      /// the momenta of the electrons collected from the sub-decays
+      boost::container::small_vector<P4,8>           subLeptons ;
+      /// the contributions to P_h and to P_e collected from the sub-decays
+      boost::container::small_vector<P4,8>           subHadrons   ;
+      boost::container::small_vector<P4,8>           subElectrons ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** single post-order walk over the decay tree for the HOP mass
+     *
+     *  The tree is traversed once with an explicit stack. Each node is
+     *  classified when all its daughters are done:
+     *   - basic electrons go to P_e and to the list of electrons to correct;
+     *   - composites with only electrons as daughters go to P_e,
+     *     and their daughters to the list of electrons to correct;
+     *   - composites without electrons in their subtree and basic
+     *     non-electrons go to P_h;
+     *   - all other composites are represented by their daughters.
+     *
+     *  @param head      (INPUT)  the head of the decay tree
+     *  @param scratch   (UPDATE) the scratch storage, on exit it holds
+     *                            the electrons to be corrected and their momenta
+     *  @param hadrons   (OUTPUT) the hadronic 4-momentum P_h
+     *  @param electrons (OUTPUT) the electronic 4-momentum P_e
+     */
+    template <class NODE, class TRAITS = NodeTraits<NODE> >
+    void walk
+    ( const NODE*     head      ,
+      Scratch<NODE>&  scratch   ,
+      P4&             hadrons   ,
+      P4&             electrons )
+    {
+      typedef typename Scratch<NODE>::Frame Frame ;
+      //
+      scratch.stack     .clear () ;
+      scratch.electrons .clear () ;
+      scratch.leptons   .clear () ;
+      scratch.stack.push_back ( Frame { head , 0 , 0 , false , true , {} , {} } ) ;
+      //
+      while ( !scratch.stack.empty() )
+      {
+        Frame& top = scratch.stack.back() ;
+        const NODE& p     = *top.node ;
+        const bool  basic = TRAITS::isBasic ( p ) ;
+        //
+        // descend to the next daughter
+        if ( !basic && top.next < TRAITS::nDaughters ( p ) )
+        {
+          const NODE* d = TRAITS::daughter ( p , top.next++ ) ;
+          scratch.stack.push_back
+            ( Frame { d , 0 , scratch.electrons.size() , false , true , {} , {} } ) ;
+          continue ;                                                // CONTINUE
+        }
+        //
+        // all daughters are done: classify the node
+        if      ( basic )
+        {
+          if ( 11 == TRAITS::abspid ( p ) )
+          {
+            top.electron  = true ;
+            top.electrons = TRAITS::momentum ( p ) ;
+            scratch.electrons.push_back ( &p ) ;
+            scratch.leptons  .push_back ( top.electrons ) ;
+          }
+          else { top.hadrons = TRAITS::momentum ( p ) ; }
+        }
+        else if ( top.onlyElectrons )
+        {
+          top.hadrons   = P4 () ;
+          top.electrons = TRAITS::momentum ( p ) ;
+          scratch.electrons.resize ( top.first ) ;
+          scratch.leptons  .resize ( top.first ) ;
+          const std::size_t n = TRAITS::nDaughters ( p ) ;
+          for ( std::size_t i = 0 ; i < n ; ++i )
+          {
+            const NODE* d = TRAITS::daughter ( p , i ) ;
+            scratch.electrons.push_back ( d ) ;
+            scratch.leptons  .push_back ( TRAITS::momentum ( *d ) ) ;
+          }
+        }
+        else if ( !top.electron )
+        {
+          top.hadrons   = TRAITS::momentum ( p ) ;
+          top.electrons = P4 () ;
+          scratch.electrons.resize ( top.first ) ;
+          scratch.leptons  .resize ( top.first ) ;
+        }
+        //
+        // propagate to the mother
+        const Frame node = top ;
+        scratch.stack.pop_back() ;
+        if ( scratch.stack.empty() )
+        {
+          hadrons   = node.hadrons   ;
+          electrons = node.electrons ;
+          break ;                                                      // BREAK
+        }
+        Frame& mother = scratch.stack.back() ;
+        mother.electron      = mother.electron || node.electron ;
+        mother.onlyElectrons = mother.onlyElectrons &&
+          11 == TRAITS::abspid ( *node.node ) ;
+        mother.hadrons      += node.hadrons   ;
+        mother.electrons    += node.electrons ;
+      }
+    }
+    // ========================================================================
+    /// the role of the node in the HOP mass
+    enum Role
+    {
+      /// the node is represented by its daughters or is ignored
+      Skip   = 0      ,
+      /// the node contributes to P_h
+      Hadron = 1 << 0 ,
+      /// the node contributes to P_e
+      Lepton = 1 << 1 ,
+      /// the node is an electron to be corrected
+      Scaled = 1 << 2
+    } ;
+    // ========================================================================
+    /// the electron content of the subtree
+    enum Content
+    {
+      /// the content is not known
+      Unknown       = 0      ,
+      /// there are (basic) electrons in the subtree
+      HasElectrons  = 1 << 0 ,
+      /// all direct daughters are electrons
+      OnlyElectrons = 1 << 1 ,
+      /// the content is known
+      Known         = 1 << 3
+    } ;
+    // ========================================================================
+    /** the HOP classification of the flattened decay tree
+     *
+     *  The nodes are in pre-order with the head first, thus all
+     *  descendants follow the node. The reverse loop visits the daughters
+     *  before their mother and finds the electron content of the
+     *  subtrees, the forward loop assigns the roles top-down.
+     *  The classification is the same as for LoKi::HOP::walk.
+     *
+     *  @param n        (INPUT)  the number of nodes
+     *  @param parent   (INPUT)  the index of the mother, ignored for the head
+     *  @param basic    (INPUT)  is the node basic?
+     *  @param electron (INPUT)  is the node an electron?
+     *  @param flags    (OUTPUT) the electron content of the subtrees
+     *  @param roles    (OUTPUT) the roles of the nodes
+     *  @see LoKi::HOP::Content
+     *  @see LoKi::HOP::Role
+     */
+    template <class PARENT, class FLAG>
+    void classify
+    ( const std::size_t n        ,
+      PARENT            parent   ,
+      FLAG              basic    ,
+      FLAG              electron ,
+      unsigned char*    flags    ,
+      unsigned char*    roles    )
+    {
+      enum { Electron = HasElectrons , Active = 1 << 2 } ;
+      //
+      for ( std::size_t k = 0 ; k < n ; ++k )
+      { flags [ k ] = OnlyElectrons ; roles [ k ] = Skip ; }
+      //
+      // the electron content of the subtrees
+      for ( std::size_t k = n ; 1 < k-- ; )
+      {
+        if ( basic [ k ] && electron [ k ] ) { flags [ k ] |= Electron ; }
+        unsigned char& fm = flags [ parent [ k ] ] ;
+        if ( flags [ k ] & Electron ) { fm |= Electron       ; }
+        if ( !electron [ k ]        ) { fm &= ~OnlyElectrons ; }
+      }
+      if ( 0 < n && basic [ 0 ] && electron [ 0 ] ) { flags [ 0 ] |= Electron ; }
+      //
+      // the roles
+      for ( std::size_t k = 0 ; k < n ; ++k )
+      {
+        if ( 0 < k )
+        {
+          const std::size_t m = parent [ k ] ;
+          if ( !( flags [ m ] & Active ) || basic [ m ] ) { continue ; }
+          if      (    flags [ m ] & OnlyElectrons  ) { roles [ k ] = Scaled ; continue ; }
+          else if ( !( flags [ m ] & Electron     ) ) {                        continue ; }
+        }
+        flags [ k ] |= Active ;
+        if      ( basic [ k ]                      )
+        { roles [ k ] = electron [ k ] ? ( Lepton | Scaled ) : Hadron ; }
+        else if (    flags [ k ] & OnlyElectrons    ) { roles [ k ] = Lepton ; }
+        else if ( !( flags [ k ] & Electron       ) ) { roles [ k ] = Hadron ; }
+      }
+      for ( std::size_t k = 0 ; k < n ; ++k ) { flags [ k ] &= ~Active ; }
+    }
+    // ========================================================================
+    /** @struct NoAnnotations
+     *  The annotations of the composite particles with their electron
+     *  content, the default policy: nothing is known, nothing is kept.
+     *
+     *  An annotation policy provides
+     *   - <code>unsigned char find ( const NODE& ) const</code>,
+     *     the known content or <code>Unknown</code>
+     *   - <code>void insert ( const NODE& , unsigned char )</code>
+     *
+     *  @see LoKi::HOP::Content
+     */
+    struct NoAnnotations
+    {
+      template <class NODE>
+      unsigned char find   ( const NODE& /* node */ ) const { return Unknown ; }
+      template <class NODE>
+      void          insert ( const NODE& /* node */ , unsigned char /* content */ ) {}
+    } ;
+    // ========================================================================
+    /** collect the nodes of the decay tree in pre-order with their
+     *  mothers and shapes, and compute the topology signature.
+     *
+     *  Composites annotated as having no electrons are collected as
+     *  basic hadrons, since this is what they are for the HOP mass:
+     *  their subtrees are not visited.
+     *
+     *  @param head        (INPUT)  the head of the decay tree
+     *  @param scratch     (UPDATE) nodes, parents and shapes are filled
+     *  @param annotations (INPUT)  the known electron content of the composites
+     *  @return the signature (hash) of the shape of the tree
+     */
+    template <class NODE, class TRAITS, class ANNOTATIONS>
+    std::size_t gather
+    ( const NODE*          head        ,
+      Scratch<NODE>&       scratch     ,
+      const ANNOTATIONS&   annotations )
+    {
+      typedef typename Scratch<NODE>::Cursor Cursor ;
+      //
+      scratch.cursors .clear () ;
+      scratch.nodes   .clear () ;
+      scratch.parents .clear () ;
+      scratch.shapes  .clear () ;
+      //
+      std::size_t signature = 0 ;
+      auto visit = [&] ( const NODE* node , const std::size_t parent )
+      {
+        const bool basic    = TRAITS::isBasic ( *node ) ;
+        const bool electron = 11 == TRAITS::abspid ( *node ) ;
+        const bool hadronic = !basic && !electron &&
+          Known == annotations.find ( *node ) ;
+        const NodeShape shape = hadronic ?
+          NodeShape { 0 , true , false } :
+          NodeShape { basic ? 0 : TRAITS::nDaughters ( *node ) , basic , electron } ;
+        //
+        const std::size_t k = scratch.nodes.size () ;
+        scratch.nodes   .push_back ( node   ) ;
+        scratch.parents .push_back ( parent ) ;
+        scratch.shapes  .push_back ( shape  ) ;
+        if ( !shape.basic ) { scratch.cursors.push_back ( Cursor { node , k , 0 } ) ; }
+        //
+        signature = signature * 1000003u ^
+          ( ( shape.nDaughters << 2 ) | ( shape.basic << 1 ) | shape.electron ) ;
+      } ;
+      //
+      visit ( head , 0 ) ;
+      while ( !scratch.cursors.empty () )
+      {
+        Cursor& top = scratch.cursors.back () ;
+        if ( scratch.shapes [ top.index ].nDaughters <= top.next )
+        { scratch.cursors.pop_back () ; continue ; }
+        const std::size_t index = top.index ;
+        visit ( TRAITS::daughter ( *top.node , top.next++ ) , index ) ;
+      }
+      return signature ;
+    }
+    // ========================================================================
+    /** @class Plan
+     *  Compiled HOP classification for one decay topology.
+     *
+     *  For a fixed decay the split of the tree into the hadronic and
+     *  electronic parts is the same for all candidates. The plan records
+     *  the shape of the tree (number of daughters, basic and electron
+     *  flags of the nodes in pre-order) and the nodes that contribute
+     *  to P_h, to P_e and the electrons to be corrected. For a candidate
+     *  with the same shape the evaluation is a gather of the nodes and
+     *  the sums, without the classification.
+     *
+     *  @see LoKi::HOP::gather
+     *  @see LoKi::HOP::PlanCache
+     */
+    template <class NODE, class TRAITS = NodeTraits<NODE> >
+    class Plan
+    {
+    public:
+      // ======================================================================
+      /** compile the plan from the gathered decay tree
+       *  @param scratch (INPUT) the gathered tree
+       *  @see LoKi::HOP::gather
+       */
+      void compile ( const Scratch<NODE>& scratch )
+      {
+        const std::size_t n = scratch.shapes.size () ;
+        m_shape.assign ( scratch.shapes.begin () , scratch.shapes.end () ) ;
+        std::vector<unsigned char>& basic    = m_work.basic    ;
+        std::vector<unsigned char>& electron = m_work.electron ;
+        std::vector<unsigned char>& flags    = m_work.flags    ;
+        std::vector<unsigned char>& roles    = m_work.roles    ;
+        basic   .assign ( n , 0 ) ;
+        electron.assign ( n , 0 ) ;
+        flags   .assign ( n , 0 ) ;
+        roles   .assign ( n , 0 ) ;
+        for ( std::size_t k = 0 ; k < n ; ++k )
+        {
+          basic    [ k ] = m_shape [ k ].basic    ;
+          electron [ k ] = m_shape [ k ].electron ;
+        }
+        classify ( n , scratch.parents.begin () , basic.begin () , electron.begin () ,
+                   flags.data () , roles.data () ) ;
+        //
+        m_hadrons    .clear () ;
+        m_leptons    .clear () ;
+        m_scaled     .clear () ;
+        m_composites .clear () ;
+        for ( std::size_t k = 0 ; k < n ; ++k )
+        {
+          if ( roles [ k ] & Hadron ) { m_hadrons .push_back ( k ) ; }
+          if ( roles [ k ] & Lepton ) { m_leptons .push_back ( k ) ; }
+          if ( roles [ k ] & Scaled ) { m_scaled  .push_back ( k ) ; }
+          if ( !basic [ k ] )
+          {
+            m_composites.push_back 
+              ( Annotation { k , static_cast<unsigned char> 
+                  ( Known | ( flags [ k ] & ( HasElectrons | OnlyElectrons ) ) ) } ) ;
+          }
+        }
+      }
+      // ======================================================================
+      /// does the gathered decay tree match the plan?
+      bool matches ( const Scratch<NODE>& scratch ) const
+      {
+        if ( m_shape.size () != scratch.shapes.size () ) { return false ; }
+        for ( std::size_t k = 0 ; k < m_shape.size () ; ++k )
+        { if ( !( m_shape [ k ] == scratch.shapes [ k ] ) ) { return false ; } }
+        return true ;
+      }
+      // ======================================================================
+      /** apply the plan to the gathered decay tree
+       *  @param scratch     (UPDATE) the gathered tree, on exit it holds the
+       *                              contributions to P_h and to P_e, the
+       *                              electrons to be corrected and their momenta
+       *  @param hadrons     (OUTPUT) the hadronic 4-momentum P_h
+       *  @param electrons   (OUTPUT) the electronic 4-momentum P_e
+       *  @param annotations (UPDATE) the content of the composites is recorded
+       */
+      template <class ANNOTATIONS>
+      void apply
+      ( Scratch<NODE>& scratch     ,
+        P4&            hadrons     ,
+        P4&            electrons   ,
+        ANNOTATIONS&   annotations ) const
+      {
+        hadrons   = P4 () ;
+        electrons = P4 () ;
+        scratch.hadrons.clear () ;
+        for ( std::size_t k : m_hadrons )
+        {
+          hadrons   += TRAITS::momentum ( *scratch.nodes [ k ] ) ;
+          scratch.hadrons.push_back ( scratch.nodes [ k ] ) ;
+        }
+        scratch.electronic.clear () ;
+        for ( std::size_t k : m_leptons )
+        {
+          electrons += TRAITS::momentum ( *scratch.nodes [ k ] ) ;
+          scratch.electronic.push_back ( scratch.nodes [ k ] ) ;
+        }
+        scratch.electrons.clear () ;
+        scratch.leptons  .clear () ;
+        for ( std::size_t k : m_scaled  )
+        {
+          scratch.electrons.push_back ( scratch.nodes [ k ] ) ;
+          scratch.leptons  .push_back ( TRAITS::momentum ( *scratch.nodes [ k ] ) ) ;
+        }
+        for ( const Annotation& a : m_composites )
+        { annotations.insert ( *scratch.nodes [ a.index ] , a.content ) ; }
+      }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the electron content of the composite
+      struct Annotation { std::size_t index ; unsigned char content ; } ;
+      // ======================================================================
+      /// the shape of the tree in pre-order
+      std::vector<NodeShape>   m_shape      ;
+      /// the nodes contributing to P_h
+      std::vector<std::size_t> m_hadrons    ;
+      /// the nodes contributing to P_e
+      std::vector<std::size_t> m_leptons    ;
+      /// the electrons to be corrected
+      std::vector<std::size_t> m_scaled     ;
+      /// the electron content of the expanded composites
+      std::vector<Annotation>  m_composites ;
+      // ======================================================================
+      /// the flags of the nodes during the compilation
+      struct Work
+      {
+        std::vector<unsigned char> basic , electron , flags , roles ;
+      } ;
+      /// kept for the capacity: the recompilation of the slot does not allocate
+      Work                     m_work       ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class PlanCache
+     *  Small direct-mapped cache of the compiled plans, keyed by the
+     *  topology signature. A few tree shapes cover the candidates of
+     *  one container, thus the plans are compiled rarely.
+     *  The hash collisions are resolved by the exact shape comparison.
+     */
+    template <class NODE, class TRAITS = NodeTraits<NODE>, std::size_t N = 16>
+    class PlanCache
+    {
+    public:
+      // ======================================================================
+      /** get the plan for the gathered decay tree, compile it if needed
+       *  @param signature (INPUT) the signature of the tree
+       *  @param scratch   (INPUT) the gathered tree
+       *  @see LoKi::HOP::gather
+       */
+      const Plan<NODE,TRAITS>& plan
+      ( const std::size_t    signature ,
+        const Scratch<NODE>& scratch   )
+      {
+        Slot& slot = m_slots [ signature % N ] ;
+        if ( !slot.valid || signature != slot.signature || !slot.plan.matches ( scratch ) )
+        {
+          slot.plan.compile ( scratch ) ;
+          slot.signature = signature ;
+          slot.valid     = true      ;
+          ++m_compiled ;
+        }
+        return slot.plan ;
+      }
+      /// the number of compiled plans
+      std::size_t compiled () const { return m_compiled ; }
+      // ======================================================================
+    private:
+      // ======================================================================
+      struct Slot
+      {
+        bool              valid     = false ;
+        std::size_t       signature = 0     ;
+        Plan<NODE,TRAITS> plan      {}      ;
+      } ;
+      std::array<Slot,N> m_slots        ;
+      std::size_t        m_compiled = 0 ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** the HOP walk with the compiled plans
+     *  @param head        (INPUT)  the head of the decay tree
+     *  @param scratch     (UPDATE) the scratch storage, on exit it holds the
+     *                              hadrons, the electrons to be corrected
+     *                              and their momenta
+     *  @param plans       (UPDATE) the plans
+     *  @param annotations (UPDATE) the annotations of the composites
+     *  @param hadrons     (OUTPUT) the hadronic 4-momentum P_h
+     *  @param electrons   (OUTPUT) the electronic 4-momentum P_e
+     */
+    template <class NODE, class TRAITS, std::size_t N, class ANNOTATIONS>
+    void walk
+    ( const NODE*                head        ,
+      Scratch<NODE>&             scratch     ,
+      PlanCache<NODE,TRAITS,N>&  plans       ,
+      ANNOTATIONS&               annotations ,
+      P4&                        hadrons     ,
+      P4&                        electrons   )
+    {
+      const std::size_t signature = gather<NODE,TRAITS> ( head , scratch , annotations ) ;
+      plans.plan ( signature , scratch ).apply ( scratch , hadrons , electrons , annotations ) ;
+    }
+    // ========================================================================
+    /** @struct Partial
+     *  The HOP decomposition of one sub-decay, as seen by its mother:
+     *  the contributions to the hadronic and electronic 4-momenta, in
+     *  the pre-order of the tree, their sums and the momenta of the
+     *  electrons to be corrected. It does not depend on the flight
+     *  direction, thus it is shared by all candidates built from the
+     *  same sub-decay. Only values are kept, no views of the nodes, thus
+     *  the partial stays valid whatever happens to the tree afterwards.
+     *  The momenta are kept in place: sub-decays with more than
+     *  <code>MaxElectrons</code> electrons to be corrected or more than
+     *  <code>MaxLeaves</code> contributions are not stored and are walked
+     *  again for each candidate
+     *  @see LoKi::HOP::NoPartials
+     */
+    template <class NODE>
+    struct Partial
+    {
+      // ======================================================================
+      /// the capacity of the lists of the electrons and of the contributions
+      enum { MaxElectrons = 4 , MaxLeaves = 8 } ;
+      // ======================================================================
+      /// the hadronic 4-momentum of the sub-decay
+      P4            hadrons      ;
+      /// the electronic 4-momentum of the sub-decay
+      P4            electrons    ;
+      /// are there (basic) electrons in the sub-decay?
+      bool          electron     ;
+      /// the number of the contributions to P_h
+      unsigned char nHadrons     ;
+      /// the number of the contributions to P_e
+      unsigned char nElectrons   ;
+      /// the number of the electrons to be corrected
+      unsigned char nLeptons     ;
+      /// the contributions to P_h, followed by the contributions to P_e
+      std::array<P4,MaxLeaves>    leaves  ;
+      /// the momenta of the electrons to be corrected
+      std::array<P4,MaxElectrons> leptons ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @struct NoPartials
+     *  The partial results of the sub-decays, the default policy:
+     *  nothing is known, nothing is kept.
+     *
+     *  A partials policy provides
+     *   - <code>const Partial<NODE>* find ( const NODE& ) const</code>,
+     *     the known decomposition or <code>nullptr</code>
+     *   - <code>void insert ( const NODE& , const Partial<NODE>& )</code>
+     */
+    struct NoPartials
+    {
+      template <class NODE>
+      const Partial<NODE>* find   ( const NODE& /* node */ ) const { return nullptr ; }
+      template <class NODE>
+      void                 insert ( const NODE& /* node */ , const Partial<NODE>& /* partial */ ) {}
+    } ;
+    // ========================================================================
+    /** the sum of the 4-momenta in their order, from zero, as in
+     *  LoKi::HOP::Plan::apply: the same terms give the same bits
+     */
+    template <class ITERATOR>
+    inline P4 sum ( ITERATOR first , ITERATOR last )
+    {
+      P4 s ;
+      for ( ; first != last ; ++first ) { s += *first ; }
+      return s ;
+    }
+    // ========================================================================
+    /** record the decomposition of the sub-decay, if it fits.
+     *  The contributions and the electrons of the sub-decay are those
+     *  collected in the scratch storage from the given positions on
+     *  @param node      (INPUT)  the head of the sub-decay
+     *  @param scratch   (INPUT)  the scratch storage after the walk
+     *  @param hadrons   (INPUT)  the first contribution to P_h
+     *  @param electrons (INPUT)  the first contribution to P_e
+     *  @param leptons   (INPUT)  the first electron to be corrected
+     *  @param electron  (INPUT)  are there electrons in the sub-decay?
+     *  @param partials  (UPDATE) the partial results of the sub-decays
+     */
+    template <class NODE, class PARTIALS>
+    void record
+    ( const NODE&          node      ,
+      const Scratch<NODE>& scratch   ,
+      const std::size_t    hadrons   ,
+      const std::size_t    electrons ,
+      const std::size_t    leptons   ,
+      const bool           electron  ,
+      PARTIALS&            partials  )
+    {
+      const std::size_t nh = scratch.subHadrons  .size () - hadrons   ;
+      const std::size_t ne = scratch.subElectrons.size () - electrons ;
+      const std::size_t nl = scratch.subLeptons  .size () - leptons   ;
+      if ( Partial<NODE>::MaxElectrons < nl      ) { return ; }
+      if ( Partial<NODE>::MaxLeaves    < nh + ne ) { return ; }
+      Partial<NODE> p ;
+      p.hadrons    = sum ( scratch.subHadrons  .begin () + hadrons   , scratch.subHadrons  .end () ) ;
+      p.electrons  = sum ( scratch.subElectrons.begin () + electrons , scratch.subElectrons.end () ) ;
+      p.electron   = electron ;
+      p.nHadrons   = static_cast<unsigned char> ( nh ) ;
+      p.nElectrons = static_cast<unsigned char> ( ne ) ;
+      p.nLeptons   = static_cast<unsigned char> ( nl ) ;
+      std::copy ( scratch.subHadrons  .begin () + hadrons   , scratch.subHadrons  .end () , p.leaves.begin ()      ) ;
+      std::copy ( scratch.subElectrons.begin () + electrons , scratch.subElectrons.end () , p.leaves.begin () + nh ) ;
+      std::copy ( scratch.subLeptons  .begin () + leptons   , scratch.subLeptons  .end () , p.leptons.begin ()     ) ;
+      partials.insert ( node , p ) ;
+    }
+    // ========================================================================
+    /** the HOP walk combining the partial results of the sub-decays.
+     *
+     *  The decomposition of a composite head is the concatenation of the
+     *  decompositions of its daughters, unless the head has no electrons
+     *  (it goes to P_h) or only electrons as daughters (it goes to P_e),
+     *  exactly as for LoKi::HOP::walk. The decompositions of the composite
+     *  daughters are taken from the partials; the missing ones are found
+     *  with the plans and recorded, as is the decomposition of the head.
+     *
+     *  In the combinatorics many candidates share their sub-decays, e.g.
+     *  the same dielectron or the same hadronic system, thus the tree
+     *  is gathered and classified once per unique sub-decay, rather than
+     *  once per candidate. The contributions are summed in the pre-order
+     *  of the whole tree, from zero, whatever is reused: the results are
+     *  the same bits as from the walk with the plans, and do not depend
+     *  on the order of the evaluations or on the content of the partials.
+     *
+     *  The walk provides the momenta of the electrons to be corrected,
+     *  not the nodes: use the walk with the plans for the uncertainties.
+     *
+     *  @param head        (INPUT)  the head of the decay tree
+     *  @param scratch     (UPDATE) the scratch storage, on exit it holds
+     *                              the momenta of the electrons to be corrected
+     *  @param plans       (UPDATE) the plans
+     *  @param annotations (UPDATE) the annotations of the composites
+     *  @param partials    (UPDATE) the partial results of the sub-decays
+     *  @param hadrons     (OUTPUT) the hadronic 4-momentum P_h
+     *  @param electrons   (OUTPUT) the electronic 4-momentum P_e
+     */
+    template <class NODE, class TRAITS, std::size_t N, class ANNOTATIONS, class PARTIALS>
+    void walk
+    ( const NODE*                head        ,
+      Scratch<NODE>&             scratch     ,
+      PlanCache<NODE,TRAITS,N>&  plans       ,
+      ANNOTATIONS&               annotations ,
+      PARTIALS&                  partials    ,
+      P4&                        hadrons     ,
+      P4&                        electrons   )
+    {
+      if ( TRAITS::isBasic ( *head ) )
+      { return walk ( head , scratch , plans , annotations , hadrons , electrons ) ; }
+      //
+      const Partial<NODE>* known = partials.find ( *head ) ;
+      if ( known )
+      {
+        hadrons   = known->hadrons   ;
+        electrons = known->electrons ;
+        scratch.hadrons  .clear () ;
+        scratch.electrons.clear () ;
+        scratch.leptons  .assign ( known->leptons.begin () ,
+                                   known->leptons.begin () + known->nLeptons ) ;
+        return ;                                                      // RETURN
+      }
+      //
+      // collect the contributions of the daughters, in pre-order
+      scratch.subHadrons  .clear () ;
+      scratch.subElectrons.clear () ;
+      scratch.subLeptons  .clear () ;
+      bool electron = false , onlyElectrons = true ;
+      const std::size_t n = TRAITS::nDaughters ( *head ) ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        const NODE* d = TRAITS::daughter ( *head , i ) ;
+        const bool  e = 11 == TRAITS::abspid ( *d ) ;
+        onlyElectrons = onlyElectrons && e ;
+        if ( TRAITS::isBasic ( *d ) )
+        {
+          const P4 q = TRAITS::momentum ( *d ) ;
+          if ( e )
+          {
+            electron = true ;
+            scratch.subElectrons.push_back ( q ) ;
+            scratch.subLeptons  .push_back ( q ) ;
+          }
+          else { scratch.subHadrons.push_back ( q ) ; }
+          continue ;                                                // CONTINUE
+        }
+        //
+        const Partial<NODE>* part = partials.find ( *d ) ;
+        if ( part )
+        {
+          electron = electron || part->electron ;
+          const P4* leaves = part->leaves.data () ;
+          scratch.subHadrons  .insert ( scratch.subHadrons.end () ,
+                                        leaves , leaves + part->nHadrons ) ;
+          scratch.subElectrons.insert ( scratch.subElectrons.end () ,
+                                        leaves + part->nHadrons ,
+                                        leaves + part->nHadrons + part->nElectrons ) ;
+          scratch.subLeptons  .insert ( scratch.subLeptons.end () ,
+                                        part->leptons.begin () ,
+                                        part->leptons.begin () + part->nLeptons ) ;
+          continue ;                                                // CONTINUE
+        }
+        //
+        // unknown sub-decay: walk it with the plans and record it
+        const std::size_t h0 = scratch.subHadrons  .size () ;
+        const std::size_t e0 = scratch.subElectrons.size () ;
+        const std::size_t l0 = scratch.subLeptons  .size () ;
+        P4 h , l ;
+        walk ( d , scratch , plans , annotations , h , l ) ;
+        const bool sub = std::any_of
+          ( scratch.shapes.begin () , scratch.shapes.end () ,
+            [] ( const NodeShape& s ) { return s.basic && s.electron ; } ) ;
+        electron = electron || sub ;
+        for ( const NODE* c : scratch.hadrons    ) { scratch.subHadrons  .push_back ( TRAITS::momentum ( *c ) ) ; }
+        for ( const NODE* c : scratch.electronic ) { scratch.subElectrons.push_back ( TRAITS::momentum ( *c ) ) ; }
+        scratch.subLeptons.insert ( scratch.subLeptons.end () ,
+                                    scratch.leptons.begin () , scratch.leptons.end () ) ;
+        record ( *d , scratch , h0 , e0 , l0 , sub , partials ) ;
+      }
+      //
+      // classify the head
+      if      ( onlyElectrons )
+      {
+        scratch.subHadrons  .clear () ;
+        scratch.subElectrons.assign ( 1 , TRAITS::momentum ( *head ) ) ;
+        scratch.subLeptons  .clear () ;
+        for ( std::size_t i = 0 ; i < n ; ++i )
+        { scratch.subLeptons.push_back ( TRAITS::momentum ( *TRAITS::daughter ( *head , i ) ) ) ; }
+      }
+      else if ( !electron )
+      {
+        scratch.subHadrons  .assign ( 1 , TRAITS::momentum ( *head ) ) ;
+        scratch.subElectrons.clear () ;
+        scratch.subLeptons  .clear () ;
+      }
+      hadrons   = sum ( scratch.subHadrons  .begin () , scratch.subHadrons  .end () ) ;
+      electrons = sum ( scratch.subElectrons.begin () , scratch.subElectrons.end () ) ;
+      scratch.hadrons  .clear () ;
+      scratch.electrons.clear () ;
+      scratch.leptons  .assign ( scratch.subLeptons.begin () , scratch.subLeptons.end () ) ;
+      annotations.insert ( *head , static_cast<unsigned char>
+                           ( Known | ( electron      ? HasElectrons  : 0 )
+                                   | ( onlyElectrons ? OnlyElectrons : 0 ) ) ) ;
+      record ( *head , scratch , 0 , 0 , 0 , electron , partials ) ;
+    }
+    // ========================================================================
+    /** the HOP correction of one electron: the 3-momentum is scaled 
+     *  and the energy is recomputed with the electron mass 
+     *  @param p     the electron 4-momentum 
+     *  @param alpha the HOP ratio 
+     */
+    inline P4 scale ( const P4& p , const double alpha )
+    {
+      const double m_e = s_electronMass ;
+      P4 c ;
+      c.px = alpha * p.px ;
+      c.py = alpha * p.py ;
+      c.pz = alpha * p.pz ;
+      c.e  = std::sqrt ( c.px * c.px + c.py * c.py + c.pz * c.pz + m_e * m_e ) ;
+      return c ;
+    }
+    // ========================================================================
+    /** fill the masses from the hadronic and corrected electronic parts 
+     *  @param P_h      (INPUT)  the hadronic 4-momentum 
+     *  @param P_e_corr (INPUT)  the corrected electronic 4-momentum 
+     *  @param info     (UPDATE) the HOP quantities 
+     */
+    inline void fill ( const P4& P_h , const P4& P_e_corr , Info& info )
+    {
+      info.mass  = ( P_h + P_e_corr ).m () ;
+      info.eMass = P_e_corr.m  () ;
+      info.q2    = P_e_corr.m2 () ;
+    }
+    // ========================================================================
+    /** apply the HOP correction to the electrons and fill the masses
+     *  @param first (INPUT)  begin of the momenta of the electrons to correct
+     *  @param last  (INPUT)  end   of the momenta of the electrons to correct
+     *  @param P_h   (INPUT)  the hadronic 4-momentum
+     *  @param info  (UPDATE) the HOP quantities, transverse momenta are input
+     */
+    template <class ITERATOR>
+    void correct
+    ( ITERATOR   first ,
+      ITERATOR   last  ,
+      const P4&  P_h   ,
+      Info&      info  )
+    {
+      info.alpha = info.ptH / info.ptE ;
+      //
+      P4 P_e_corr ;
+      for ( ; first != last ; ++first )
+      { P_e_corr += scale ( *first , info.alpha ) ; }
+      //
+      fill ( P_h , P_e_corr , info ) ;
+    }
+    // ========================================================================
+    /** complete the HOP evaluation from the results of the walk
+     *  @param scratch   (INPUT) the scratch storage with the momenta of the
+     *                           electrons to be corrected
+     *  @param P_h       (INPUT) the hadronic 4-momentum
+     *  @param P_e       (INPUT) the electronic 4-momentum
+     *  @param dx,dy,dz  (INPUT) the flight direction
+     *  @return all HOP quantities, without the uncertainty
+     */
+    template <class NODE>
+    Info complete
+    ( const Scratch<NODE>& scratch ,
+      const P4&            P_h     ,
+      const P4&            P_e     ,
+      const double         dx      ,
+      const double         dy      ,
+      const double         dz      )
+    {
+      Info info ;
+      info.ptH     = ptDir ( P_h , dx , dy , dz ) ;
+      info.ptE     = ptDir ( P_e , dx , dy , dz ) ;
+      info.massErr = std::numeric_limits<double>::quiet_NaN () ;
+      correct ( scratch.leptons.begin () , scratch.leptons.end () , P_h , info ) ;
+      return info ;
+    }
+    // ========================================================================
+    /** is the HOP mass above the threshold by the lower bound alone,
+     *  i.e. without the correction of the electrons?
+     *  The degenerate \f$ p_T^e = 0 \f$, where the HOP mass is not a
+     *  number, is never decided by the bound
+     *  @param scratch   (INPUT) the scratch storage after the walk
+     *  @param P_h       (INPUT) the hadronic 4-momentum
+     *  @param P_e       (INPUT) the electronic 4-momentum
+     *  @param dx,dy,dz  (INPUT) the flight direction
+     *  @param cut       (INPUT) the threshold
+     *  @return true if <code>HOPM > cut</code> for sure
+     *  @see LoKi::HOP::hopMassLowerBound
+     */
+    template <class NODE>
+    inline bool hopMassAbove
+    ( const Scratch<NODE>& scratch ,
+      const P4&            P_h     ,
+      const P4&            P_e     ,
+      const double         dx      ,
+      const double         dy      ,
+      const double         dz      ,
+      const double         cut     )
+    {
+      return !scratch.leptons.empty ()
+        && cut < hopMassLowerBound ( P_h )
+        && 0   < ptDir ( P_e , dx , dy , dz ) ;
+    }
+    // ========================================================================
+    /** the bounds of the squared HOP mass from the HOP ratio, i.e. with
+     *  the projections onto the flight direction but without the correction
+     *  of the electrons. The 3-momentum of the scaled electron
+     *  \f$ \alpha \vec{l} \f$ is exact, its energy
+     *  \f$ \sqrt{ \alpha^2 \vec{l}^2 + m_e^2 } \f$ is between
+     *  \f$ \alpha \left( E_l - m_l^2 / E_l \right) \f$ and
+     *  \f$ \alpha E_l + m_e \f$ for the time-like momentum of the electron,
+     *  thus the bounds need the sums over the electrons only, without
+     *  the square roots. They are widened by the rounding errors,
+     *  relative to the squared energy of the candidate
+     *  @param scratch   (INPUT)  the scratch storage after the walk
+     *  @param P_h       (INPUT)  the hadronic 4-momentum
+     *  @param P_e       (INPUT)  the electronic 4-momentum
+     *  @param dx,dy,dz  (INPUT)  the flight direction
+     *  @param lo2       (OUTPUT) the lower bound of the squared HOP mass
+     *  @param hi2       (OUTPUT) the upper bound of the squared HOP mass
+     *  @return false without electrons, for \f$ p_T^e = 0 \f$ and for
+     *          the space-like momenta, where there are no bounds
+     */
+    template <class NODE>
+    inline bool hopMass2Bounds
+    ( const Scratch<NODE>& scratch ,
+      const P4&            P_h     ,
+      const P4&            P_e     ,
+      const double         dx      ,
+      const double         dy      ,
+      const double         dz      ,
+      double&              lo2     ,
+      double&              hi2     )
+    {
+      if ( scratch.leptons.empty () || !( 0 <= P_h.e ) ) { return false ; }
+      const double ptE = ptDir ( P_e , dx , dy , dz ) ;
+      if ( !( 0 < ptE ) ) { return false ; }
+      const double alpha = ptDir ( P_h , dx , dy , dz ) / ptE ;
+      if ( !std::isfinite ( alpha ) ) { return false ; }
+      //
+      double emin = 0 , emax = 0 , lx = 0 , ly = 0 , lz = 0 ;
+      for ( const P4& l : scratch.leptons )
+      {
+        const double m2 = l.m2 () ;
+        if ( !( 0 <= m2 ) || !( 0 < l.e ) ) { return false ; }
+        emin += l.e - m2 / l.e ;
+        emax += l.e ;
+        lx   += l.px ; ly += l.py ; lz += l.pz ;
+      }
+      //
+      const double elo = P_h.e + alpha * emin ;
+      const double ehi = P_h.e + alpha * emax + scratch.leptons.size () * s_electronMass ;
+      const double qx  = P_h.px + alpha * lx ;
+      const double qy  = P_h.py + alpha * ly ;
+      const double qz  = P_h.pz + alpha * lz ;
+      const double q2  = qx * qx + qy * qy + qz * qz ;
+      const double tol = s_boundTolerance * ehi * ehi ;
+      lo2 = elo * elo - q2 - tol ;
+      hi2 = ehi * ehi - q2 + tol ;
+      return true ;
+    }
+    // ========================================================================
+    /** the side of the threshold for the HOP mass, decided by the bounds
+     *  without the correction of the electrons: first by the mass of the
+     *  hadronic part, that needs no projection, then by the bounds from
+     *  the HOP ratio. The degenerate \f$ p_T^e = 0 \f$, where the HOP mass
+     *  is not a number, is never decided
+     *  @param scratch   (INPUT) the scratch storage after the walk
+     *  @param P_h       (INPUT) the hadronic 4-momentum
+     *  @param P_e       (INPUT) the electronic 4-momentum
+     *  @param dx,dy,dz  (INPUT) the flight direction
+     *  @param cut       (INPUT) the threshold
+     *  @return +1 if <code>HOPM > cut</code> for sure,
+     *          -1 if <code>HOPM < cut</code> for sure, 0 otherwise
+     *  @see LoKi::HOP::hopMassAbove
+     *  @see LoKi::HOP::hopMass2Bounds
+     */
+    template <class NODE>
+    inline int hopMassSide
+    ( const Scratch<NODE>& scratch ,
+      const P4&            P_h     ,
+      const P4&            P_e     ,
+      const double         dx      ,
+      const double         dy      ,
+      const double         dz      ,
+      const double         cut     )
+    {
+      if ( hopMassAbove ( scratch , P_h , P_e , dx , dy , dz , cut ) ) { return  1 ; }
+      double lo2 = 0 , hi2 = 0 ;
+      if ( !( 0 < cut ) ||
+           !hopMass2Bounds ( scratch , P_h , P_e , dx , dy , dz , lo2 , hi2 ) ) { return 0 ; }
+      const double cut2 = cut * cut ;
+      return cut2 < lo2 ? 1 : hi2 < cut2 ? -1 : 0 ;
+    }
+    // ========================================================================
+    /** evaluate all HOP quantities for the decay tree
+     *  @param head     (INPUT)  the head of the decay tree
+     *  @param dx,dy,dz (INPUT)  the flight direction of the head
+     *  @param scratch  (UPDATE) the scratch storage for the tree walk
+     *  @return all HOP quantities
+     */
+    template <class NODE, class TRAITS = NodeTraits<NODE> >
+    Info evaluate
+    ( const NODE*    head    ,
+      const double   dx      ,
+      const double   dy      ,
+      const double   dz      ,
+      Scratch<NODE>& scratch )
+    {
+      P4 P_h , P_e ;
+      walk<NODE,TRAITS> ( head , scratch , P_h , P_e ) ;
+      return complete ( scratch , P_h , P_e , dx , dy , dz ) ;
+    }
+    // ========================================================================
+    /** evaluate all HOP quantities for the decay tree using the plans
+     *  @param head        (INPUT)  the head of the decay tree
+     *  @param dx,dy,dz    (INPUT)  the flight direction of the head
+     *  @param scratch     (UPDATE) the scratch storage for the tree walk
+     *  @param plans       (UPDATE) the plans
+     *  @param annotations (UPDATE) the annotations of the composites
+     *  @return all HOP quantities
+     */
+    template <class NODE, class TRAITS, std::size_t N, class ANNOTATIONS>
+    Info evaluate
+    ( const NODE*               head        ,
+      const double              dx          ,
+      const double              dy          ,
+      const double              dz          ,
+      Scratch<NODE>&            scratch     ,
+      PlanCache<NODE,TRAITS,N>& plans       ,
+      ANNOTATIONS&              annotations )
+    {
+      P4 P_h , P_e ;
+      walk ( head , scratch , plans , annotations , P_h , P_e ) ;
+      return complete ( scratch , P_h , P_e , dx , dy , dz ) ;
+    }
+    // ========================================================================
+    /** evaluate the corrected mass and the HOP mass for many primary vertices.
+     *  The tree-dependent sums come from one walk, only the projections
+     *  onto the flight directions are evaluated for each vertex, in
+     *  branch-free loops over the contiguous vertex positions that the
+     *  compiler vectorises. The HOP masses are the same as from
+     *  LoKi::HOP::complete for each vertex
+     *  @param scratch   (UPDATE) the scratch storage after the walk
+     *  @param total     (INPUT)  the 4-momentum of the head
+     *  @param P_h       (INPUT)  the hadronic 4-momentum
+     *  @param P_e       (INPUT)  the electronic 4-momentum
+     *  @param sx,sy,sz  (INPUT)  the decay vertex of the head
+     *  @param n         (INPUT)  the number of primary vertices
+     *  @param pvx,pvy,pvz (INPUT) the positions of the primary vertices
+     *  @param corrected (OUTPUT) the corrected masses, one per vertex
+     *  @param hop       (OUTPUT) the HOP masses, one per vertex
+     */
+    template <class NODE>
+    void scan
+    ( Scratch<NODE>&      scratch   ,
+      const P4&           total     ,
+      const P4&           P_h       ,
+      const P4&           P_e       ,
+      const double        sx        ,
+      const double        sy        ,
+      const double        sz        ,
+      const std::size_t   n         ,
+      const double*       pvx       ,
+      const double*       pvy       ,
+      const double*       pvz       ,
+      double*             corrected ,
+      double*             hop       )
+    {
+      // the momenta as local values: the outputs may not alias them
+      const double m2 = total.m2 () ;
+      const double tx = total.px , ty = total.py , tz = total.pz ;
+      //
+      // no electrons: the HOP mass is the hadronic mass for all vertices
+      if ( scratch.leptons.empty () )
+      {
+        const double m = P_h.m () ;
+        for ( std::size_t i = 0 ; i < n ; ++i )
+        {
+          const double dx = sx - pvx [ i ] ;
+          const double dy = sy - pvy [ i ] ;
+          const double dz = sz - pvz [ i ] ;
+          corrected [ i ] = mCorr ( m2 , ptDir ( tx , ty , tz , dx , dy , dz ) ) ;
+          hop       [ i ] = m ;
+        }
+        return ;
+      }
+      //
+      // the tree-dependent part: the electrons to be scaled
+      double ex = 0 , ey = 0 , ez = 0 ;
+      scratch.norms.clear () ;
+      for ( const P4& q : scratch.leptons )
+      {
+        ex += q.px ; ey += q.py ; ez += q.pz ;
+        scratch.norms.push_back ( q.px * q.px + q.py * q.py + q.pz * q.pz ) ;
+      }
+      const double m2e = s_electronMass * s_electronMass ;
+      const P4     h   = P_h ;
+      const P4     l   = P_e ;
+      //
+      // the vertex-dependent part, in branch-free loops over the vertices:
+      // the ratio (kept in hop), the energies electron by electron, the mass
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        const double dx = sx - pvx [ i ] ;
+        const double dy = sy - pvy [ i ] ;
+        const double dz = sz - pvz [ i ] ;
+        corrected [ i ] = mCorr ( m2 , ptDir ( tx , ty , tz , dx , dy , dz ) ) ;
+        hop       [ i ] =
+          ptDir ( h.px , h.py , h.pz , dx , dy , dz ) /
+          ptDir ( l.px , l.py , l.pz , dx , dy , dz ) ;
+      }
+      scratch.energies.assign ( n , 0.0 ) ;
+      double* energies = scratch.energies.data () ;
+      for ( const double norm : scratch.norms )
+      {
+        for ( std::size_t i = 0 ; i < n ; ++i )
+        { energies [ i ] += std::sqrt ( hop [ i ] * hop [ i ] * norm + m2e ) ; }
+      }
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        const double alpha = hop [ i ] ;
+        hop [ i ] = P4 { h.px + alpha * ex ,
+                         h.py + alpha * ey ,
+                         h.pz + alpha * ez ,
+                         h.e  + energies [ i ] } .m () ;
+      }
+    }
+    // ========================================================================
+    // Uncertainties
+    // ========================================================================
+    /** @struct NoCovariance
+     *  Null covariance matrix, e.g. for uncorrelated inputs
+     */
+    struct NoCovariance
+    { double operator() ( const int /* i */ , const int /* j */ ) const { return 0 ; } } ;
+    // ========================================================================
+    /** the transverse momentum with respect to the flight vector and
+     *  its derivatives
+     *  @param p  (INPUT)  the 3-momentum
+     *  @param d  (INPUT)  the flight vector, not normalised
+     *  @param dp (OUTPUT) the derivatives with respect to the momentum
+     *  @param dd (OUTPUT) the derivatives with respect to the flight vector
+     *  @return the transverse momentum
+     */
+    inline double ptDirDerivatives
+    ( const double p  [ 3 ] ,
+      const double d  [ 3 ] ,
+      double       dp [ 3 ] ,
+      double       dd [ 3 ] )
+    {
+      const double dl = std::sqrt ( d [ 0 ] * d [ 0 ] + d [ 1 ] * d [ 1 ] + d [ 2 ] * d [ 2 ] ) ;
+      const double pu = 0 < dl ?
+        ( p [ 0 ] * d [ 0 ] + p [ 1 ] * d [ 1 ] + p [ 2 ] * d [ 2 ] ) / dl : 0.0 ;
+      double t [ 3 ] ;
+      for ( int i = 0 ; i < 3 ; ++i )
+      { t [ i ] = 0 < dl ? p [ i ] - pu * d [ i ] / dl : p [ i ] ; }
+      const double pt = std::sqrt ( t [ 0 ] * t [ 0 ] + t [ 1 ] * t [ 1 ] + t [ 2 ] * t [ 2 ] ) ;
+      for ( int i = 0 ; i < 3 ; ++i )
+      {
+        dp [ i ] = 0 < pt             ? t [ i ] / pt               : 0.0 ;
+        dd [ i ] = 0 < pt && 0 < dl   ? -pu * t [ i ] / ( pt * dl ) : 0.0 ;
+      }
+      return pt ;
+    }
+    // ========================================================================
+    /** the uncertainty of the corrected mass
+     *  \f$ m_{corr} = \sqrt{ m^2 + p_T^2 } + p_T \f$,
+     *  propagated with the analytic Jacobian from the covariances of the
+     *  4-momentum, of the decay and of the primary vertex positions.
+     *  The primary vertex is considered as uncorrelated with the candidate.
+     *
+     *  @param p        (INPUT) the 4-momentum
+     *  @param dx,dy,dz (INPUT) the flight vector from the primary to the decay vertex
+     *  @param cpp      (INPUT) the covariance of the 4-momentum (px,py,pz,E)
+     *  @param csv      (INPUT) the covariance of the decay vertex
+     *  @param cpv      (INPUT) the covariance of the primary vertex
+     *  @param cpd      (INPUT) the covariance of the 4-momentum and the decay vertex (4x3)
+     *  @return the uncertainty, NaN for the degenerate case
+     */
+    template <class COV4, class COV3, class COV43>
+    double mCorrError
+    ( const P4&    p   ,
+      const double dx  ,
+      const double dy  ,
+      const double dz  ,
+      const COV4&  cpp ,
+      const COV3&  csv ,
+      const COV3&  cpv ,
+      const COV43& cpd )
+    {
+      const double mom [ 3 ] = { p.px , p.py , p.pz } ;
+      const double d   [ 3 ] = { dx   , dy   , dz   } ;
+      double dpt_dp [ 3 ] , dpt_dd [ 3 ] ;
+      const double pt = ptDirDerivatives ( mom , d , dpt_dp , dpt_dd ) ;
+      const double S  = std::sqrt ( p.m2 () + pt * pt ) ;
+      if ( !( 0 < S ) ) { return std::numeric_limits<double>::quiet_NaN () ; }
+      //
+      // m_corr = S + pt , S^2 = E^2 - p^2 + pt^2
+      const double f = 1 + pt / S ;
+      double jp [ 4 ] , jd [ 3 ] ;
+      for ( int i = 0 ; i < 3 ; ++i )
+      {
+        jp [ i ] = -mom [ i ] / S + f * dpt_dp [ i ] ;
+        jd [ i ] =                  f * dpt_dd [ i ] ;
+      }
+      jp [ 3 ] = p.e / S ;
+      //
+      double var = 0 ;
+      for ( int i = 0 ; i < 4 ; ++i )
+      { for ( int j = 0 ; j < 4 ; ++j ) { var += jp [ i ] * cpp ( i , j ) * jp [ j ] ; } }
+      for ( int i = 0 ; i < 3 ; ++i )
+      {
+        for ( int j = 0 ; j < 3 ; ++j )
+        { var += jd [ i ] * ( csv ( i , j ) + cpv ( i , j ) ) * jd [ j ] ; }
+      }
+      for ( int i = 0 ; i < 4 ; ++i )
+      { for ( int j = 0 ; j < 3 ; ++j ) { var += 2 * jp [ i ] * cpd ( i , j ) * jd [ j ] ; } }
+      //
+      return std::sqrt ( std::max ( var , 0.0 ) ) ;
+    }
+    // ========================================================================
+    /** the uncertainty of the HOP mass, propagated with the analytic
+     *  Jacobian from the momentum covariances of the hadrons and of the
+     *  electrons, and from the covariances of the decay and primary
+     *  vertex positions. It uses the results of the same walk.
+     *
+     *  The approximations:
+     *   - the inputs are considered as uncorrelated between themselves;
+     *   - for the derivatives the electronic part P_e is taken as the
+     *     sum of the electrons to be corrected, which is exact unless
+     *     the composite momentum differs from the sum of its electrons.
+     *
+     *  @param scratch  (INPUT) the scratch storage after the walk with the plans
+     *  @param P_h      (INPUT) the hadronic 4-momentum
+     *  @param P_e      (INPUT) the electronic 4-momentum
+     *  @param info     (INPUT) the HOP quantities
+     *  @param dx,dy,dz (INPUT) the flight vector from the primary to the decay vertex
+     *  @param csv      (INPUT) the covariance of the decay vertex
+     *  @param cpv      (INPUT) the covariance of the primary vertex
+     *  @return the uncertainty, NaN for the degenerate case
+     */
+    template <class TRAITS, class NODE, class COV3>
+    double hopMassError
+    ( const Scratch<NODE>& scratch ,
+      const P4&            P_h     ,
+      const P4&            P_e     ,
+      const Info&          info    ,
+      const double         dx      ,
+      const double         dy      ,
+      const double         dz      ,
+      const COV3&          csv     ,
+      const COV3&          cpv     )
+    {
+      const double d  [ 3 ] = { dx     , dy     , dz     } ;
+      const double ph [ 3 ] = { P_h.px , P_h.py , P_h.pz } ;
+      const double pe [ 3 ] = { P_e.px , P_e.py , P_e.pz } ;
+      double dh_dp [ 3 ] , dh_dd [ 3 ] , de_dp [ 3 ] , de_dd [ 3 ] ;
+      ptDirDerivatives ( ph , d , dh_dp , dh_dd ) ;
+      const double pte   = ptDirDerivatives ( pe , d , de_dp , de_dd ) ;
+      const double alpha = info.alpha ;
+      const double m     = info.mass  ;
+      if ( !( 0 < pte ) || !( 0 < m ) )
+      { return std::numeric_limits<double>::quiet_NaN () ; }
+      //
+      // the total 4-momentum and the derivative of the mass on alpha
+      P4     total = P_h ;
+      double sumP [ 3 ] = { 0 , 0 , 0 } ;
+      double sumE       = 0 ;
+      for ( const NODE* e : scratch.electrons )
+      {
+        const P4 q = TRAITS::momentum ( *e ) ;
+        const P4 c = scale ( q , alpha ) ;
+        total   += c ;
+        sumP [ 0 ] += q.px ; sumP [ 1 ] += q.py ; sumP [ 2 ] += q.pz ;
+        sumE       += alpha * ( q.px * q.px + q.py * q.py + q.pz * q.pz ) / c.e ;
+      }
+      const double gp [ 3 ] = { -total.px / m , -total.py / m , -total.pz / m } ;
+      const double gE       =   total.e  / m ;
+      const double k        = gp [ 0 ] * sumP [ 0 ] + gp [ 1 ] * sumP [ 1 ] +
+        gp [ 2 ] * sumP [ 2 ] + gE * sumE ;
+      //
+      double var = 0 ;
+      // the hadrons
+      for ( const NODE* h : scratch.hadrons )
+      {
+        double j [ 4 ] ;
+        for ( int i = 0 ; i < 3 ; ++i ) { j [ i ] = gp [ i ] + k * dh_dp [ i ] / pte ; }
+        j [ 3 ] = gE ;
+        for ( int a = 0 ; a < 4 ; ++a )
+        { for ( int b = 0 ; b < 4 ; ++b ) { var += j [ a ] * TRAITS::momCov ( *h , a , b ) * j [ b ] ; } }
+      }
+      // the electrons: their energy is not used
+      for ( const NODE* e : scratch.electrons )
+      {
+        const P4 q = TRAITS::momentum ( *e ) ;
+        const P4 c = scale ( q , alpha ) ;
+        const double qv [ 3 ] = { q.px , q.py , q.pz } ;
+        double j [ 3 ] ;
+        for ( int i = 0 ; i < 3 ; ++i )
+        {
+          j [ i ] = alpha * gp [ i ] + gE * alpha * alpha * qv [ i ] / c.e
+            - k * alpha * de_dp [ i ] / pte ;
+        }
+        for ( int a = 0 ; a < 3 ; ++a )
+        { for ( int b = 0 ; b < 3 ; ++b ) { var += j [ a ] * TRAITS::momCov ( *e , a , b ) * j [ b ] ; } }
+      }
+      // the flight vector
+      double jd [ 3 ] ;
+      for ( int i = 0 ; i < 3 ; ++i ) { jd [ i ] = k * ( dh_dd [ i ] - alpha * de_dd [ i ] ) / pte ; }
+      for ( int a = 0 ; a < 3 ; ++a )
+      {
+        for ( int b = 0 ; b < 3 ; ++b )
+        { var += jd [ a ] * ( csv ( a , b ) + cpv ( a , b ) ) * jd [ b ] ; }
+      }
+      //
+      return std::sqrt ( std::max ( var , 0.0 ) ) ;
+    }
+    // ========================================================================
+  } //                                             end of namespace LoKi::HOP
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOP_H
+// ============================================================================
@@ -0,0 +1,392 @@
+// ============================================================================
+#ifndef LOKI_HOPCOLUMNS_H
+#define LOKI_HOPCOLUMNS_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/HOP.h"
+// ============================================================================
+/** @file LoKi/HOPColumns.h
+ *
+ *  Columnar evaluation of the 'corrected mass', the transverse momentum
+ *  with respect to the flight direction and the 'HOP mass' directly from
+ *  flat (ntuple) columns, without the event model.
+ *
+ *  The decay trees of N candidates are stored in compressed-sparse-row
+ *  layout: the nodes of candidate <code>i</code> occupy the range
+ *  <code>[ offsets[i] , offsets[i+1] )</code> in pre-order, the head of
+ *  the decay first. For each node the index of its mother relative to
+ *  the first node of the candidate is given, -1 for the head.
+ *  Nodes without stored daughters are considered as basic particles.
+ *  E.g. for B0 -> ( K*0 -> K+ pi- ) ( J/psi -> e+ e- ):
+ *  @code
+ *
+ *   node   :  B0   K*0   K+   pi-  J/psi  e+   e-
+ *   parent :  -1    0     1    1     0    4    4
+ *
+ *  @endcode
+ *
+ *  @see LoKi::HOP
+ *  @see LoKi::Particles::PtFlightWithBestVertex
+ *  @see LoKi::Particles::MCorrectedWithBestVertex
+ *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace HOP
+  {
+    // ========================================================================
+    /** @struct Columns
+     *  Views of the input columns. Nothing is owned.
+     */
+    struct Columns
+    {
+      // ======================================================================
+      /// the number of candidates
+      std::size_t        size    = 0       ;
+      /// CSR offsets of the decay trees, <code>size + 1</code> entries
+      const std::size_t* offsets = nullptr ;
+      /// the mother of each node, relative to the head, -1 for the head
+      const int*         parent  = nullptr ;
+      /// the particle identifier of each node (the sign is ignored)
+      const int*         pid     = nullptr ;
+      /// the 4-momenta of the nodes
+      const double*      px      = nullptr ;
+      const double*      py      = nullptr ;
+      const double*      pz      = nullptr ;
+      const double*      e       = nullptr ;
+      /// the decay vertex of each candidate
+      const double*      endx    = nullptr ;
+      const double*      endy    = nullptr ;
+      const double*      endz    = nullptr ;
+      /// the (best) primary vertex of each candidate
+      const double*      pvx     = nullptr ;
+      const double*      pvy     = nullptr ;
+      const double*      pvz     = nullptr ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @struct ColumnResults
+     *  The output columns, <code>size</code> entries each.
+     *  Null columns are not evaluated.
+     */
+    struct ColumnResults
+    {
+      // ======================================================================
+      /// the transverse momentum with respect to the flight direction
+      double* ptFlight = nullptr ;
+      /// the corrected mass
+      double* mCorr    = nullptr ;
+      /// the HOP mass
+      double* hopMass  = nullptr ;
+      /// the HOP ratio
+      double* alpha    = nullptr ;
+      /// all HOP quantities
+      Info*   hop      = nullptr ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @struct ColumnScratch
+     *  Reusable scratch storage for the columnar evaluation.
+     *  The arrays keep their capacity between the calls
+     */
+    struct ColumnScratch
+    {
+      // ======================================================================
+      /// the flight directions
+      std::vector<double>        dx , dy , dz ;
+      /// the heads, the hadronic and electronic parts
+      std::vector<double>        mx , my , mz , me ;
+      std::vector<double>        hx , hy , hz , he ;
+      std::vector<double>        ex , ey , ez ;
+      /// the transverse momenta
+      std::vector<double>        pt , ptE ;
+      /// the electrons to be corrected (global node indices) per candidate
+      std::vector<std::size_t>   electrons ;
+      std::vector<std::size_t>   first     ;
+      /// the per-node state of the current tree
+      std::vector<unsigned char> basic     ;
+      std::vector<unsigned char> electron  ;
+      std::vector<unsigned char> flags     ;
+      std::vector<unsigned char> roles     ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** check the structure of the flattened decay trees: the offsets are
+     *  non-decreasing and within the node arrays, the head of each tree
+     *  has the mother -1 and any other node has its mother among the
+     *  preceding nodes of the same tree. The evaluation relies on it:
+     *  the mothers are used as indices into the per-tree scratch arrays.
+     *  @param size    the number of candidates
+     *  @param offsets the CSR offsets, <code>size + 1</code> entries
+     *  @param parent  the mother of each node, relative to the head
+     *  @param nodes   the length of the node arrays, if known
+     *  @return the description of the first problem, null for valid trees
+     */
+    inline const char* check
+    ( const std::size_t  size    ,
+      const std::size_t* offsets ,
+      const int*         parent  ,
+      const std::size_t  nodes   = std::numeric_limits<std::size_t>::max () )
+    {
+      if ( 0 == offsets        ) { return "the offsets are missing"                 ; }
+      if ( nodes < offsets [ 0 ] ) { return "the offsets exceed the number of nodes" ; }
+      for ( std::size_t i = 0 ; i < size ; ++i )
+      {
+        const std::size_t begin = offsets [ i ] , end = offsets [ i + 1 ] ;
+        if ( end   < begin ) { return "the offsets are decreasing"              ; }
+        if ( nodes < end   ) { return "the offsets exceed the number of nodes"  ; }
+        if ( begin < end && 0 == parent ) { return "the mothers are missing"    ; }
+        for ( std::size_t k = begin ; k < end ; ++k )
+        {
+          const long mother = parent [ k ] ;
+          const long self   = k - begin    ;
+          if ( 0 == self ? -1 != mother : ( mother < 0 || self <= mother ) )
+          { return "the mother of a node is not a preceding node of its tree" ; }
+        }
+      }
+      return 0 ;
+    }
+    // ========================================================================
+    namespace Details
+    {
+      // ======================================================================
+      /** the HOP classification of one flattened decay tree
+       *  @see LoKi::HOP::classify
+       *  @param c       (INPUT)  the columns
+       *  @param begin   (INPUT)  the first node of the tree
+       *  @param end     (INPUT)  the end of the tree
+       *  @param s       (UPDATE) the scratch
+       *  @param P_h     (OUTPUT) the hadronic 4-momentum
+       *  @param P_e     (OUTPUT) the electronic 4-momentum
+       */
+      inline void walk
+      ( const Columns&       c     ,
+        const std::size_t    begin ,
+        const std::size_t    end   ,
+        ColumnScratch&       s     ,
+        P4&                  P_h   ,
+        P4&                  P_e   )
+      {
+        const std::size_t n = end - begin ;
+        s.basic    .assign ( n , 1 ) ;
+        s.electron .resize ( n ) ;
+        s.flags    .resize ( n ) ;
+        s.roles    .resize ( n ) ;
+        for ( std::size_t k = 0 ; k < n ; ++k )
+        {
+          s.electron [ k ] = 11 == std::abs ( c.pid [ begin + k ] ) ;
+          if ( 0 < k ) { s.basic [ c.parent [ begin + k ] ] = 0 ; }
+        }
+        classify ( n , c.parent + begin , s.basic.data () , s.electron.data () ,
+                   s.flags.data () , s.roles.data () ) ;
+        //
+        P_h = P4 () ;
+        P_e = P4 () ;
+        for ( std::size_t k = 0 ; k < n ; ++k )
+        {
+          const unsigned char role = s.roles [ k ] ;
+          if ( Skip == role ) { continue ; }
+          const std::size_t g = begin + k ;
+          const P4 mom { c.px [ g ] , c.py [ g ] , c.pz [ g ] , c.e [ g ] } ;
+          if ( role & Hadron ) { P_h += mom ; }
+          if ( role & Lepton ) { P_e += mom ; }
+          if ( role & Scaled ) { s.electrons.push_back ( g ) ; }
+        }
+      }
+      // ======================================================================
+    } //                                   end of namespace LoKi::HOP::Details
+    // ========================================================================
+    /** evaluate the requested quantities for all candidates
+     *
+     *  The flight direction is taken from the primary vertex to the decay
+     *  vertex. The tree walk is done per candidate, the flight projections
+     *  and the masses are done by plain loops over contiguous arrays,
+     *  suitable for the auto-vectorisation.
+     *  Candidates without nodes get the invalid value.
+     *  The structure of the trees is not checked here, see LoKi::HOP::check
+     *
+     *  @param c       (INPUT)  the columns
+     *  @param r       (OUTPUT) the results
+     *  @param s       (UPDATE) the scratch storage
+     *  @param invalid (INPUT)  the value for invalid candidates
+     */
+    inline void evaluate
+    ( const Columns&       c       ,
+      const ColumnResults& r       ,
+      ColumnScratch&       s       ,
+      const double         invalid = std::numeric_limits<double>::quiet_NaN () )
+    {
+      const std::size_t n = c.size ;
+      for ( std::vector<double>* a : { &s.dx , &s.dy , &s.dz ,
+                                       &s.mx , &s.my , &s.mz , &s.me ,
+                                       &s.hx , &s.hy , &s.hz , &s.he ,
+                                       &s.ex , &s.ey , &s.ez , &s.pt , &s.ptE } )
+      { a->resize ( n ) ; }
+      //
+      // gather the heads and the flight directions
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        const std::size_t h = c.offsets [ i ] ;
+        const bool valid = h < c.offsets [ i + 1 ] ;
+        s.mx [ i ] = valid ? c.px [ h ] : 0.0 ;
+        s.my [ i ] = valid ? c.py [ h ] : 0.0 ;
+        s.mz [ i ] = valid ? c.pz [ h ] : 0.0 ;
+        s.me [ i ] = valid ? c.e  [ h ] : 0.0 ;
+        s.dx [ i ] = c.endx [ i ] - c.pvx [ i ] ;
+        s.dy [ i ] = c.endy [ i ] - c.pvy [ i ] ;
+        s.dz [ i ] = c.endz [ i ] - c.pvz [ i ] ;
+      }
+      //
+      // PTFLIGHT & CORRM
+      if ( r.ptFlight || r.mCorr )
+      {
+        for ( std::size_t i = 0 ; i < n ; ++i )
+        {
+          s.pt [ i ] = ptDir ( s.mx [ i ] , s.my [ i ] , s.mz [ i ] ,
+                               s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ) ;
+        }
+        if ( r.ptFlight )
+        { for ( std::size_t i = 0 ; i < n ; ++i ) { r.ptFlight [ i ] = s.pt [ i ] ; } }
+        if ( r.mCorr )
+        {
+          for ( std::size_t i = 0 ; i < n ; ++i )
+          {
+            const double m2 = s.me [ i ] * s.me [ i ] -
+              ( s.mx [ i ] * s.mx [ i ] + s.my [ i ] * s.my [ i ] + s.mz [ i ] * s.mz [ i ] ) ;
+            r.mCorr [ i ] = mCorr ( m2 , s.pt [ i ] ) ;
+          }
+        }
+      }
+      //
+      // HOP
+      if ( r.hopMass || r.alpha || r.hop )
+      {
+        s.electrons.clear () ;
+        s.first.resize ( n + 1 ) ;
+        for ( std::size_t i = 0 ; i < n ; ++i )
+        {
+          s.first [ i ] = s.electrons.size () ;
+          P4 P_h , P_e ;
+          if ( c.offsets [ i ] < c.offsets [ i + 1 ] )
+          { Details::walk ( c , c.offsets [ i ] , c.offsets [ i + 1 ] , s , P_h , P_e ) ; }
+          s.hx [ i ] = P_h.px ; s.hy [ i ] = P_h.py ; s.hz [ i ] = P_h.pz ; s.he [ i ] = P_h.e ;
+          s.ex [ i ] = P_e.px ; s.ey [ i ] = P_e.py ; s.ez [ i ] = P_e.pz ;
+        }
+        s.first [ n ] = s.electrons.size () ;
+        //
+        for ( std::size_t i = 0 ; i < n ; ++i )
+        {
+          s.pt  [ i ] = ptDir ( s.hx [ i ] , s.hy [ i ] , s.hz [ i ] ,
+                                s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ) ;
+          s.ptE [ i ] = ptDir ( s.ex [ i ] , s.ey [ i ] , s.ez [ i ] ,
+                                s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ) ;
+        }
+        //
+        for ( std::size_t i = 0 ; i < n ; ++i )
+        {
+          Info info ;
+          info.massErr = std::numeric_limits<double>::quiet_NaN () ;
+          info.ptH   = s.pt  [ i ] ;
+          info.ptE   = s.ptE [ i ] ;
+          info.alpha = info.ptH / info.ptE ;
+          P4 P_e_corr ;
+          for ( std::size_t k = s.first [ i ] ; k < s.first [ i + 1 ] ; ++k )
+          {
+            const std::size_t g = s.electrons [ k ] ;
+            P_e_corr += scale ( P4 { c.px [ g ] , c.py [ g ] , c.pz [ g ] , c.e [ g ] } , 
+                                info.alpha ) ;
+          }
+          fill ( P4 { s.hx [ i ] , s.hy [ i ] , s.hz [ i ] , s.he [ i ] } , 
+                 P_e_corr , info ) ;
+          //
+          if ( r.hopMass ) { r.hopMass [ i ] = info.mass  ; }
+          if ( r.alpha   ) { r.alpha   [ i ] = info.alpha ; }
+          if ( r.hop     ) { r.hop     [ i ] = info      ; }
+        }
+      }
+      //
+      // invalid candidates
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        if ( c.offsets [ i ] < c.offsets [ i + 1 ] ) { continue ; }
+        if ( r.ptFlight ) { r.ptFlight [ i ] = invalid ; }
+        if ( r.mCorr    ) { r.mCorr    [ i ] = invalid ; }
+        if ( r.hopMass  ) { r.hopMass  [ i ] = invalid ; }
+        if ( r.alpha    ) { r.alpha    [ i ] = invalid ; }
+        if ( r.hop      )
+        { r.hop [ i ] = Info { invalid , invalid , invalid , invalid , invalid , invalid , invalid } ; }
+      }
+    }
+    // ========================================================================
+    /** evaluate the requested quantities for all candidates from plain arrays.
+     *  The entry point for the language bindings, e.g. the NumPy interface
+     *  <code>LoKiPhys.columns</code>: only pointers and sizes cross the
+     *  boundary, the scratch storage is thread-local, thus the function
+     *  may run concurrently with the interpreter lock released.
+     *  Null output arrays are not evaluated.
+     *  The structure of the trees is checked first, nothing is evaluated
+     *  for invalid trees.
+     *  @return the description of the problem, null for valid trees
+     *  @see LoKi::HOP::Columns
+     *  @see LoKi::HOP::ColumnResults
+     *  @see LoKi::HOP::check
+     */
+    inline const char* evaluateArrays
+    ( const std::size_t  size     ,
+      const std::size_t* offsets  ,
+      const int*         parent   ,
+      const int*         pid      ,
+      const double*      px       ,
+      const double*      py       ,
+      const double*      pz       ,
+      const double*      e        ,
+      const double*      endx     ,
+      const double*      endy     ,
+      const double*      endz     ,
+      const double*      pvx      ,
+      const double*      pvy      ,
+      const double*      pvz      ,
+      double*            ptFlight ,
+      double*            mCorr    ,
+      double*            hopMass  ,
+      double*            alpha    )
+    {
+      const char* problem = check ( size , offsets , parent ) ;
+      if ( 0 != problem ) { return problem ; }
+      //
+      Columns c ;
+      c.size    = size    ; c.offsets = offsets ;
+      c.parent  = parent  ; c.pid     = pid     ;
+      c.px      = px      ; c.py      = py      ; c.pz = pz ; c.e = e ;
+      c.endx    = endx    ; c.endy    = endy    ; c.endz = endz ;
+      c.pvx     = pvx     ; c.pvy     = pvy     ; c.pvz  = pvz  ;
+      ColumnResults r ;
+      r.ptFlight = ptFlight ;
+      r.mCorr    = mCorr    ;
+      r.hopMass  = hopMass  ;
+      r.alpha    = alpha    ;
+      static thread_local ColumnScratch s_scratch ;
+      evaluate ( c , r , s_scratch ) ;
+      return 0 ;
+    }
+    // ========================================================================
+  } //                                             end of namespace LoKi::HOP
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOPCOLUMNS_H
+// ============================================================================
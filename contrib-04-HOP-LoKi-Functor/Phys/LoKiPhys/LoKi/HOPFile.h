@@ -0,0 +1,366 @@
+// ============================================================================
+#ifndef LOKI_HOPFILE_H
+#define LOKI_HOPFILE_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+// ============================================================================
+// POSIX
+// ============================================================================
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/HOPColumns.h"
+// ============================================================================
+/** @file LoKi/HOPFile.h
+ *
+ *  Compact memory-mappable file format for flattened decay-tree candidates,
+ *  the on-disk form of LoKi::HOP::Columns. The arrays are stored as they
+ *  are used by the columnar kernels, thus the reader maps the file and
+ *  hands out zero-copy views, without any unpacking.
+ *
+ *  Layout (host byte order, checked by the endianness marker):
+ *  @code
+ *
+ *   FileHeader                        fixed size, at offset 0
+ *   section 0 ... section NSections-1 each aligned to 64 bytes
+ *
+ *   section   type      entries       content
+ *   Offsets   uint64    N + 1         CSR offsets of the decay trees
+ *   Parent    int32     M             the mother, relative to the head, -1 for the head
+ *   Pid       int32     M             the particle identifier
+ *   Px ... E  float64   M             the 4-momenta of the nodes
+ *   EndX ...  float64   N             the decay vertices of the candidates
+ *   PvX ...   float64   N             the (best) primary vertices of the candidates
+ *   MomCov    float64   10 M          optional, the 4x4 momentum covariances
+ *   EndCov    float64   6 N           optional, the 3x3 decay vertex covariances
+ *   PvCov     float64   6 N           optional, the 3x3 primary vertex covariances
+ *
+ *  @endcode
+ *
+ *  N is the number of candidates, M the number of nodes. The symmetric
+ *  covariance matrices are packed as the lower triangle, row by row:
+ *  (0,0) (1,0) (1,1) (2,0) (2,1) (2,2) ... Absent sections have zero length.
+ *
+ *  @see LoKi::HOP::Columns
+ *  @see LoKi::HOP::MappedFile
+ *  @see LoKi::HOP::writeFile
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace HOP
+  {
+    // ========================================================================
+    /// the sections of the file
+    enum FileSection
+      {
+        Offsets = 0 , Parent , Pid ,
+        Px , Py , Pz , E ,
+        EndX , EndY , EndZ , PvX , PvY , PvZ ,
+        MomCov , EndCov , PvCov ,
+        NSections
+      } ;
+    // ========================================================================
+    /** @struct FileHeader
+     *  The fixed header of the file
+     */
+    struct FileHeader
+    {
+      // ======================================================================
+      /// the format identifier, "LOKIHOP1"
+      char          magic    [ 8 ] ;
+      /// 0x01020304 in the byte order of the writer
+      std::uint32_t endian   ;
+      /// the version of the format
+      std::uint32_t version  ;
+      /// the number of candidates
+      std::uint64_t size     ;
+      /// the number of nodes
+      std::uint64_t nodes    ;
+      /// the byte offset and the length of each section
+      std::uint64_t sections [ NSections ] [ 2 ] ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /// the alignment of the sections
+    constexpr std::size_t s_fileAlignment = 64 ;
+    /// the current version of the format
+    constexpr std::uint32_t s_fileVersion = 1  ;
+    // ========================================================================
+    /** @struct FileCovariances
+     *  The optional covariances, packed, null if absent
+     */
+    struct FileCovariances
+    {
+      // ======================================================================
+      /// the momentum covariances, 10 per node
+      const double* momentum = nullptr ;
+      /// the decay vertex covariances, 6 per candidate
+      const double* endVertex = nullptr ;
+      /// the primary vertex covariances, 6 per candidate
+      const double* primary  = nullptr ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** the header of the file, with the sections aligned
+     *  @param n       (INPUT) the number of candidates
+     *  @param m       (INPUT) the number of nodes
+     *  @param lengths (INPUT) the length of each section in bytes
+     *  @return the header
+     */
+    inline FileHeader fileHeader
+    ( const std::uint64_t                        n       ,
+      const std::uint64_t                        m       ,
+      const std::array<std::uint64_t,NSections>& lengths )
+    {
+      FileHeader header ;
+      std::memset ( &header , 0 , sizeof ( header ) ) ;
+      std::memcpy ( header.magic , "LOKIHOP1" , 8 ) ;
+      header.endian  = 0x01020304 ;
+      header.version = s_fileVersion ;
+      header.size    = n ;
+      header.nodes   = m ;
+      std::uint64_t position = sizeof ( FileHeader ) ;
+      for ( std::size_t s = 0 ; s < NSections ; ++s )
+      {
+        position = ( position + s_fileAlignment - 1 ) / s_fileAlignment * s_fileAlignment ;
+        header.sections [ s ] [ 0 ] = position ;
+        header.sections [ s ] [ 1 ] = lengths [ s ] ;
+        position += lengths [ s ] ;
+      }
+      return header ;
+    }
+    // ========================================================================
+    /** write the columns to the file
+     *  @param name (INPUT) the file name
+     *  @param c    (INPUT) the columns
+     *  @param cov  (INPUT) the optional covariances
+     *  @exception std::runtime_error if the file can not be written
+     */
+    inline void writeFile
+    ( const std::string&     name    ,
+      const Columns&         c       ,
+      const FileCovariances& cov     = FileCovariances () )
+    {
+      const std::size_t n = c.size ;
+      const std::size_t m = 0 < n ? c.offsets [ n ] : 0 ;
+      //
+      const std::array<std::pair<const void*,std::size_t>,NSections> data = {{
+          { c.offsets       , ( n + 1 ) * sizeof ( std::uint64_t ) } ,
+          { c.parent        , m * sizeof ( std::int32_t ) } ,
+          { c.pid           , m * sizeof ( std::int32_t ) } ,
+          { c.px            , m * sizeof ( double ) } ,
+          { c.py            , m * sizeof ( double ) } ,
+          { c.pz            , m * sizeof ( double ) } ,
+          { c.e             , m * sizeof ( double ) } ,
+          { c.endx          , n * sizeof ( double ) } ,
+          { c.endy          , n * sizeof ( double ) } ,
+          { c.endz          , n * sizeof ( double ) } ,
+          { c.pvx           , n * sizeof ( double ) } ,
+          { c.pvy           , n * sizeof ( double ) } ,
+          { c.pvz           , n * sizeof ( double ) } ,
+          { cov.momentum    , cov.momentum  ? 10 * m * sizeof ( double ) : 0 } ,
+          { cov.endVertex   , cov.endVertex ?  6 * n * sizeof ( double ) : 0 } ,
+          { cov.primary     , cov.primary   ?  6 * n * sizeof ( double ) : 0 } }} ;
+      static_assert ( sizeof ( std::size_t ) == sizeof ( std::uint64_t ) ,
+                      "the offsets are stored as 64-bit integers" ) ;
+      //
+      std::array<std::uint64_t,NSections> lengths ;
+      for ( std::size_t s = 0 ; s < NSections ; ++s ) { lengths [ s ] = data [ s ].second ; }
+      const FileHeader header = fileHeader ( n , m , lengths ) ;
+      //
+      std::FILE* file = std::fopen ( name.c_str () , "wb" ) ;
+      if ( !file ) { throw std::runtime_error ( "Cannot open '" + name + "'" ) ; }
+      bool ok = 1 == std::fwrite ( &header , sizeof ( header ) , 1 , file ) ;
+      std::uint64_t written = sizeof ( FileHeader ) ;
+      static const char s_zeros [ s_fileAlignment ] = {} ;
+      for ( std::size_t s = 0 ; ok && s < NSections ; ++s )
+      {
+        const std::uint64_t pad = header.sections [ s ] [ 0 ] - written ;
+        ok = pad == std::fwrite ( s_zeros , 1 , pad , file ) ;
+        if ( ok && 0 < data [ s ].second )
+        { ok = data [ s ].second == std::fwrite ( data [ s ].first , 1 , data [ s ].second , file ) ; }
+        written = header.sections [ s ] [ 0 ] + data [ s ].second ;
+      }
+      ok = 0 == std::fclose ( file ) && ok ;
+      if ( !ok ) { throw std::runtime_error ( "Cannot write '" + name + "'" ) ; }
+    }
+    // ========================================================================
+    /** @class MappedFile
+     *  Read-only memory map of the file, with zero-copy views of the columns.
+     *  The views are valid as long as the object exists
+     */
+    class MappedFile
+    {
+    public:
+      // ======================================================================
+      /** map the file
+       *  @param name the file name
+       *  @exception std::runtime_error for missing or invalid files, e.g.
+       *  inconsistent section lengths or decay trees (see LoKi::HOP::check)
+       */
+      explicit MappedFile ( const std::string& name )
+      {
+        const int fd = ::open ( name.c_str () , O_RDONLY ) ;
+        if ( fd < 0 ) { throw std::runtime_error ( "Cannot open '" + name + "'" ) ; }
+        struct stat st ;
+        if ( 0 != ::fstat ( fd , &st ) || st.st_size < static_cast<off_t> ( sizeof ( FileHeader ) ) )
+        {
+          ::close ( fd ) ;
+          throw std::runtime_error ( "'" + name + "' is not a HOP file" ) ;
+        }
+        m_length = st.st_size ;
+        m_data   = ::mmap ( nullptr , m_length , PROT_READ , MAP_SHARED , fd , 0 ) ;
+        ::close ( fd ) ;
+        if ( MAP_FAILED == m_data )
+        {
+          m_data = nullptr ;
+          throw std::runtime_error ( "Cannot map '" + name + "'" ) ;
+        }
+        //
+        const FileHeader& h = header () ;
+        // the sizes are bounded by the length first, the section lengths
+        // below can not overflow then
+        bool ok = 0 == std::memcmp ( h.magic , "LOKIHOP1" , 8 )
+          && 0x01020304    == h.endian
+          && s_fileVersion == h.version
+          && h.size  < m_length / sizeof ( std::uint64_t )
+          && h.nodes < m_length / sizeof ( std::int32_t  ) ;
+        for ( std::size_t s = 0 ; ok && s < NSections ; ++s )
+        {
+          ok = 0 == h.sections [ s ] [ 0 ] % s_fileAlignment
+            && h.sections [ s ] [ 0 ] <= m_length
+            && h.sections [ s ] [ 1 ] <= m_length - h.sections [ s ] [ 0 ] ;
+        }
+        ok = ok
+          && h.sections [ Offsets ] [ 1 ] == ( h.size + 1 ) * sizeof ( std::uint64_t )
+          && h.sections [ Parent  ] [ 1 ] == h.nodes * sizeof ( std::int32_t )
+          && h.sections [ Pid     ] [ 1 ] == h.nodes * sizeof ( std::int32_t ) ;
+        for ( std::size_t s = Px   ; ok && s <= E   ; ++s ) { ok = h.sections [ s ] [ 1 ] == h.nodes * sizeof ( double ) ; }
+        for ( std::size_t s = EndX ; ok && s <= PvZ ; ++s ) { ok = h.sections [ s ] [ 1 ] == h.size  * sizeof ( double ) ; }
+        ok = ok
+          && ( 0 == h.sections [ MomCov ] [ 1 ] || h.sections [ MomCov ] [ 1 ] == 10 * h.nodes * sizeof ( double ) )
+          && ( 0 == h.sections [ EndCov ] [ 1 ] || h.sections [ EndCov ] [ 1 ] ==  6 * h.size  * sizeof ( double ) )
+          && ( 0 == h.sections [ PvCov  ] [ 1 ] || h.sections [ PvCov  ] [ 1 ] ==  6 * h.size  * sizeof ( double ) ) ;
+        // the decay trees: the offsets and the mothers are used as indices
+        ok = ok
+          && h.nodes == section<std::uint64_t> ( Offsets ) [ h.size ]
+          && 0 == check ( h.size ,
+                          reinterpret_cast<const std::size_t*> ( section<std::uint64_t> ( Offsets ) ) ,
+                          section<std::int32_t> ( Parent ) , h.nodes ) ;
+        if ( !ok )
+        {
+          ::munmap ( m_data , m_length ) ;
+          m_data = nullptr ;
+          throw std::runtime_error ( "'" + name + "' is not a valid HOP file" ) ;
+        }
+      }
+      /// destructor: unmap the file
+      ~MappedFile () { if ( m_data ) { ::munmap ( m_data , m_length ) ; } }
+      // ======================================================================
+      MappedFile            ( const MappedFile& ) = delete ;
+      MappedFile& operator= ( const MappedFile& ) = delete ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /// the header
+      const FileHeader& header () const
+      { return *static_cast<const FileHeader*> ( m_data ) ; }
+      /// the number of candidates
+      std::size_t size  () const { return header ().size  ; }
+      /// the number of nodes
+      std::size_t nodes () const { return header ().nodes ; }
+      // ======================================================================
+      /// the views of the columns
+      Columns columns () const
+      {
+        Columns c ;
+        c.size    = size () ;
+        c.offsets = reinterpret_cast<const std::size_t*> ( section<std::uint64_t> ( Offsets ) ) ;
+        c.parent  = section<std::int32_t> ( Parent ) ;
+        c.pid     = section<std::int32_t> ( Pid    ) ;
+        c.px      = section<double> ( Px   ) ;
+        c.py      = section<double> ( Py   ) ;
+        c.pz      = section<double> ( Pz   ) ;
+        c.e       = section<double> ( E    ) ;
+        c.endx    = section<double> ( EndX ) ;
+        c.endy    = section<double> ( EndY ) ;
+        c.endz    = section<double> ( EndZ ) ;
+        c.pvx     = section<double> ( PvX  ) ;
+        c.pvy     = section<double> ( PvY  ) ;
+        c.pvz     = section<double> ( PvZ  ) ;
+        return c ;
+      }
+      /// the views of the covariances, null if absent
+      FileCovariances covariances () const
+      {
+        FileCovariances cov ;
+        cov.momentum  = 0 < header ().sections [ MomCov ] [ 1 ] ? section<double> ( MomCov ) : nullptr ;
+        cov.endVertex = 0 < header ().sections [ EndCov ] [ 1 ] ? section<double> ( EndCov ) : nullptr ;
+        cov.primary   = 0 < header ().sections [ PvCov  ] [ 1 ] ? section<double> ( PvCov  ) : nullptr ;
+        return cov ;
+      }
+      // ======================================================================
+      /** ask the kernel to read ahead the nodes of the candidates
+       *  <code>[first,last)</code>, e.g. for the next batch
+       */
+      void prefetch ( const std::size_t first , const std::size_t last ) const
+      {
+        const std::uint64_t* offsets = section<std::uint64_t> ( Offsets ) ;
+        const std::size_t    begin   = offsets [ first ] , end = offsets [ last ] ;
+        if ( end <= begin ) { return ; }
+        for ( std::size_t s = Px ; s <= E ; ++s )
+        { advise ( section<double> ( s ) + begin , ( end - begin ) * sizeof ( double ) ) ; }
+        advise ( section<std::int32_t> ( Parent ) + begin , ( end - begin ) * sizeof ( std::int32_t ) ) ;
+        advise ( section<std::int32_t> ( Pid    ) + begin , ( end - begin ) * sizeof ( std::int32_t ) ) ;
+      }
+      // ======================================================================
+    private:
+      // ======================================================================
+      template <class T>
+      const T* section ( const std::size_t s ) const
+      {
+        return reinterpret_cast<const T*>
+          ( static_cast<const char*> ( m_data ) + header ().sections [ s ] [ 0 ] ) ;
+      }
+      /// madvise works on whole pages
+      void advise ( const void* address , const std::size_t length ) const
+      {
+        static const std::size_t s_page = ::sysconf ( _SC_PAGESIZE ) ;
+        const std::uintptr_t a     = reinterpret_cast<std::uintptr_t> ( address ) ;
+        const std::uintptr_t start = a / s_page * s_page ;
+        ::madvise ( reinterpret_cast<void*> ( start ) , a + length - start , MADV_WILLNEED ) ;
+      }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the mapped file
+      void*       m_data   = nullptr ;
+      /// the length of the file
+      std::size_t m_length = 0       ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+  } //                                             end of namespace LoKi::HOP
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOPFILE_H
+// ============================================================================
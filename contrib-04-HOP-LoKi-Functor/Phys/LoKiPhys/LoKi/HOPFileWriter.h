@@ -0,0 +1,165 @@
+// ============================================================================
+#ifndef LOKI_HOPFILEWRITER_H
+#define LOKI_HOPFILEWRITER_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+// ============================================================================
+// GaudiKernel
+// ============================================================================
+#include "GaudiKernel/Kernel.h"
+#include "GaudiKernel/StatusCode.h"
+// ============================================================================
+// Event
+// ============================================================================
+#include "Event/Particle.h"
+#include "Event/VertexBase.h"
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/HOPFile.h"
+// ============================================================================
+/** @file LoKi/HOPFileWriter.h
+ *
+ *  Writer of the flattened decay trees to the memory-mappable file
+ *  of LoKi/HOPFile.h, to be used inside DaVinci, e.g.
+ *
+ *  @code
+ *
+ *   // in the algorithm
+ *   LoKi::Particles::HOPFileWriter m_writer { true } ;
+ *
+ *   // for each event
+ *   for ( const LHCb::Particle* p : particles )
+ *   { m_writer.add ( p , bestVertex ( p ) ) ; }
+ *
+ *   // at finalization
+ *   m_writer.write ( "candidates.hop" ) ;
+ *
+ *  @endcode
+ *
+ *  @see LoKi::HOP::MappedFile
+ *  @see LoKi::HOP::writeFile
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace Particles
+  {
+    // ========================================================================
+    /** @class HOPFileWriter
+     *  Accumulates the flattened decay trees, in the compressed-sparse-row
+     *  layout of LoKi/HOPColumns.h, and writes them to the file.
+     *
+     *  The memory does not grow with the job: the candidates are kept in
+     *  memory in chunks of fixed size, each full chunk is appended to the
+     *  spool files, one anonymous temporary file per section of the file
+     *  format. At the end the sections are copied into the file, after
+     *  the header made from their lengths. The temporary disk space is
+     *  the size of the file.
+     *
+     *  One writer may be shared by several threads: add(), write() and
+     *  clear() are serialised by a lock, the order of the candidates is
+     *  then the order of the calls
+     */
+    class GAUDI_API HOPFileWriter
+    {
+    public:
+      // ======================================================================
+      /** constructor
+       *  @param covariances store the covariance matrices
+       *  @param chunk       the number of candidates kept in memory
+       */
+      explicit HOPFileWriter ( const bool        covariances = false ,
+                               const std::size_t chunk       = 65536 ) ;
+      /// destructor, removes the spool files
+      ~HOPFileWriter () ;
+      // ======================================================================
+      HOPFileWriter            ( const HOPFileWriter& ) = delete ;
+      HOPFileWriter& operator= ( const HOPFileWriter& ) = delete ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** add the candidate
+       *  @param p  the candidate
+       *  @param pv the (best) primary vertex, NaN position if null
+       *  @return false for null candidates, they are not stored
+       */
+      bool add ( const LHCb::Particle*   p      ,
+                 const LHCb::VertexBase* pv     ) ;
+      /** write all candidates to the file, more candidates may be added
+       *  and written afterwards
+       */
+      StatusCode write ( const std::string& name ) ;
+      /// remove all candidates
+      void clear () ;
+      /// the number of candidates
+      std::size_t size () const ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// add the node and its descendants in pre-order
+      void addNode ( const LHCb::Particle* p , const int parent , const std::size_t head ) ;
+      /// add the position and the covariance of the vertex
+      void addVertex ( const LHCb::VertexBase* vx   ,
+                       std::vector<double>&    x    ,
+                       std::vector<double>&    y    ,
+                       std::vector<double>&    z    ,
+                       std::vector<double>&    cov  ) ;
+      /// append the chunk in memory to the spool files and clear it
+      void flush () ;
+      /// append the bytes to the spool file of the section
+      void spool ( const LoKi::HOP::FileSection section ,
+                   const void*                  data    ,
+                   const std::size_t            bytes   ) ;
+      /// close the spool files
+      void close () ;
+      /// clear the chunk in memory
+      void clearChunk () ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// store the covariances?
+      bool                     m_covariances ; // store the covariances?
+      /// the number of candidates kept in memory
+      std::size_t              m_chunk   ;
+      /// the lock of add, write and clear
+      mutable std::mutex       m_mutex   ;
+      /// the spool files and their lengths, one per section
+      std::array<std::FILE*,LoKi::HOP::NSections>     m_spool   ;
+      std::array<std::uint64_t,LoKi::HOP::NSections>  m_spooled ;
+      /// the candidates and the nodes in the spool files
+      std::uint64_t            m_spooledCandidates ;
+      std::uint64_t            m_spooledNodes      ;
+      /// has any spool operation failed?
+      bool                     m_failed  ;
+      /// the columns of the chunk in memory, the offsets relative to the chunk
+      std::vector<std::size_t> m_offsets ;
+      std::vector<int>         m_parent  ;
+      std::vector<int>         m_pid     ;
+      std::vector<double>      m_px , m_py , m_pz , m_e ;
+      std::vector<double>      m_endx , m_endy , m_endz ;
+      std::vector<double>      m_pvx  , m_pvy  , m_pvz  ;
+      /// the packed covariances
+      std::vector<double>      m_momCov , m_endCov , m_pvCov ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+  } //                                       end of namespace LoKi::Particles
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOPFILEWRITER_H
+// ============================================================================
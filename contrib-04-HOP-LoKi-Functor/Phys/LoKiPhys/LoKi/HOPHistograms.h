@@ -0,0 +1,217 @@
+// ============================================================================
+#ifndef LOKI_HOPHISTOGRAMS_H
+#define LOKI_HOPHISTOGRAMS_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/Particles38.h"
+// ============================================================================
+/** @file LoKi/HOPHistograms.h
+ *
+ *  Streaming aggregation of BPVHOPM, BPVHOPALPHA and BPVCORRM into
+ *  fixed-binning histograms per decay channel and run, for calibration
+ *  and data-quality studies without the ntuples, e.g.
+ *
+ *  @code
+ *
+ *   // in the algorithm
+ *   LoKi::Particles::HOPHistograms m_histos { { 120 , 3000 , 7000 } ,
+ *                                             {  50 ,    0 ,    5 } ,
+ *                                             { 120 , 3000 , 9000 } } ;
+ *
+ *   // for each event, from any thread
+ *   m_histos.fill ( "B2Kee" , odin->runNumber() , particles ) ;
+ *
+ *   // at finalization
+ *   m_histos.write ( "hop-summary.txt" ) ;
+ *
+ *  @endcode
+ *
+ *  @see LoKi::Particles::BestVertexColumns
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace Particles
+  {
+    // ========================================================================
+    /** @class HOPHistograms
+     *  Histograms of the HOP mass, the HOP ratio and the corrected mass,
+     *  and the 2D histogram of the HOP mass versus the HOP ratio, one set
+     *  per decay channel and run.
+     *
+     *  The histograms are filled into per-thread shards without locks
+     *  and merged at the end of the job. The values are evaluated for the
+     *  whole container in one batched pass (see BestVertexColumns), thus
+     *  they are the same as from BPVHOPM, BPVHOPALPHA and BPVCORRM.
+     *
+     *  Each axis has the underflow (bin 0) and the overflow (bin
+     *  <code>bins+1</code>) bins; the invalid candidates, with
+     *  LoKi::Constants::InvalidMass etc., go to the underflow.
+     *  NaN values are not binned, only counted, for each quantity
+     *  independently: the 2D histogram takes the candidates with both
+     *  the HOP mass and the HOP ratio defined.
+     *
+     *  The shards are not locked: merge() and write() read them, thus
+     *  they must be called when all fills are finished (at finalization)
+     */
+    class GAUDI_API HOPHistograms
+    {
+    public:
+      // ======================================================================
+      /** @struct Axis
+       *  Fixed binning
+       */
+      struct Axis
+      {
+        // ====================================================================
+        /// the number of bins
+        std::size_t bins ;
+        /// the low edge
+        double      low  ;
+        /// the high edge
+        double      high ;
+        // ====================================================================
+        /// the bin of the value, with the underflow and the overflow
+        std::size_t bin ( const double x ) const ;
+        // ====================================================================
+      } ;
+      // ======================================================================
+      /** @struct Set
+       *  The histograms of one decay channel and run,
+       *  the counts include the underflow and the overflow
+       */
+      struct Set
+      {
+        // ====================================================================
+        /// the number of candidates
+        std::uint64_t              entries    = 0 ;
+        /// the number of NaN values of the HOP mass, HOP ratio and corrected mass
+        std::uint64_t              nanHopMass = 0 ;
+        std::uint64_t              nanAlpha   = 0 ;
+        std::uint64_t              nanMCorr   = 0 ;
+        /// HOP mass, HOP ratio and corrected mass
+        std::vector<std::uint64_t> hopMass ;
+        std::vector<std::uint64_t> alpha   ;
+        std::vector<std::uint64_t> mCorr   ;
+        /// HOP mass versus HOP ratio, <code>( hopMass bin ) * ( alpha.bins + 2 ) + alpha bin</code>
+        std::vector<std::uint64_t> hopMassAlpha ;
+        // ====================================================================
+      } ;
+      // ======================================================================
+      /// the key of the set: the decay channel and the run
+      typedef std::pair<std::string,unsigned int> Key ;
+      /// all sets
+      typedef std::map<Key,Set>                   Sets ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** constructor
+       *  @param hopMass the binning of the HOP mass
+       *  @param alpha   the binning of the HOP ratio
+       *  @param mCorr   the binning of the corrected mass
+       */
+      HOPHistograms
+      ( const Axis& hopMass = Axis { 100 , 0 , 10000 } ,
+        const Axis& alpha   = Axis { 100 , 0 ,     5 } ,
+        const Axis& mCorr   = Axis { 100 , 0 , 10000 } ) ;
+      // ======================================================================
+      HOPHistograms            ( const HOPHistograms& ) = delete ;
+      HOPHistograms& operator= ( const HOPHistograms& ) = delete ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** evaluate and fill the candidates, from any thread
+       *  @param channel   the decay channel, without whitespaces
+       *  @param run       the run number
+       *  @param particles the candidates
+       */
+      void fill
+      ( const std::string&           channel   ,
+        const unsigned int           run       ,
+        const LHCb::Particle::Range& particles ) const ;
+      /** fill the values of one candidate, from any thread,
+       *  e.g. from the functors
+       */
+      void fill
+      ( const std::string&           channel   ,
+        const unsigned int           run       ,
+        const double                 hopMass   ,
+        const double                 alpha     ,
+        const double                 mCorr     ) const ;
+      // ======================================================================
+      /** merge the shards of all threads.
+       *  To be called after all fills are done, e.g. at finalization:
+       *  the shards are filled without locks, a fill running in another
+       *  thread during the merge is a data race. It is reported as an
+       *  error, the result is then undefined
+       */
+      Sets merge () const ;
+      /** merge and write the summary file:
+       *  @code
+       *   # LoKi::Particles::HOPHistograms 2
+       *   SET <channel> <run> <entries> <NaN HOPM> <NaN HOPALPHA> <NaN CORRM>
+       *   H1 HOPM <bins> <low> <high> <bin>:<count> ...
+       *   H1 HOPALPHA ...
+       *   H1 CORRM ...
+       *   H2 HOPM:HOPALPHA <bins> <low> <high> <bins> <low> <high> <bin>:<count> ...
+       *  @endcode
+       *  Only the non-empty bins are written
+       */
+      StatusCode write ( const std::string& name ) const ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the sets filled by one thread
+      typedef std::map<Key,Set> Shard ;
+      /// the shard of the current thread
+      Shard& shard () const ;
+      /// the set of the channel and run in the shard
+      Set&   set   ( Shard& shard , const std::string& channel , const unsigned int run ) const ;
+      /// fill the values into the set
+      void   fill  ( Set& set , const double hopMass , const double alpha , const double mCorr ) const ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the binning
+      Axis                                 m_hopMass ;
+      Axis                                 m_alpha   ;
+      Axis                                 m_mCorr   ;
+      /// the batched evaluation
+      BestVertexColumns                    m_columns ;
+      /** the handle of the instance for the thread-local registries of the
+       *  shards: they keep it weakly, thus the entries of a destroyed
+       *  instance expire and are never confused with a new instance
+       */
+      std::shared_ptr<const void>          m_token   ;
+      /// the shards of all threads
+      mutable std::mutex                   m_mutex   ;
+      mutable std::vector<std::unique_ptr<Shard> > m_shards ;
+      /// the number of fills in progress, to detect a concurrent merge
+      mutable std::atomic<unsigned int>    m_filling { 0 } ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+  } //                                       end of namespace LoKi::Particles
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOPHISTOGRAMS_H
+// ============================================================================
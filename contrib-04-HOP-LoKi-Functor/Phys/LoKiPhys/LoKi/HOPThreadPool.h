@@ -0,0 +1,282 @@
+// ============================================================================
+#ifndef LOKI_HOPTHREADPOOL_H
+#define LOKI_HOPTHREADPOOL_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+// ============================================================================
+/** @file LoKi/HOPThreadPool.h
+ *
+ *  Work-stealing thread pool for the loops over batches of candidates,
+ *  e.g. for the standalone reprocessing of the corrected mass and the
+ *  HOP mass from flat columns (see LoKi/HOPColumns.h).
+ *  Like LoKi/HOP.h the header has no dependency on Gaudi or LoKi.
+ *
+ *  @code
+ *
+ *   LoKi::HOP::WorkStealingPool pool ( 8 ) ;
+ *   pool.run ( nBatches ,
+ *              [&] ( std::size_t batch , std::size_t worker ) { ... } ,
+ *              [&] ( std::size_t batch ) { ... prefetch the inputs ... } ) ;
+ *
+ *  @endcode
+ *
+ *  @see LoKi::HOP::evaluateArrays
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace HOP
+  {
+    // ========================================================================
+    /** @class WorkStealingPool
+     *  Fixed pool of worker threads for the loops over batch indices.
+     *
+     *  Each worker owns a contiguous range of the batches and takes them
+     *  from the front; an idle worker steals the back half of the largest
+     *  remaining range, thus the load is balanced for batches of uneven
+     *  cost with little contention. Before running a batch, the worker
+     *  passes the next batch of its range to the prefetch callback, so
+     *  its inputs are in flight while the current one is computed.
+     *
+     *  The calling thread takes part in the loop as worker 0.
+     *  The assignment of the batches to the workers is not deterministic:
+     *  the body has to write its results to the places given by the
+     *  batch index only, then the results do not depend on the schedule.
+     */
+    class WorkStealingPool
+    {
+    public:
+      // ======================================================================
+      /// the body of the loop <code>body ( batch , worker )</code>
+      typedef std::function<void ( std::size_t , std::size_t )> Body     ;
+      /// the prefetch callback <code>prefetch ( batch )</code>
+      typedef std::function<void ( std::size_t )>               Prefetch ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** constructor
+       *  @param nThreads the number of workers, including the calling thread
+       */
+      explicit WorkStealingPool
+      ( const std::size_t nThreads = std::thread::hardware_concurrency () )
+        : m_size   ( std::max<std::size_t> ( 1 , nThreads ) )
+        , m_ranges ( new Range [ std::max<std::size_t> ( 1 , nThreads ) ] )
+      {
+        m_threads.reserve ( m_size - 1 ) ;
+        for ( std::size_t w = 1 ; w < m_size ; ++w )
+        { m_threads.emplace_back ( [this,w] () { this->loop ( w ) ; } ) ; }
+      }
+      /// destructor: stop and join the workers
+      ~WorkStealingPool ()
+      {
+        {
+          std::lock_guard<std::mutex> guard ( m_mutex ) ;
+          m_stop = true ;
+        }
+        m_start.notify_all () ;
+        for ( std::thread& t : m_threads ) { t.join () ; }
+      }
+      // ======================================================================
+      WorkStealingPool            ( const WorkStealingPool& ) = delete ;
+      WorkStealingPool& operator= ( const WorkStealingPool& ) = delete ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /// the number of workers
+      std::size_t size () const { return m_size ; }
+      // ======================================================================
+      /** run the body for all batches <code>[0,n)</code>, wait for the end.
+       *  The first exception thrown by the body is rethrown here,
+       *  the remaining batches are skipped
+       *  @param n        the number of batches
+       *  @param body     the body of the loop
+       *  @param prefetch the prefetch callback, optional
+       */
+      void run ( const std::size_t n , Body body , Prefetch prefetch = Prefetch () )
+      {
+        if ( 0 == n ) { return ; }
+        // the initial ranges: equal shares
+        for ( std::size_t w = 0 ; w < m_size ; ++w )
+        {
+          std::lock_guard<std::mutex> guard ( m_ranges [ w ].lock ) ;
+          m_ranges [ w ].begin = n *   w       / m_size ;
+          m_ranges [ w ].end   = n * ( w + 1 ) / m_size ;
+        }
+        {
+          std::lock_guard<std::mutex> guard ( m_mutex ) ;
+          m_body     = std::move ( body     ) ;
+          m_prefetch = std::move ( prefetch ) ;
+          m_error    = nullptr ;
+          m_failed.store ( false , std::memory_order_relaxed ) ;
+          m_pending  = m_size - 1 ;
+          ++m_generation ;
+        }
+        m_start.notify_all () ;
+        //
+        work ( 0 ) ;
+        //
+        std::unique_lock<std::mutex> lock ( m_mutex ) ;
+        m_done.wait ( lock , [this] () { return 0 == m_pending ; } ) ;
+        m_body     = Body     () ;
+        m_prefetch = Prefetch () ;
+        if ( m_error ) { std::rethrow_exception ( m_error ) ; }
+      }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the range of the batches owned by the worker
+      struct Range
+      {
+        std::mutex  lock      ;
+        std::size_t begin = 0 ;
+        std::size_t end   = 0 ;
+      } ;
+      // ======================================================================
+      /// the loop of the worker thread
+      void loop ( const std::size_t w )
+      {
+        std::size_t seen = 0 ;
+        while ( true )
+        {
+          {
+            std::unique_lock<std::mutex> lock ( m_mutex ) ;
+            m_start.wait ( lock , [this,seen] () { return m_stop || seen != m_generation ; } ) ;
+            if ( m_stop ) { return ; }
+            seen = m_generation ;
+          }
+          work ( w ) ;
+          {
+            std::lock_guard<std::mutex> guard ( m_mutex ) ;
+            --m_pending ;
+          }
+          m_done.notify_all () ;
+        }
+      }
+      // ======================================================================
+      /// run the batches of the worker, then steal until nothing is left
+      void work ( const std::size_t w )
+      {
+        std::size_t batch = 0 ;
+        while ( true )
+        {
+          if ( !take ( w , batch ) )
+          {
+            if ( steal ( w ) ) { continue ; }
+            break ;                                              // BREAK
+          }
+          if ( m_failed.load ( std::memory_order_relaxed ) ) { continue ; }
+          try
+          {
+            std::size_t next = 0 ;
+            if ( m_prefetch && peek ( w , next ) ) { m_prefetch ( next ) ; }
+            m_body ( batch , w ) ;
+          }
+          catch ( ... )
+          {
+            std::lock_guard<std::mutex> guard ( m_mutex ) ;
+            if ( !m_error ) { m_error = std::current_exception () ; }
+            m_failed.store ( true , std::memory_order_relaxed ) ;
+          }
+        }
+      }
+      // ======================================================================
+      /// take the next batch of the worker
+      bool take ( const std::size_t w , std::size_t& batch )
+      {
+        Range& r = m_ranges [ w ] ;
+        std::lock_guard<std::mutex> guard ( r.lock ) ;
+        if ( r.end <= r.begin ) { return false ; }
+        batch = r.begin++ ;
+        return true ;
+      }
+      // ======================================================================
+      /// the next batch of the worker, if any
+      bool peek ( const std::size_t w , std::size_t& batch )
+      {
+        Range& r = m_ranges [ w ] ;
+        std::lock_guard<std::mutex> guard ( r.lock ) ;
+        if ( r.end <= r.begin ) { return false ; }
+        batch = r.begin ;
+        return true ;
+      }
+      // ======================================================================
+      /// steal the back half of the largest range of the other workers
+      bool steal ( const std::size_t w )
+      {
+        while ( true )
+        {
+          // find the victim, the sizes are only a hint
+          std::size_t victim = m_size , largest = 0 ;
+          for ( std::size_t v = 0 ; v < m_size ; ++v )
+          {
+            if ( v == w ) { continue ; }
+            std::lock_guard<std::mutex> guard ( m_ranges [ v ].lock ) ;
+            const std::size_t left = m_ranges [ v ].end > m_ranges [ v ].begin ?
+              m_ranges [ v ].end - m_ranges [ v ].begin : 0 ;
+            if ( left > largest ) { largest = left ; victim = v ; }
+          }
+          if ( m_size == victim ) { return false ; }     // nothing is left
+          //
+          std::size_t begin = 0 , end = 0 ;
+          {
+            Range& r = m_ranges [ victim ] ;
+            std::lock_guard<std::mutex> guard ( r.lock ) ;
+            if ( r.end <= r.begin ) { continue ; }       // taken meanwhile
+            const std::size_t middle = r.begin + ( r.end - r.begin ) / 2 ;
+            begin = middle ;
+            end   = r.end  ;
+            r.end = middle ;
+          }
+          Range& own = m_ranges [ w ] ;
+          std::lock_guard<std::mutex> guard ( own.lock ) ;
+          own.begin = begin ;
+          own.end   = end   ;
+          return true ;
+        }
+      }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the number of workers
+      std::size_t                m_size       ;
+      /// the ranges of the workers
+      std::unique_ptr<Range[]>   m_ranges     ;
+      /// the worker threads
+      std::vector<std::thread>   m_threads    ;
+      /// the synchronisation of the loops
+      std::mutex                 m_mutex      ;
+      std::condition_variable    m_start      ;
+      std::condition_variable    m_done       ;
+      std::size_t                m_generation = 0     ;
+      std::size_t                m_pending    = 0     ;
+      bool                       m_stop       = false ;
+      /// the current loop
+      Body                       m_body       ;
+      Prefetch                   m_prefetch   ;
+      std::exception_ptr         m_error      ;
+      std::atomic<bool>          m_failed     { false } ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+  } //                                             end of namespace LoKi::HOP
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOPTHREADPOOL_H
+// ============================================================================
@@ -4,11 +4,22 @@
 // ============================================================================
 // Include files
 // ============================================================================
+// STD & STL
+// ============================================================================
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+// ============================================================================
 // LoKi
 // ============================================================================
 #include "LoKi/Particles0.h"
 #include "LoKi/VertexHolder.h"
 #include "LoKi/AuxDesktopBase.h"
+#include "LoKi/HOP.h"
 // ============================================================================
 /** @file LoKi/Particles38.h
  *
@@ -37,6 +48,255 @@ namespace LoKi
   // ==========================================================================
   namespace Particles 
   {
+    // ========================================================================
+    /** @class Diagnostics 
+     *  Lock-free counters of the calls and of the invalid inputs of 
+     *  the functors from this file. The messages are limited to 
+     *  a few per event, the rest is only counted. 
+     *
+     *  The summary is reported once: by reportAll() from finalize() of 
+     *  the algorithm or tool that owns the functors, while the message 
+     *  service is still there, otherwise when the last clone of the 
+     *  functor is destroyed 
+     *
+     *  @code 
+     *
+     *   StatusCode MyAlg::finalize () 
+     *   {
+     *     LoKi::Particles::Diagnostics::reportAll () ;
+     *     return DaVinciAlgorithm::finalize () ;
+     *   }
+     *
+     *  @endcode 
+     *  @see LoKi::Particles::DiagnosticsHolder
+     */
+    // ========================================================================
+    class GAUDI_API Diagnostics 
+    {
+    public:
+      // ======================================================================
+      /// the categories of the problems 
+      enum Category 
+        { 
+          NoParticle      = 0 , // invalid argument 
+          NoEndVertex         , // no decay vertex 
+          NoBestVertex        , // no best primary vertex 
+          NoPrimaryVertex     , // no (valid) primary vertex 
+          NoTool              , // no distance calculator 
+          BadAlpha            , // non-finite HOP alpha, pT_e = 0 
+          VertexMismatch      , // the index and the relator disagree 
+          NCategories 
+        } ;
+      // ======================================================================
+      /// the maximal number of messages per event 
+      static constexpr unsigned s_maxMessages = 3 ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /// count the calls 
+      void calls   ( const std::size_t n = 1 ) 
+      { m_calls.fetch_add ( n , std::memory_order_relaxed ) ; }
+      /** count the problem 
+       *  @return true if the message is to be printed 
+       */
+      bool problem ( const Category c , const std::size_t n = 1 ) ;
+      /// the number of calls 
+      unsigned long long calls   () const 
+      { return m_calls.load ( std::memory_order_relaxed ) ; }
+      /// the number of problems of the given category 
+      unsigned long long counter ( const Category c ) const 
+      { return m_counters [ c ].load ( std::memory_order_relaxed ) ; }
+      /// count the lookups in the event-scoped memo 
+      void lookup  ( const bool hit , const std::size_t n = 1 ) 
+      { ( hit ? m_hits : m_misses ).fetch_add ( n , std::memory_order_relaxed ) ; }
+      /// the lookups that found the result in the memo 
+      unsigned long long hits    () const 
+      { return m_hits  .load ( std::memory_order_relaxed ) ; }
+      /// the lookups that did not find the result in the memo 
+      unsigned long long misses  () const 
+      { return m_misses.load ( std::memory_order_relaxed ) ; }
+      /// the summary, empty if there were no problems 
+      std::string summary () const ;
+      /** report the summary, unless it is empty or already reported 
+       *  @return true if the summary is reported now 
+       */
+      bool report () ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** report the summaries of all existing diagnostics, e.g. from 
+       *  finalize() of the algorithm or tool that owns the functors 
+       *  @return the number of the reported summaries 
+       */
+      static std::size_t reportAll () ;
+      /// register the diagnostics for reportAll, kept as a weak handle 
+      static void record ( const std::shared_ptr<Diagnostics>& diagnostics ) ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the calls 
+      std::atomic<unsigned long long> m_calls { 0 } ;
+      /// the problems 
+      std::array<std::atomic<unsigned long long>,NCategories> m_counters {} ;
+      /// the lookups in the memo 
+      std::atomic<unsigned long long> m_hits   { 0 } ;
+      std::atomic<unsigned long long> m_misses { 0 } ;
+      /// the bits of the count of the messages in the packed word 
+      static constexpr unsigned           s_countBits = 8 ;
+      static constexpr unsigned long long s_countMask = ( 1ull << s_countBits ) - 1 ;
+      /// the event of the last message and the messages in this event, 
+      /// packed as <code>event << s_countBits | count</code> 
+      std::atomic<unsigned long long> m_messages { 0 } ;
+      /// is the summary already reported? 
+      std::atomic<bool>               m_reported { false } ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class Memo 
+     *  The switch of the event-scoped memo of the per-candidate results 
+     *  (the best primary vertex with the flight direction, the HOP 
+     *  quantities, the electron content of the composites), shared by 
+     *  all functors from this file and all threads. 
+     *  The entries are tagged with the event number, thus the memo is 
+     *  cleared at the end of the event. It is on by default.
+     *  The hits and misses are counted by the diagnostics of each functor 
+     *
+     *  @code 
+     *
+     *   // evaluate everything from scratch, e.g. for the timing 
+     *   LoKi::Particles::Memo::enable ( false ) ;
+     *
+     *  @endcode 
+     *
+     *  @see LoKi::Particles::Diagnostics::hits 
+     *  @see LoKi::Particles::Diagnostics::misses 
+     */
+    // ========================================================================
+    struct GAUDI_API Memo 
+    {
+      // ======================================================================
+      /// switch the memo on or off 
+      static void enable  ( const bool value ) ;
+      /// is the memo on?
+      static bool enabled () ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class BestVertexIndex 
+     *  The switch of the best-vertex association with the event-level 
+     *  index of the primary vertices, for all BPV* functors from this file.
+     *
+     *  The relator of the desktop takes the stored relation of the 
+     *  particle, if any, otherwise it scans all primary vertices for the 
+     *  smallest IP chi2. With the index the functors do the scan 
+     *  themselves, with the same distance calculator: the vertices are 
+     *  visited from the closest in z to the particle trajectory outwards, 
+     *  and the vertices that cannot have a smaller IP chi2, from the 
+     *  geometric impact parameter and the bounds of the covariances, are 
+     *  not passed to the distance calculator. The equal IP chi2 values 
+     *  are resolved by the order of the container, as by the relator.
+     *
+     *  The stored relations and the refitted vertices are not seen by the 
+     *  index: switch it on only when the job uses neither. It is off by 
+     *  default. With the verification both associations are made, the 
+     *  relator is used, and the differences are counted by the 
+     *  diagnostics of the functor 
+     *
+     *  @code 
+     *
+     *   // no stored relations, no refit: the association from the index 
+     *   LoKi::Particles::BestVertexIndex::enable ( true ) ;
+     *   // compare with the relator, for the validation 
+     *   LoKi::Particles::BestVertexIndex::verify ( true ) ;
+     *
+     *  @endcode 
+     *
+     *  @see LoKi::Particles::Diagnostics::VertexMismatch 
+     */
+    // ========================================================================
+    struct GAUDI_API BestVertexIndex 
+    {
+      // ======================================================================
+      /// switch the association with the index on or off 
+      static void enable    ( const bool value ) ;
+      /// is the association with the index on?
+      static bool enabled   () ;
+      /// switch the comparison with the relator on or off 
+      static void verify    ( const bool value ) ;
+      /// is the comparison with the relator on?
+      static bool verifying () ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class DiagnosticsHolder 
+     *  Keeps the diagnostics, shared by all clones of the functor.
+     *  The summary is printed when the last clone is destroyed 
+     *  @see LoKi::Particles::Diagnostics
+     */
+    // ========================================================================
+    struct GAUDI_API DiagnosticsHolder : virtual LoKi::AuxFunBase 
+    {
+      // ======================================================================
+      /// constructor: register the diagnostics for the report at finalize 
+      DiagnosticsHolder () ;
+      /// the clones share the diagnostics 
+      DiagnosticsHolder ( const DiagnosticsHolder& ) = default ;
+      /// destructor: report the summary, unless it is already reported 
+      ~DiagnosticsHolder() override ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /// count the calls 
+      void countCalls ( const std::size_t n = 1 ) const 
+      { m_diagnostics -> calls ( n ) ; }
+      /** count the problem 
+       *  @return true if the message is to be printed 
+       */
+      bool diagnose 
+      ( const Diagnostics::Category c , const std::size_t n = 1 ) const 
+      { return m_diagnostics -> problem ( c , n ) ; }
+      /// count the lookups in the event-scoped memo 
+      void memo ( const bool hit , const std::size_t n = 1 ) const 
+      { m_diagnostics -> lookup ( hit , n ) ; }
+      /// the diagnostics 
+      const Diagnostics& diagnostics () const { return *m_diagnostics ; }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the diagnostics 
+      std::shared_ptr<Diagnostics> m_diagnostics 
+        { std::make_shared<Diagnostics> () } ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class DesktopHolder 
+     *  Loads the desktop once, at the first evaluation, also when the 
+     *  same functor is evaluated concurrently from many threads: the 
+     *  functor itself is not modified afterwards. 
+     *  Each clone loads its own desktop 
+     */
+    // ========================================================================
+    struct GAUDI_API DesktopHolder : virtual LoKi::AuxDesktopBase 
+    {
+      // ======================================================================
+      /// load the desktop, unless it is already loaded 
+      void loadDesktopOnce () const ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the flag of the loading, the copy is not loaded yet 
+      struct Once 
+      {
+        Once () = default ;
+        Once            ( const Once& ) {}
+        Once& operator= ( const Once& ) { return *this ; }
+        std::once_flag flag ;
+      } ;
+      // ======================================================================
+      /// the flag of the loading 
+      mutable Once m_once ;
+      // ======================================================================
+    } ;
     // ========================================================================
     /** @class PtFlight 
      *  Simple evaluator for transverse momentum relative to flight direction 
@@ -50,6 +310,7 @@ namespace LoKi
     struct GAUDI_API PtFlight
       : LoKi::Particles::TransverseMomentumRel  
       , LoKi::Vertices::VertexHolder    
+      , LoKi::Particles::DiagnosticsHolder
     {
       // ======================================================================
       /** constructor from the primary vertex
@@ -108,6 +369,18 @@ namespace LoKi
         const LoKi::Point3D&       pv ) const 
       { return mCorrDir ( p , sv - pv ) ; }
       // ======================================================================
+    public:
+      // ======================================================================
+      /** evaluate the functor for all particles of the container at once.
+       *  The momenta and flight directions are gathered into contiguous 
+       *  arrays and the projections are evaluated by vectorised kernels,
+       *  avoiding the virtual call and the scalar math per candidate 
+       *  @param particles (INPUT)  the particles 
+       *  @param results   (OUTPUT) the results, one per particle 
+       */
+      virtual void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const ;
+      // ======================================================================
     } ;
     // ========================================================================
     /** @class MCorrected
@@ -153,9 +426,21 @@ namespace LoKi
       result_type operator() ( argument p ) const override;
       /// OPTIONAL: the specific printout 
       std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
       // ======================================================================
     } ;
     // ========================================================================
+    /** @typedef HOPInfo
+     *  All quantities from one HOP evaluation of the candidate.
+     *  They are evaluated together and shared by the whole HOP family 
+     *  @see LoKi::HOP::Info 
+     *  @see LoKi::Particles::BremMCorrected
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     */
+    typedef LoKi::HOP::Info HOPInfo ;
+    // ========================================================================
     /** @class BremMCorrected
      *  Simple evaluator for 'HOP' mass 
      *  
@@ -191,15 +476,17 @@ namespace LoKi
       result_type operator () ( argument p ) const override;
       // OPTIONAL: the specific printout
       std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
       // ======================================================================
-      bool has_electron (const LHCb::Particle *parent) const;
-      bool has_only_electrons (const LHCb::Particle *parent) const;
-      bool classify (const LHCb::Particle *parent) const;
-      std::vector <LHCb::Particle*> *m_all_electrons  = new std::vector<LHCb::Particle*>;
-      std::vector <LHCb::Particle*> *m_rest_electrons  = new std::vector<LHCb::Particle*>;
-      std::vector <LHCb::Particle*> *m_electron_mothers  = new std::vector<LHCb::Particle*>;
-      std::vector <LHCb::Particle*> *m_others  = new std::vector<LHCb::Particle*>;
-      static constexpr double m_e_PDG = 0.510998910;
+      /** evaluate all HOP quantities for the candidate 
+       *  @param p    (INPUT)  the candidate 
+       *  @param info (OUTPUT) the HOP quantities 
+       *  @return false for invalid input 
+       */
+      bool hop ( argument p , HOPInfo& info ) const ;
+      static constexpr double m_e_PDG = LoKi::HOP::s_electronMass ;
       // ========================================================================
     };
     // ========================================================================
@@ -212,8 +499,8 @@ namespace LoKi
      */
     // ========================================================================
     struct GAUDI_API PtFlightWithBestVertex 
-      :          LoKi::Particles::PtFlight 
-      , virtual  LoKi::AuxDesktopBase 
+      : LoKi::Particles::PtFlight 
+      , LoKi::Particles::DesktopHolder 
     {
       // =====================================================================
       /// constructor 
@@ -224,6 +511,24 @@ namespace LoKi
       result_type operator() ( argument p ) const override;
       /// OPTIONAL: the specific printout 
       std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** get the best primary vertex and the flight direction of the particle.
+       *  The vertex is taken from the relator of the desktop, as 
+       *  <code>bestVertex</code>, or from the event-level index of the 
+       *  primary vertices, if it is switched on. Both are kept in the 
+       *  event-scoped cache shared by all functors from this file 
+       *  @see LoKi::Particles::BestVertexIndex 
+       *  @param p      (INPUT)  the particle with valid end-vertex 
+       *  @param flight (OUTPUT) the normalised SV-PV flight vector 
+       *  @return the best primary vertex, nullptr if there is none 
+       */
+      const LHCb::VertexBase* bestFlight 
+      ( argument p , LoKi::ThreeVector& flight ) const ;
       // ======================================================================
     } ;  
     // ========================================================================
@@ -251,12 +556,25 @@ namespace LoKi
       // =====================================================================
       /// constructor 
       MCorrectedWithBestVertex() = default;
+      /** constructor 
+       *  @param fast use the single precision, branch-free evaluation 
+       *  @see LoKi::HOP::mCorrFast
+       */
+      explicit MCorrectedWithBestVertex ( const bool fast ) ;
       /// MANDATORY: clone method ("virtual constructor")
       MCorrectedWithBestVertex* clone() const override;
       /// MANDATORY: the only one essential method 
       result_type operator() ( argument p ) const override;
       /// OPTIONAL: the specific printout 
       std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// use the single precision evaluation?
+      bool m_fast = false ;
       // ======================================================================
     } ;  
     // ========================================================================
@@ -266,6 +584,17 @@ namespace LoKi
      *  For more information see 
      *  <a href="https://cds.cern.ch/record/2102345/files/LHCb-INT-2015-037.pdf">
      *
+     *  Within the event the decompositions of the sub-decays are shared
+     *  by all candidates built from them, as the momenta only. The
+     *  sub-decays with more than <code>LoKi::HOP::Partial::MaxElectrons</code>
+     *  (4) electrons to be corrected or more than
+     *  <code>LoKi::HOP::Partial::MaxLeaves</code> (8) contributions are not
+     *  shared, but walked again for each candidate: the results are the
+     *  same, only slower. The momenta are summed in the same order as for
+     *  BPVHOPMERR, thus the values do not depend on the order of the
+     *  evaluations within the event.
+     *
+     *  @see LoKi::HOP::Partial
      *  @authors Pavol Stefko pavol.stefko@epfl.ch, Guido Andreassi guido.andreassi@epfl.ch, Violaine Bellee violaine.bellee@epfl.ch
      *  @date   2017-01-17
      */
@@ -275,24 +604,494 @@ namespace LoKi
       // =====================================================================
       /// constructor 
       BremMCorrectedWithBestVertex() = default;
+      /** constructor 
+       *  @param fast use the single precision, branch-free evaluation, 
+       *              that does not use the event cache of the exact results 
+       *  @see LoKi::HOP::hopMassFast
+       */
+      explicit BremMCorrectedWithBestVertex ( const bool fast ) ;
       /// MANDATORY: clone method ("virtual constructor")
       BremMCorrectedWithBestVertex* clone() const override;
       /// MANDATORY: the only one essential method 
       result_type operator() ( argument p ) const override;
       /// OPTIONAL: the specific printout 
       std::ostream& fillStream( std::ostream& s ) const override;
-      bool has_electron (const LHCb::Particle *parent) const;
-      bool has_only_electrons (const LHCb::Particle *parent) const;
-      bool classify (const LHCb::Particle *parent) const;
-      std::vector <LHCb::Particle*> *m_all_electrons  = new std::vector<LHCb::Particle*>;
-      std::vector <LHCb::Particle*> *m_rest_electrons  = new std::vector<LHCb::Particle*>;
-      std::vector <LHCb::Particle*> *m_electron_mothers  = new std::vector<LHCb::Particle*>;
-      std::vector <LHCb::Particle*> *m_others  = new std::vector<LHCb::Particle*>;
-      static constexpr double m_e_PDG = 0.510998910;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+      /** evaluate all HOP quantities for the candidate 
+       *  @param p     (INPUT)  the candidate 
+       *  @param info  (OUTPUT) the HOP quantities 
+       *  @param error (INPUT)  evaluate also the uncertainty of the HOP mass 
+       *  @param what  (INPUT)  the quantity, for the messages: "Mass", "Pt", ...
+       *  @return false for invalid input 
+       */
+      bool hop ( argument    p              , 
+                 HOPInfo&    info           , 
+                 const bool  error = false  , 
+                 const char* what  = "Mass" ) const ;
+      static constexpr double m_e_PDG = LoKi::HOP::s_electronMass ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// use the single precision evaluation?
+      bool m_fast = false ;
       // ======================================================================
     } ;  
     // ========================================================================
-  }  //                                        end of namespace LoKi::Particles 
+    /** @class HOPAlphaWithBestVertex
+     *  Simple evaluator for the HOP ratio 
+     *  \f$ \alpha_{HOP} = p_T^{h} / p_T^{e} \f$ 
+     *  with respect to the best primary vertex.
+     *
+     *  The HOP quantities are evaluated once per candidate and 
+     *  shared by all members of the BPVHOP* family
+     *  @see LoKi::Cuts::BPVHOPALPHA
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     */
+    // ========================================================================
+    struct GAUDI_API HOPAlphaWithBestVertex : BremMCorrectedWithBestVertex 
+    {
+      // ======================================================================
+      /// constructor 
+      HOPAlphaWithBestVertex() = default;
+      /// MANDATORY: clone method ("virtual constructor")
+      HOPAlphaWithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method 
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout 
+      std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class HOPPtEWithBestVertex
+     *  Simple evaluator for the transverse momentum of the electronic part 
+     *  of the candidate with respect to its flight direction 
+     *  @see LoKi::Cuts::BPVHOPPTE
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     */
+    // ========================================================================
+    struct GAUDI_API HOPPtEWithBestVertex : BremMCorrectedWithBestVertex 
+    {
+      // ======================================================================
+      /// constructor 
+      HOPPtEWithBestVertex() = default;
+      /// MANDATORY: clone method ("virtual constructor")
+      HOPPtEWithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method 
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout 
+      std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class HOPPtHWithBestVertex
+     *  Simple evaluator for the transverse momentum of the hadronic part 
+     *  of the candidate with respect to its flight direction 
+     *  @see LoKi::Cuts::BPVHOPPTH
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     */
+    // ========================================================================
+    struct GAUDI_API HOPPtHWithBestVertex : BremMCorrectedWithBestVertex 
+    {
+      // ======================================================================
+      /// constructor 
+      HOPPtHWithBestVertex() = default;
+      /// MANDATORY: clone method ("virtual constructor")
+      HOPPtHWithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method 
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout 
+      std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class HOPElectronMassWithBestVertex
+     *  Simple evaluator for the mass of the HOP-corrected electronic system 
+     *  @see LoKi::Cuts::BPVHOPEM
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     */
+    // ========================================================================
+    struct GAUDI_API HOPElectronMassWithBestVertex : BremMCorrectedWithBestVertex 
+    {
+      // ======================================================================
+      /// constructor 
+      HOPElectronMassWithBestVertex() = default;
+      /// MANDATORY: clone method ("virtual constructor")
+      HOPElectronMassWithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method 
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout 
+      std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class HOPQ2WithBestVertex
+     *  Simple evaluator for \f$ q^2 \f$ of the HOP-corrected electronic system 
+     *  @see LoKi::Cuts::BPVHOPQ2
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     */
+    // ========================================================================
+    struct GAUDI_API HOPQ2WithBestVertex : BremMCorrectedWithBestVertex 
+    {
+      // ======================================================================
+      /// constructor 
+      HOPQ2WithBestVertex() = default;
+      /// MANDATORY: clone method ("virtual constructor")
+      HOPQ2WithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method 
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout 
+      std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class MCorrectedErrorWithBestVertex
+     *  Simple evaluator for the uncertainty of the corrected mass relative 
+     *  to the flight direction, propagated analytically from the covariances 
+     *  of the 4-momentum, of the decay vertex and of the best primary vertex 
+     *  @see LoKi::Cuts::BPVCORRMERR
+     *  @see LoKi::Particles::MCorrectedWithBestVertex
+     *  @see LoKi::HOP::mCorrError
+     */
+    // ========================================================================
+    struct GAUDI_API MCorrectedErrorWithBestVertex : MCorrectedWithBestVertex 
+    {
+      // ======================================================================
+      /// constructor 
+      MCorrectedErrorWithBestVertex() = default;
+      /// MANDATORY: clone method ("virtual constructor")
+      MCorrectedErrorWithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method 
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout 
+      std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class HOPMassErrorWithBestVertex
+     *  Simple evaluator for the uncertainty of the HOP mass, evaluated 
+     *  in the same pass as the HOP mass itself. 
+     *  The momenta of the daughters are considered as uncorrelated 
+     *  @see LoKi::Cuts::BPVHOPMERR
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     *  @see LoKi::HOP::hopMassError
+     */
+    // ========================================================================
+    struct GAUDI_API HOPMassErrorWithBestVertex : BremMCorrectedWithBestVertex 
+    {
+      // ======================================================================
+      /// constructor 
+      HOPMassErrorWithBestVertex() = default;
+      /// MANDATORY: clone method ("virtual constructor")
+      HOPMassErrorWithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method 
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout 
+      std::ostream& fillStream( std::ostream& s ) const override;
+      /// OPTIONAL: evaluate the functor for all particles at once 
+      void evaluate 
+      ( const LHCb::Particle::Range& particles , double* results ) const override ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class MassVertexScan
+     *  Evaluator for the corrected mass or the HOP mass with respect to 
+     *  all primary vertices of the event, reduced to one value: the minimum,
+     *  the maximum or the value for the vertex with the smallest 
+     *  impact parameter \f$\chi^2\f$. The decay tree is walked once, 
+     *  only the projections onto the flight directions are evaluated 
+     *  for each primary vertex.
+     *
+     *  @code 
+     *
+     *   // the minimal HOP mass over all primary vertices:
+     *   const PVSCANM fun  = PVSCANM ( "HOPM" , "MIN" ) ;
+     *   // the index of the vertex with the minimal HOP mass:
+     *   const PVSCANM ifun = PVSCANM ( "HOPM" , "MIN" , true ) ;
+     *
+     *  @endcode 
+     *
+     *  @see LoKi::Cuts::PVSCANM
+     *  @see LoKi::HOP::scan 
+     */
+    // ========================================================================
+    struct GAUDI_API MassVertexScan 
+      : LoKi::BasicFunctors<const LHCb::Particle*>::Function
+      , LoKi::Particles::DesktopHolder 
+      , LoKi::Particles::DiagnosticsHolder
+    {
+      // ======================================================================
+      /// the mass to evaluate 
+      enum Mass      { CorrectedMass , HOPMass } ;
+      /// the reduction over the primary vertices 
+      enum Reduction { Minimum , Maximum , BestIPChi2 } ;
+      /// the result of the scan 
+      struct Result 
+      {
+        /// the reduced value 
+        double value ;
+        /// the index of the selected primary vertex, -1 if there is none 
+        std::ptrdiff_t index ;
+      } ;
+      // ======================================================================
+      /** constructor 
+       *  @param mass      the mass: "CORRM" or "HOPM"
+       *  @param reduction the reduction: "MIN", "MAX" or "BESTIPCHI2"
+       *  @param index     return the index of the selected primary vertex 
+       *                   instead of the value 
+       */
+      MassVertexScan 
+      ( const std::string& mass      , 
+        const std::string& reduction , 
+        const bool         index     = false ) ;
+      /// MANDATORY: clone method ("virtual constructor")
+      MassVertexScan* clone() const override;
+      /// MANDATORY: the only one essential method 
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout 
+      std::ostream& fillStream( std::ostream& s ) const override;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** scan all primary vertices 
+       *  @param p      (INPUT)  the particle 
+       *  @param result (OUTPUT) the reduced value and the index of the vertex 
+       *  @return false for invalid input 
+       */
+      bool scan ( argument p , Result& result ) const ;
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the mass 
+      std::string m_massName      ;
+      /// the reduction 
+      std::string m_reductionName ;
+      /// the mass 
+      Mass        m_mass          ;
+      /// the reduction 
+      Reduction   m_reduction     ;
+      /// return the index?
+      bool        m_index         ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class MCorrectedCutWithBestVertex
+     *  The cut on the corrected mass with respect to the best primary vertex,
+     *  identical to <code>BPVCORRM > cut</code> (or <code>BPVCORRM < cut</code>).
+     *  The bounds \f$ m \le m_{corr} \le \sqrt{ m^2 + \vec{p}^2 } + |\vec{p}| \f$
+     *  are checked first, the projection onto the flight direction is
+     *  evaluated only if they do not decide the cut
+     *  @see LoKi::Cuts::BPVCORRMCUT
+     *  @see LoKi::HOP::mCorrBounds
+     */
+    // ========================================================================
+    struct GAUDI_API MCorrectedCutWithBestVertex
+      : LoKi::BasicFunctors<const LHCb::Particle*>::Predicate
+    {
+      // ======================================================================
+      /** constructor
+       *  @param cut     the threshold
+       *  @param greater select the candidates above the threshold?
+       */
+      MCorrectedCutWithBestVertex
+      ( const double cut , const bool greater = true ) ;
+      /// MANDATORY: clone method ("virtual constructor")
+      MCorrectedCutWithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout
+      std::ostream& fillStream( std::ostream& s ) const override;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /// the number of the candidates decided by the bounds alone
+      unsigned long long early () const
+      { return m_early -> load ( std::memory_order_relaxed ) ; }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// apply the cut to the value
+      bool decide ( const double value ) const
+      { return m_greater ? m_cut < value : value < m_cut ; }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the full evaluation
+      LoKi::Particles::MCorrectedWithBestVertex m_fun ;
+      /// the threshold
+      double m_cut     ;
+      /// select the candidates above the threshold?
+      bool   m_greater ;
+      /// the candidates decided by the bounds, shared by all clones
+      std::shared_ptr<std::atomic<unsigned long long> > m_early
+        { std::make_shared<std::atomic<unsigned long long> > ( 0 ) } ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class BremMCorrectedCutWithBestVertex
+     *  The cut on the HOP mass with respect to the best primary vertex,
+     *  identical to <code>BPVHOPM > cut</code> (or <code>BPVHOPM < cut</code>).
+     *  The HOP mass is not smaller than the mass of the hadronic part,
+     *  thus the projections and the correction of the electrons are
+     *  skipped once the hadronic part alone is above the threshold.
+     *  Otherwise the HOP ratio gives the lower and the upper bounds
+     *  from the sums over the electrons, and the correction of the
+     *  electrons is skipped if the threshold is outside of them.
+     *  The only exception is the degenerate \f$ p_T^e = 0 \f$,
+     *  where the HOP mass is not a number.
+     *  The bounds need the sums of the walk: the momentum of the head
+     *  is not the sum of the momenta the walk takes, thus no bound from
+     *  the head alone gives the same decision as the mass
+     *  @see LoKi::Cuts::BPVHOPMCUT
+     *  @see LoKi::HOP::hopMassSide
+     */
+    // ========================================================================
+    struct GAUDI_API BremMCorrectedCutWithBestVertex
+      : LoKi::BasicFunctors<const LHCb::Particle*>::Predicate
+    {
+      // ======================================================================
+      /** constructor
+       *  @param cut     the threshold
+       *  @param greater select the candidates above the threshold?
+       */
+      BremMCorrectedCutWithBestVertex
+      ( const double cut , const bool greater = true ) ;
+      /// MANDATORY: clone method ("virtual constructor")
+      BremMCorrectedCutWithBestVertex* clone() const override;
+      /// MANDATORY: the only one essential method
+      result_type operator() ( argument p ) const override;
+      /// OPTIONAL: the specific printout
+      std::ostream& fillStream( std::ostream& s ) const override;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /// the number of the candidates decided by the bounds alone
+      unsigned long long early () const
+      { return m_early -> load ( std::memory_order_relaxed ) ; }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// apply the cut to the value
+      bool decide ( const double value ) const
+      { return m_greater ? m_cut < value : value < m_cut ; }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the full evaluation
+      LoKi::Particles::BremMCorrectedWithBestVertex m_fun ;
+      /// the threshold
+      double m_cut     ;
+      /// select the candidates above the threshold?
+      bool   m_greater ;
+      /// the candidates decided by the bounds, shared by all clones
+      std::shared_ptr<std::atomic<unsigned long long> > m_early
+        { std::make_shared<std::atomic<unsigned long long> > ( 0 ) } ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+    /** @class BestVertexColumns
+     *  Fill the columns of several BPV* variables from this file for the 
+     *  whole container in one pass, e.g. for the ntuple production.
+     *  The best vertices and the flight directions are gathered once, 
+     *  the decay trees are walked once, and the results are written 
+     *  directly into the column buffers, without the per-candidate and 
+     *  per-variable virtual calls. 
+     *  The values are the same as from the individual functors.
+     *
+     *  @code 
+     *
+     *   const BestVertexColumns filler ( { "BPVCORRM" , "BPVHOPM" , "BPVHOPALPHA" } ) ;
+     *
+     *   const LHCb::Particle::Range particles = ... ;
+     *   std::vector<std::vector<double> > columns ;
+     *   filler.fill ( particles , columns ) ;
+     *
+     *  @endcode 
+     *
+     *  @see LoKi::Particles::PtFlightWithBestVertex
+     *  @see LoKi::Particles::MCorrectedWithBestVertex
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     */
+    // ========================================================================
+    class GAUDI_API BestVertexColumns 
+    {
+    public:
+      // ======================================================================
+      /// the variables 
+      enum Variable 
+        { 
+          PtFlight        = 0 , // BPVPTFLIGHT
+          MCorrected          , // BPVCORRM
+          HOPMass             , // BPVHOPM
+          HOPAlpha            , // BPVHOPALPHA
+          HOPPtE              , // BPVHOPPTE
+          HOPPtH              , // BPVHOPPTH
+          HOPElectronMass     , // BPVHOPEM
+          HOPQ2               , // BPVHOPQ2
+          NVariables 
+        } ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** constructor 
+       *  @param variables the names of the variables, as in LoKi::Cuts 
+       */
+      explicit BestVertexColumns ( const std::vector<std::string>& variables ) ;
+      // ======================================================================
+    public:
+      // ======================================================================
+      /** evaluate all variables for all particles 
+       *  @param particles (INPUT)  the particles 
+       *  @param columns   (OUTPUT) one buffer per variable, in the order of 
+       *                            the variables, <code>particles.size()</code> 
+       *                            entries each 
+       */
+      void fill 
+      ( const LHCb::Particle::Range& particles , 
+        double* const*               columns   ) const ;
+      /** evaluate all variables for all particles 
+       *  @param particles (INPUT)  the particles 
+       *  @param columns   (OUTPUT) the columns, resized 
+       */
+      void fill 
+      ( const LHCb::Particle::Range&      particles , 
+        std::vector<std::vector<double> >& columns   ) const ;
+      // ======================================================================
+      /// the variables 
+      const std::vector<Variable>& variables () const { return m_variables ; }
+      /// the diagnostics 
+      const Diagnostics& diagnostics () const { return m_fun.diagnostics () ; }
+      // ======================================================================
+    private:
+      // ======================================================================
+      /// the best vertex, the HOP evaluation and the diagnostics 
+      LoKi::Particles::BremMCorrectedWithBestVertex m_fun       ;
+      /// the variables 
+      std::vector<Variable>                         m_variables ;
+      // ======================================================================
+    } ;
+    // ========================================================================
+  }  //                                        end of namespace LoKi::Particles
   // ==========================================================================
   namespace Cuts 
   {
@@ -386,6 +1185,11 @@ namespace LoKi
      *  @see LoKi::Cuts::PTFLIGHT
      *  @see LoKi::Cuts::BPVPTFLIGHT
      *  @see LoKi::Cuts::PTDIR
+     *
+     *  The single precision variant for coarse cuts: <code>BPVCORRM ( true )</code>,
+     *  <code>BPVCORRMF</code> in Python
+     *  @see LoKi::HOP::mCorrFast
+     *
      *  @author Vanya Belyaev Ivan.Belyaev@nikhef.nl
      *  @date   2010-10-23
      *  @thanks Mike Williams
@@ -412,26 +1216,165 @@ namespace LoKi
      */
     typedef LoKi::Particles::BremMCorrected                              HOPM ;
     // ========================================================================
-    /** @typedef BPVCORRM 
-     *  Simple functor to evaluate the corrected mass with respect to 
-     *  particle flight direction
+    /** @typedef BPVHOPM
+     *  Simple functor to evaluate the HOP mass with respect to the 
+     *  flight direction of the particle from the best primary vertex:
+     *  the momenta of the electrons are scaled by the ratio of the 
+     *  transverse momenta of the hadronic and electronic parts,
+     *  \f$ \alpha_{HOP} = p_T^{h} / p_T^{e} \f$, to recover the 
+     *  bremsstrahlung losses 
      *
      *  For more information see 
      *  <a href="https://cds.cern.ch/record/2102345/files/LHCb-INT-2015-037.pdf">
      *
-     *  @see LoKi::Particles::MCorrectedWithBestVertex
-     *  @see LoKi::Particles::MCorrected
-     *  @see LoKi::Particles::PtFlightWithBestVertex 
-     *  @see LoKi::Particles::PtFlight 
-     *  @see LoKi::Cuts::CORRM
-     *  @see LoKi::Cuts::PTFLIGHT
-     *  @see LoKi::Cuts::BPVPTFLIGHT
+     *  @see LoKi::Particles::BremMCorrectedWithBestVertex
+     *  @see LoKi::Particles::BremMCorrected
+     *  @see LoKi::Cuts::HOPM
+     *  @see LoKi::Cuts::BPVHOPALPHA
+     *  @see LoKi::Cuts::BPVCORRM
      *  @authors Pavol Stefko pavol.stefko@epfl.ch, Guido Andreassi guido.andreassi@epfl.ch, Violaine Bellee violaine.bellee@epfl.ch
      *  @date   2017-01-17
      *  @thanks Albert Puig Navarro
+     *
+     *  The single precision variant for coarse cuts: <code>BPVHOPM ( true )</code>,
+     *  <code>BPVHOPMF</code> in Python
+     *  @see LoKi::HOP::hopMassFast
      */
     typedef LoKi::Particles::BremMCorrectedWithBestVertex             BPVHOPM ;
     // ========================================================================
+    /** @typedef BPVHOPALPHA
+     *  Simple functor to evaluate the HOP ratio 
+     *  \f$ \alpha_{HOP} = p_T^{h} / p_T^{e} \f$ 
+     *  with respect to the particle flight direction
+     *
+     *  @code 
+     * 
+     *   const BPVHOPALPHA alpha = BPVHOPALPHA () ;
+     *   const BPVHOPM     hopm  = BPVHOPM     () ;
+     * 
+     *   const LHCb::Particle* B = ... ;
+     *
+     *   // the second call reuses the HOP evaluation of the first one 
+     *   const double a = alpha ( B ) ;
+     *   const double m = hopm  ( B ) ;
+     *
+     *  @endcode 
+     *
+     *  @see LoKi::Particles::HOPAlphaWithBestVertex
+     *  @see LoKi::Cuts::BPVHOPM
+     */
+    typedef LoKi::Particles::HOPAlphaWithBestVertex               BPVHOPALPHA ;
+    // ========================================================================
+    /** @typedef BPVHOPPTE
+     *  Simple functor to evaluate the transverse momentum of the electronic 
+     *  part of the candidate with respect to the particle flight direction
+     *  @see LoKi::Particles::HOPPtEWithBestVertex
+     *  @see LoKi::Cuts::BPVHOPM
+     */
+    typedef LoKi::Particles::HOPPtEWithBestVertex                   BPVHOPPTE ;
+    // ========================================================================
+    /** @typedef BPVHOPPTH
+     *  Simple functor to evaluate the transverse momentum of the hadronic 
+     *  part of the candidate with respect to the particle flight direction
+     *  @see LoKi::Particles::HOPPtHWithBestVertex
+     *  @see LoKi::Cuts::BPVHOPM
+     */
+    typedef LoKi::Particles::HOPPtHWithBestVertex                   BPVHOPPTH ;
+    // ========================================================================
+    /** @typedef BPVHOPEM
+     *  Simple functor to evaluate the mass of the HOP-corrected 
+     *  electronic system 
+     *  @see LoKi::Particles::HOPElectronMassWithBestVertex
+     *  @see LoKi::Cuts::BPVHOPM
+     */
+    typedef LoKi::Particles::HOPElectronMassWithBestVertex           BPVHOPEM ;
+    // ========================================================================
+    /** @typedef BPVHOPQ2
+     *  Simple functor to evaluate \f$ q^2 \f$ of the HOP-corrected 
+     *  electronic system 
+     *  @see LoKi::Particles::HOPQ2WithBestVertex
+     *  @see LoKi::Cuts::BPVHOPM
+     */
+    typedef LoKi::Particles::HOPQ2WithBestVertex                     BPVHOPQ2 ;
+    // ========================================================================
+    /** @typedef BPVCORRMERR
+     *  Simple functor to evaluate the uncertainty of the corrected mass 
+     *  with respect to the best primary vertex 
+     *
+     *  @code 
+     *
+     *   const LHCb::Particle* B = ... ;
+     *
+     *   const double sigma = BPVCORRMERR ( B ) ;
+     *
+     *  @endcode 
+     *
+     *  @see LoKi::Particles::MCorrectedErrorWithBestVertex
+     *  @see LoKi::Cuts::BPVCORRM
+     */
+    typedef LoKi::Particles::MCorrectedErrorWithBestVertex           BPVCORRMERR ;
+    // ========================================================================
+    /** @typedef BPVHOPMERR
+     *  Simple functor to evaluate the uncertainty of the HOP mass 
+     *  with respect to the best primary vertex 
+     *  @see LoKi::Particles::HOPMassErrorWithBestVertex
+     *  @see LoKi::Cuts::BPVHOPM
+     */
+    typedef LoKi::Particles::HOPMassErrorWithBestVertex              BPVHOPMERR ;
+    // ========================================================================
+    /** @typedef PVSCANM
+     *  The corrected mass or the HOP mass reduced over all primary vertices 
+     *
+     *  @code 
+     *
+     *   const LHCb::Particle* B = ... ;
+     *
+     *   const PVSCANM fun = PVSCANM ( "CORRM" , "BESTIPCHI2" ) ;
+     *   const double  m   = fun ( B ) ;
+     *
+     *  @endcode 
+     *
+     *  @see LoKi::Particles::MassVertexScan
+     *  @see LoKi::Cuts::BPVCORRM
+     *  @see LoKi::Cuts::BPVHOPM
+     */
+    typedef LoKi::Particles::MassVertexScan                          PVSCANM ;
+    // ========================================================================
+    /** @typedef BPVCORRMCUT
+     *  The cut on the corrected mass with respect to the best primary vertex,
+     *  decided by the cheap bounds whenever possible
+     *
+     *  @code
+     *
+     *   // the same as BPVCORRM > 4000
+     *   const BPVCORRMCUT above = BPVCORRMCUT ( 4000 ) ;
+     *   // the same as BPVCORRM < 7000
+     *   const BPVCORRMCUT below = BPVCORRMCUT ( 7000 , false ) ;
+     *
+     *  @endcode
+     *
+     *  @see LoKi::Particles::MCorrectedCutWithBestVertex
+     *  @see LoKi::Cuts::BPVCORRM
+     */
+    typedef LoKi::Particles::MCorrectedCutWithBestVertex             BPVCORRMCUT ;
+    // ========================================================================
+    /** @typedef BPVHOPMCUT
+     *  The cut on the HOP mass with respect to the best primary vertex,
+     *  decided by the mass of the hadronic part and by the bounds from
+     *  the HOP ratio whenever possible
+     *
+     *  @code
+     *
+     *   // the same as BPVHOPM > 4500
+     *   const BPVHOPMCUT above = BPVHOPMCUT ( 4500 ) ;
+     *
+     *  @endcode
+     *
+     *  @see LoKi::Particles::BremMCorrectedCutWithBestVertex
+     *  @see LoKi::Cuts::BPVHOPM
+     */
+    typedef LoKi::Particles::BremMCorrectedCutWithBestVertex         BPVHOPMCUT ;
+    // ========================================================================
     // ========================================================================
   } //                                              end of namespace LoKi::Cuts 
   // ==========================================================================
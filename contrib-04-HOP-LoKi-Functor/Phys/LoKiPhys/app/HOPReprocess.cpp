@@ -0,0 +1,208 @@
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/HOPColumns.h"
+#include "LoKi/HOPFile.h"
+#include "LoKi/HOPThreadPool.h"
+// ============================================================================
+/** @file HOPReprocess.cpp
+ *
+ *  Standalone multi-threaded reprocessing of PTFLIGHT, CORRM, the HOP mass
+ *  and the HOP ratio from flattened decay trees, without Gaudi and the
+ *  LHCb event model.
+ *
+ *  The candidates are split into batches, run on the work-stealing pool
+ *  (LoKi/HOPThreadPool.h); the inputs of the next batch of each worker
+ *  are prefetched while the current one is computed. Each batch writes
+ *  to its own slice of the output columns, thus the output is identical
+ *  for any number of threads (checked with <code>--verify</code>).
+ *
+ *  @code
+ *
+ *   HOPReprocess [-j threads] [-b batch] [--verify] input output
+ *
+ *  @endcode
+ *
+ *  The input is the memory-mapped file of LoKi/HOPFile.h, e.g. written
+ *  inside DaVinci by LoKi::Particles::HOPFileWriter; the columns are used
+ *  in place and the pages of the next batch are read ahead.
+ *
+ *  The output is <code>"HOPRES01"</code>, <code>uint64</code> N and
+ *  the <code>float64</code> columns PTFLIGHT, CORRM, HOPM and HOPALPHA,
+ *  N entries each, NaN for candidates without nodes.
+ *
+ *  @see LoKi::HOP::evaluateArrays
+ *  @see LoKi::HOP::MappedFile
+ *  @see LoKi::HOP::WorkStealingPool
+ */
+// ============================================================================
+namespace
+{
+  // ==========================================================================
+  /// the output columns
+  struct Output
+  {
+    std::vector<double> ptFlight , mCorr , hopMass , alpha ;
+    void resize ( const std::size_t n )
+    {
+      for ( std::vector<double>* c : { &ptFlight , &mCorr , &hopMass , &alpha } )
+      { c->assign ( n , 0.0 ) ; }
+    }
+  } ;
+  // ==========================================================================
+  /// write the output columns
+  void write ( const std::string& name , const Output& o )
+  {
+    std::ofstream out ( name , std::ios::binary ) ;
+    if ( !out ) { throw std::runtime_error ( "Cannot open '" + name + "'" ) ; }
+    const std::uint64_t n = o.hopMass.size () ;
+    out.write ( "HOPRES01" , 8 ) ;
+    out.write ( reinterpret_cast<const char*> ( &n ) , sizeof ( n ) ) ;
+    for ( const std::vector<double>* c : { &o.ptFlight , &o.mCorr , &o.hopMass , &o.alpha } )
+    { out.write ( reinterpret_cast<const char*> ( c->data () ) , n * sizeof ( double ) ) ; }
+    if ( !out ) { throw std::runtime_error ( "Cannot write '" + name + "'" ) ; }
+  }
+  // ==========================================================================
+  /// evaluate the candidates <code>[first,last)</code>
+  void evaluate ( const LoKi::HOP::Columns& i , Output& o ,
+                  const std::size_t first , const std::size_t last )
+  {
+    LoKi::HOP::evaluateArrays
+      ( last - first , i.offsets + first ,
+        i.parent , i.pid , i.px , i.py , i.pz , i.e ,
+        i.endx + first , i.endy + first , i.endz + first ,
+        i.pvx  + first , i.pvy  + first , i.pvz  + first ,
+        o.ptFlight.data () + first , o.mCorr.data () + first ,
+        o.hopMass .data () + first , o.alpha.data () + first ) ;
+  }
+  // ==========================================================================
+  /** read ahead the pages of the node arrays of the candidates
+   *  <code>[first,last)</code> and start the streams of the first lines
+   */
+  void prefetch ( const LoKi::HOP::MappedFile& file ,
+                  const std::size_t first , const std::size_t last )
+  {
+    file.prefetch ( first , last ) ;
+#if defined ( __GNUC__ )
+    const LoKi::HOP::Columns i = file.columns () ;
+    const std::size_t begin = i.offsets [ first ] , end = i.offsets [ last ] ;
+    const std::size_t lines = std::min<std::size_t> ( end - begin , 64 ) ;
+    for ( std::size_t k = 0 ; k < lines ; k += 8 )
+    {
+      for ( const double* a : { i.px , i.py , i.pz , i.e } )
+      { __builtin_prefetch ( a + begin + k ) ; }
+      __builtin_prefetch ( i.parent + begin + k ) ;
+      __builtin_prefetch ( i.pid    + begin + k ) ;
+    }
+#endif
+  }
+  // ==========================================================================
+  /// evaluate all candidates on the pool
+  void process ( const LoKi::HOP::MappedFile& file , Output& o ,
+                 const std::size_t threads , const std::size_t batch )
+  {
+    const LoKi::HOP::Columns i = file.columns () ;
+    const std::size_t n        = i.size ;
+    const std::size_t nBatches = ( n + batch - 1 ) / batch ;
+    o.resize ( n ) ;
+    //
+    LoKi::HOP::WorkStealingPool pool ( threads ) ;
+    pool.run ( nBatches ,
+               [&] ( const std::size_t k , const std::size_t /* worker */ )
+               { evaluate ( i , o , k * batch , std::min ( n , ( k + 1 ) * batch ) ) ; } ,
+               [&] ( const std::size_t k )
+               { prefetch ( file , k * batch , std::min ( n , ( k + 1 ) * batch ) ) ; } ) ;
+  }
+  // ==========================================================================
+  /// the same bits, NaN included
+  bool identical ( const Output& a , const Output& b )
+  {
+    const std::size_t bytes = a.hopMass.size () * sizeof ( double ) ;
+    return 0 == std::memcmp ( a.ptFlight.data () , b.ptFlight.data () , bytes )
+      &&   0 == std::memcmp ( a.mCorr   .data () , b.mCorr   .data () , bytes )
+      &&   0 == std::memcmp ( a.hopMass .data () , b.hopMass .data () , bytes )
+      &&   0 == std::memcmp ( a.alpha   .data () , b.alpha   .data () , bytes ) ;
+  }
+  // ==========================================================================
+  int usage ()
+  {
+    std::cerr << "Usage: HOPReprocess [-j threads] [-b batch] [--verify] input output"
+              << std::endl ;
+    return 2 ;
+  }
+  // ==========================================================================
+}
+// ============================================================================
+int main ( int argc , char** argv )
+{
+  std::size_t threads = std::max<unsigned> ( 1 , std::thread::hardware_concurrency () ) ;
+  std::size_t batch   = 4096  ;
+  bool        verify  = false ;
+  std::vector<std::string> files ;
+  for ( int a = 1 ; a < argc ; ++a )
+  {
+    const std::string arg = argv [ a ] ;
+    if      ( "-j" == arg && a + 1 < argc ) { threads = std::strtoul ( argv [ ++a ] , nullptr , 10 ) ; }
+    else if ( "-b" == arg && a + 1 < argc ) { batch   = std::strtoul ( argv [ ++a ] , nullptr , 10 ) ; }
+    else if ( "--verify" == arg           ) { verify  = true ; }
+    else if ( !arg.empty () && '-' == arg [ 0 ] ) { return usage () ; }
+    else                                    { files.push_back ( arg ) ; }
+  }
+  if ( 2 != files.size () || 0 == threads || 0 == batch ) { return usage () ; }
+  //
+  try
+  {
+    const LoKi::HOP::MappedFile input ( files [ 0 ] ) ;
+    Output output ;
+    //
+    const auto start = std::chrono::steady_clock::now () ;
+    process ( input , output , threads , batch ) ;
+    const auto stop  = std::chrono::steady_clock::now () ;
+    const double ns  = std::chrono::duration<double,std::nano> ( stop - start ).count () ;
+    std::cout << "HOPReprocess: " << input.size () << " candidates, "
+              << threads << " threads, "
+              << ( input.size () ? ns / input.size () : 0.0 ) << " ns/candidate"
+              << std::endl ;
+    //
+    if ( verify )
+    {
+      Output reference ;
+      process ( input , reference , 1 , batch ) ;
+      if ( !identical ( output , reference ) )
+      {
+        std::cerr << "HOPReprocess: the output differs from the single-threaded run"
+                  << std::endl ;
+        return 1 ;
+      }
+      std::cout << "HOPReprocess: identical to the single-threaded run" << std::endl ;
+    }
+    //
+    write ( files [ 1 ] , output ) ;
+  }
+  catch ( const std::exception& e )
+  {
+    std::cerr << "HOPReprocess: " << e.what () << std::endl ;
+    return 1 ;
+  }
+  return 0 ;
+}
+// ============================================================================
+// The END
+// ============================================================================
@@ -0,0 +1,186 @@
+#!/usr/bin/env python
+# =============================================================================
+## @file columns.py LoKiPhys/columns.py
+#  Columnar evaluation of PTFLIGHT, CORRM and the HOP mass for NumPy arrays
+#
+#  The decay trees are given in compressed-sparse-row layout, see
+#  LoKi/HOPColumns.h: the nodes of candidate <code>i</code> occupy
+#  <code>[ offsets[i] , offsets[i+1] )</code> in pre-order, with the
+#  index of the mother relative to the head, -1 for the head.
+#
+#  @code
+#
+#  >>> from LoKiPhys.columns import evaluate
+#  >>> r = evaluate ( offsets , parent , pid , px , py , pz , e ,
+#  ...                endx , endy , endz , pvx , pvy , pvz )
+#  >>> r['HOPM'] , r['HOPALPHA'] , r['CORRM'] , r['PTFLIGHT']
+#
+#  @endcode
+#
+#  The arrays are passed to C++ through the buffer protocol: arrays of
+#  the expected type and C-contiguous layout are not copied
+#  (size_t-like uintp offsets, int32 parent and pid, float64 otherwise).
+#  Any other array is converted, i.e. silently copied, on each call.
+#  The structure of the decay trees is checked before the evaluation.
+#  The evaluation runs with the interpreter lock released.
+#
+#  The BPV* variables of the candidates in the event, for the ntuples,
+#  are evaluated for the whole container in one batched pass by the Filler,
+#  instead of one LoKi::Hybrid::TupleTool call per candidate and variable:
+#
+#  @code
+#
+#  >>> from LoKiPhys.columns import Filler
+#  >>> filler = Filler ( ( 'BPVCORRM' , 'BPVHOPM' , 'BPVHOPALPHA' ) )
+#  >>> ## in the algorithm, for each event
+#  >>> r = filler ( particles )
+#  >>> r['BPVHOPM']
+#
+#  @endcode
+#
+#  @see LoKi::HOP::evaluateArrays
+#  @see LoKi::Particles::BestVertexColumns
+# =============================================================================
+"""
+Columnar evaluation of PTFLIGHT, CORRM and the HOP mass for NumPy arrays
+
+>>> from LoKiPhys.columns import evaluate
+>>> r = evaluate ( offsets , parent , pid , px , py , pz , e ,
+...                endx , endy , endz , pvx , pvy , pvz )
+>>> r['HOPM'] , r['HOPALPHA'] , r['CORRM'] , r['PTFLIGHT']
+
+and of the BPV* variables of the candidates, for the ntuples
+
+>>> from LoKiPhys.columns import Filler
+>>> filler = Filler ( ( 'BPVCORRM' , 'BPVHOPM' , 'BPVHOPALPHA' ) )
+>>> r = filler ( particles )
+>>> r['BPVHOPM']
+"""
+# =============================================================================
+__all__ = ( 'evaluate' , 'Filler' )
+# =============================================================================
+
+import numpy as _np
+
+from LoKiCore.basic import cpp
+try :
+    from cppyy import nullptr as _nullptr
+except ImportError :
+    from ROOT  import nullptr as _nullptr
+
+cpp.gInterpreter.Declare ( '#include "LoKi/HOPColumns.h"' )
+
+## the C++ entry point, run without the interpreter lock
+_evaluate = cpp.LoKi.HOP.evaluateArrays
+_evaluate.__release_gil__ = True
+
+## the quantities, in the order of the output arguments of the C++ entry
+_OUTPUTS = ( 'PTFLIGHT' , 'CORRM' , 'HOPM' , 'HOPALPHA' )
+
+# =============================================================================
+## get the C-contiguous array of the given type:
+#  the array itself if it has the type and the layout, otherwise the copy
+def _column ( array , dtype , name , size = None ) :
+    a = _np.require ( array , dtype = dtype , requirements = 'C' )
+    if 1 != a.ndim :
+        raise TypeError  ( "Column '%s' must be one-dimensional" % name )
+    if size is not None and size != len ( a ) :
+        raise ValueError ( "Column '%s' has %d entries, %d expected" % ( name , len ( a ) , size ) )
+    return a
+
+# =============================================================================
+## evaluate PTFLIGHT, CORRM, the HOP mass and the HOP ratio for all candidates
+#  @param offsets  CSR offsets of the decay trees, N+1 entries
+#  @param parent   the mother of each node relative to the head, -1 for the head
+#  @param pid      the particle identifier of each node
+#  @param px,py,pz,e  the 4-momenta of the nodes
+#  @param endx,endy,endz the decay vertices of the candidates
+#  @param pvx,pvy,pvz    the (best) primary vertices of the candidates
+#  @param quantities     the quantities to evaluate
+#  @return dictionary of NumPy arrays, N entries each,
+#          NaN for candidates without nodes
+#  @exception ValueError for inconsistent lengths or decay trees
+#  @see LoKi::HOP::check
+def evaluate ( offsets , parent , pid , px , py , pz , e ,
+               endx , endy , endz , pvx , pvy , pvz ,
+               quantities = _OUTPUTS ) :
+    """Evaluate PTFLIGHT, CORRM, the HOP mass and the HOP ratio for all candidates
+    >>> r = evaluate ( offsets , parent , pid , px , py , pz , e ,
+    ...                endx , endy , endz , pvx , pvy , pvz )
+    >>> hopm = r['HOPM']
+
+    Arrays of other types than uintp (offsets), int32 (parent, pid) and
+    float64, or not C-contiguous, are copied on each call: convert them
+    once beforehand for repeated evaluations.
+    ValueError is raised for inconsistent lengths, decreasing offsets, or
+    mothers that are not preceding nodes of the same tree.
+    """
+    for q in quantities :
+        if not q in _OUTPUTS : raise KeyError ( "Unknown quantity '%s'" % q )
+    #
+    offsets = _column ( offsets , _np.uintp , 'offsets' )
+    if len ( offsets ) < 1 : raise ValueError ( "Column 'offsets' is empty" )
+    size  = len ( offsets ) - 1
+    nodes = int ( offsets [ -1 ] )
+    #
+    parent = _column ( parent , _np.int32 , 'parent' , nodes )
+    pid    = _column ( pid    , _np.int32 , 'pid'    , nodes )
+    mom    = [ _column ( a , _np.float64 , n , nodes ) for a , n in
+               ( ( px , 'px' ) , ( py , 'py' ) , ( pz , 'pz' ) , ( e , 'e' ) ) ]
+    vxs    = [ _column ( a , _np.float64 , n , size  ) for a , n in
+               ( ( endx , 'endx' ) , ( endy , 'endy' ) , ( endz , 'endz' ) ,
+                 ( pvx  , 'pvx'  ) , ( pvy  , 'pvy'  ) , ( pvz  , 'pvz'  ) ) ]
+    #
+    results = dict ( ( q , _np.empty ( size , dtype = _np.float64 ) ) for q in quantities )
+    outputs = [ results.get ( q , _nullptr ) for q in _OUTPUTS ]
+    #
+    problem = _evaluate ( size , offsets , parent , pid , *( mom + vxs + outputs ) )
+    if problem : raise ValueError ( "Invalid decay trees: %s" % problem )
+    return results
+
+# =============================================================================
+## @class Filler
+#  The BPV* variables of all candidates of the container in one batched
+#  pass, written directly into NumPy arrays: the values are the same as
+#  from the functors BPVPTFLIGHT, BPVCORRM, BPVHOPM, BPVHOPALPHA,
+#  BPVHOPPTE, BPVHOPPTH, BPVHOPEM and BPVHOPQ2.
+#  Create it once, e.g. at the initialization of the algorithm,
+#  and call it in the event loop, where the desktop is available
+#  @see LoKi::Particles::BestVertexColumns
+class Filler ( object ) :
+    """The BPV* variables of all candidates of the container in one batched pass
+    >>> filler = Filler ( ( 'BPVCORRM' , 'BPVHOPM' ) )
+    >>> r = filler ( particles )
+    >>> r['BPVHOPM']
+    """
+    def __init__ ( self , variables = ( 'BPVCORRM' , 'BPVHOPM' , 'BPVHOPALPHA' ) ) :
+        self.variables = tuple ( variables )
+        names = cpp.std.vector ( 'std::string' ) ()
+        for v in self.variables : names.push_back ( v )
+        self._filler   = cpp.LoKi.Particles.BestVertexColumns ( names )
+        self._buffers  = cpp.std.vector ( 'double*' ) ()
+
+    ## evaluate the variables for all particles
+    #  @param particles the particles, LHCb::Particle::Range
+    #  @return dictionary of NumPy arrays, one entry per particle each
+    def __call__ ( self , particles ) :
+        """Evaluate the variables for all particles
+        >>> r = filler ( particles )
+        """
+        results = dict ( ( v , _np.empty ( particles.size () , dtype = _np.float64 ) )
+                         for v in self.variables )
+        self._buffers.clear ()
+        for v in self.variables : self._buffers.push_back ( results [ v ] )
+        self._filler.fill ( particles , self._buffers.data () )
+        return results
+
+# =============================================================================
+if '__main__' == __name__ :
+
+    print 80*'*'
+    print __doc__
+    print 80*'*'
+
+# =============================================================================
+# The END
+# =============================================================================
@@ -1027,6 +1027,8 @@ BPVPTFLIGHT = LoKi.Particles.PtFlightWithBestVertex ()
 CORRM       = LoKi.Particles.MCorrected 
 ## @see LoKi::Cuts::BPVCORRM
 BPVCORRM    = LoKi.Particles.MCorrectedWithBestVertex ()  
+## @see LoKi::Cuts::BPVCORRM, single precision for coarse cuts 
+BPVCORRMF   = LoKi.Particles.MCorrectedWithBestVertex ( True )  
 
 
 # =============================================================================
@@ -1040,6 +1042,36 @@ BPVCORRM    = LoKi.Particles.MCorrectedWithBestVertex ()
 HOPM    = LoKi.Particles.BremMCorrected
 ## @see LoKi::Cuts::BPVHOPM
 BPVHOPM = LoKi.Particles.BremMCorrectedWithBestVertex ()  
+## @see LoKi::Cuts::BPVHOPM, single precision for coarse cuts 
+BPVHOPMF = LoKi.Particles.BremMCorrectedWithBestVertex ( True )  
+## @see LoKi::Cuts::BPVHOPALPHA
+BPVHOPALPHA = LoKi.Particles.HOPAlphaWithBestVertex        ()
+## @see LoKi::Cuts::BPVHOPPTE
+BPVHOPPTE   = LoKi.Particles.HOPPtEWithBestVertex          ()
+## @see LoKi::Cuts::BPVHOPPTH
+BPVHOPPTH   = LoKi.Particles.HOPPtHWithBestVertex          ()
+## @see LoKi::Cuts::BPVHOPEM
+BPVHOPEM    = LoKi.Particles.HOPElectronMassWithBestVertex ()
+## @see LoKi::Cuts::BPVHOPQ2
+BPVHOPQ2    = LoKi.Particles.HOPQ2WithBestVertex           ()
+## @see LoKi::Cuts::BPVCORRMERR
+BPVCORRMERR = LoKi.Particles.MCorrectedErrorWithBestVertex ()
+## @see LoKi::Cuts::BPVHOPMERR
+BPVHOPMERR  = LoKi.Particles.HOPMassErrorWithBestVertex    ()
+## @see LoKi::Cuts::PVSCANM
+PVSCANM     = LoKi.Particles.MassVertexScan
+## @see LoKi::Cuts::BPVCORRMCUT
+BPVCORRMCUT = LoKi.Particles.MCorrectedCutWithBestVertex
+## @see LoKi::Cuts::BPVHOPMCUT
+BPVHOPMCUT  = LoKi.Particles.BremMCorrectedCutWithBestVertex
+## report the summaries of the invalid inputs of the functors above, 
+#  to be called from finalize() of the algorithm, while MessageSvc is there 
+#  @see LoKi::Particles::Diagnostics::reportAll
+reportDiagnostics = LoKi.Particles.Diagnostics.reportAll
+## the best vertex from the z-sorted index of the primary vertices, for the
+#  jobs without the stored relations and without the refit of the vertices
+#  @see LoKi::Particles::BestVertexIndex
+bestVertexIndex   = LoKi.Particles.BestVertexIndex
 
 
 # =============================================================================
@@ -0,0 +1,280 @@
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <algorithm>
+#include <limits>
+#include <vector>
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/Report.h"
+#include "LoKi/HOPFile.h"
+#include "LoKi/HOPFileWriter.h"
+// ============================================================================
+/** @file
+ *
+ *  Implementation file for class LoKi::Particles::HOPFileWriter
+ *
+ *  @see LoKi/HOPFile.h
+ */
+// ============================================================================
+namespace
+{
+  // ==========================================================================
+  /// the position of missing vertices
+  const double s_NaN = std::numeric_limits<double>::quiet_NaN() ;
+  // ==========================================================================
+  /// append the lower triangle of the symmetric matrix, row by row
+  template <class MATRIX>
+  void pack ( const MATRIX& m , const unsigned n , std::vector<double>& out )
+  {
+    for ( unsigned i = 0 ; i < n ; ++i )
+    { for ( unsigned j = 0 ; j <= i ; ++j ) { out.push_back ( m ( i , j ) ) ; } }
+  }
+  // ==========================================================================
+  static_assert ( sizeof ( int ) == sizeof ( std::int32_t ) ,
+                  "the particle identifiers are stored as 32-bit integers" ) ;
+  static_assert ( sizeof ( std::size_t ) == sizeof ( std::uint64_t ) ,
+                  "the offsets are stored as 64-bit integers" ) ;
+  // ==========================================================================
+}
+// ============================================================================
+// constructor
+// ============================================================================
+LoKi::Particles::HOPFileWriter::HOPFileWriter
+( const bool        covariances ,
+  const std::size_t chunk       )
+  : m_covariances       ( covariances )
+  , m_chunk             ( 0 < chunk ? chunk : 1 )
+  , m_spooledCandidates ( 0 )
+  , m_spooledNodes      ( 0 )
+  , m_failed            ( false )
+  , m_offsets           ( 1 , 0 )
+{
+  m_spool  .fill ( nullptr ) ;
+  m_spooled.fill ( 0 ) ;
+}
+// ============================================================================
+// destructor
+// ============================================================================
+LoKi::Particles::HOPFileWriter::~HOPFileWriter () { close () ; }
+// ============================================================================
+// add the candidate
+// ============================================================================
+bool LoKi::Particles::HOPFileWriter::add
+( const LHCb::Particle*   p  ,
+  const LHCb::VertexBase* pv )
+{
+  if ( 0 == p ) { return false ; }
+  //
+  std::lock_guard<std::mutex> guard ( m_mutex ) ;
+  addNode ( p , -1 , m_pid.size() ) ;
+  m_offsets.push_back ( m_pid.size() ) ;
+  //
+  addVertex ( p->endVertex() , m_endx , m_endy , m_endz , m_endCov ) ;
+  addVertex ( pv             , m_pvx  , m_pvy  , m_pvz  , m_pvCov  ) ;
+  //
+  if ( m_chunk < m_offsets.size() ) { flush () ; }
+  return true ;
+}
+// ============================================================================
+// the number of candidates
+// ============================================================================
+std::size_t LoKi::Particles::HOPFileWriter::size () const
+{
+  std::lock_guard<std::mutex> guard ( m_mutex ) ;
+  return m_spooledCandidates + ( m_offsets.size() - 1 ) ;
+}
+// ============================================================================
+// add the node and its descendants in pre-order
+// ============================================================================
+void LoKi::Particles::HOPFileWriter::addNode
+( const LHCb::Particle* p      ,
+  const int             parent ,
+  const std::size_t     head   )
+{
+  const int self = m_pid.size() - head ;
+  //
+  const Gaudi::LorentzVector& v = p->momentum() ;
+  m_parent .push_back ( parent ) ;
+  m_pid    .push_back ( p->particleID().pid() ) ;
+  m_px     .push_back ( v.Px () ) ;
+  m_py     .push_back ( v.Py () ) ;
+  m_pz     .push_back ( v.Pz () ) ;
+  m_e      .push_back ( v.E  () ) ;
+  if ( m_covariances ) { pack ( p->momCovMatrix() , 4 , m_momCov ) ; }
+  //
+  for ( const LHCb::Particle* d : p->daughtersVector() )
+  { if ( 0 != d ) { addNode ( d , self , head ) ; } }
+}
+// ============================================================================
+// add the position and the covariance of the vertex
+// ============================================================================
+void LoKi::Particles::HOPFileWriter::addVertex
+( const LHCb::VertexBase* vx  ,
+  std::vector<double>&    x   ,
+  std::vector<double>&    y   ,
+  std::vector<double>&    z   ,
+  std::vector<double>&    cov )
+{
+  if ( 0 == vx )
+  {
+    x.push_back ( s_NaN ) ;
+    y.push_back ( s_NaN ) ;
+    z.push_back ( s_NaN ) ;
+    if ( m_covariances ) { cov.insert ( cov.end() , 6 , s_NaN ) ; }
+    return ;
+  }
+  const Gaudi::XYZPoint& position = vx->position() ;
+  x.push_back ( position.X () ) ;
+  y.push_back ( position.Y () ) ;
+  z.push_back ( position.Z () ) ;
+  if ( m_covariances ) { pack ( vx->covMatrix() , 3 , cov ) ; }
+}
+// ============================================================================
+// append the bytes to the spool file of the section
+// ============================================================================
+void LoKi::Particles::HOPFileWriter::spool
+( const LoKi::HOP::FileSection section ,
+  const void*                  data    ,
+  const std::size_t            bytes   )
+{
+  if ( m_failed || 0 == bytes ) { return ; }
+  std::FILE*& file = m_spool [ section ] ;
+  if ( 0 == file ) { file = std::tmpfile () ; }
+  if ( 0 == file || bytes != std::fwrite ( data , 1 , bytes , file ) )
+  {
+    m_failed = true ;
+    LoKi::Report::Error ( "HOPFileWriter: cannot write the spool file, the candidates are lost" ) ;
+    return ;
+  }
+  m_spooled [ section ] += bytes ;
+}
+// ============================================================================
+// append the chunk in memory to the spool files and clear it
+// ============================================================================
+void LoKi::Particles::HOPFileWriter::flush ()
+{
+  const std::size_t n = m_offsets.size() - 1 ;
+  if ( 0 == n ) { return ; }
+  const std::size_t m = m_pid.size() ;
+  //
+  // the offsets in the file, the leading zero is written with the header
+  for ( std::size_t k = 1 ; k <= n ; ++k ) { m_offsets [ k ] += m_spooledNodes ; }
+  //
+  using namespace LoKi::HOP ;
+  spool ( Offsets , m_offsets.data () + 1 , n * sizeof ( std::uint64_t ) ) ;
+  spool ( Parent  , m_parent .data () , m * sizeof ( std::int32_t ) ) ;
+  spool ( Pid     , m_pid    .data () , m * sizeof ( std::int32_t ) ) ;
+  spool ( Px      , m_px     .data () , m * sizeof ( double ) ) ;
+  spool ( Py      , m_py     .data () , m * sizeof ( double ) ) ;
+  spool ( Pz      , m_pz     .data () , m * sizeof ( double ) ) ;
+  spool ( E       , m_e      .data () , m * sizeof ( double ) ) ;
+  spool ( EndX    , m_endx   .data () , n * sizeof ( double ) ) ;
+  spool ( EndY    , m_endy   .data () , n * sizeof ( double ) ) ;
+  spool ( EndZ    , m_endz   .data () , n * sizeof ( double ) ) ;
+  spool ( PvX     , m_pvx    .data () , n * sizeof ( double ) ) ;
+  spool ( PvY     , m_pvy    .data () , n * sizeof ( double ) ) ;
+  spool ( PvZ     , m_pvz    .data () , n * sizeof ( double ) ) ;
+  // empty without the covariances
+  spool ( MomCov  , m_momCov .data () , m_momCov.size () * sizeof ( double ) ) ;
+  spool ( EndCov  , m_endCov .data () , m_endCov.size () * sizeof ( double ) ) ;
+  spool ( PvCov   , m_pvCov  .data () , m_pvCov .size () * sizeof ( double ) ) ;
+  //
+  m_spooledCandidates += n ;
+  m_spooledNodes      += m ;
+  clearChunk () ;
+}
+// ============================================================================
+// write all candidates to the file
+// ============================================================================
+StatusCode LoKi::Particles::HOPFileWriter::write ( const std::string& name )
+{
+  using namespace LoKi::HOP ;
+  std::lock_guard<std::mutex> guard ( m_mutex ) ;
+  flush () ;
+  if ( m_failed )
+  { return LoKi::Report::Error ( "HOPFileWriter: the spool files are incomplete, '" + name + "' is not written" ) ; }
+  //
+  std::array<std::uint64_t,NSections> lengths = m_spooled ;
+  lengths [ Offsets ] += sizeof ( std::uint64_t ) ;
+  const FileHeader header = fileHeader ( m_spooledCandidates , m_spooledNodes , lengths ) ;
+  //
+  std::FILE* file = std::fopen ( name.c_str () , "wb" ) ;
+  if ( 0 == file ) { return LoKi::Report::Error ( "HOPFileWriter: cannot open '" + name + "'" ) ; }
+  bool ok = 1 == std::fwrite ( &header , sizeof ( header ) , 1 , file ) ;
+  std::uint64_t written = sizeof ( FileHeader ) ;
+  static const char s_zeros [ s_fileAlignment ] = {} ;
+  std::vector<char> buffer ( 1 << 20 ) ;
+  for ( std::size_t s = 0 ; ok && s < NSections ; ++s )
+  {
+    const std::uint64_t pad = header.sections [ s ] [ 0 ] - written ;
+    ok = pad == std::fwrite ( s_zeros , 1 , pad , file ) ;
+    if ( ok && Offsets == s )
+    {
+      const std::uint64_t zero = 0 ;
+      ok = 1 == std::fwrite ( &zero , sizeof ( zero ) , 1 , file ) ;
+    }
+    // copy the spool file, then continue to append at its end
+    std::FILE* spooled = m_spool [ s ] ;
+    if ( ok && 0 != spooled )
+    {
+      ok = 0 == std::fflush ( spooled ) && 0 == std::fseek ( spooled , 0 , SEEK_SET ) ;
+      for ( std::uint64_t left = m_spooled [ s ] ; ok && 0 < left ; )
+      {
+        const std::size_t k = std::min<std::uint64_t> ( left , buffer.size () ) ;
+        ok = k == std::fread  ( buffer.data () , 1 , k , spooled ) &&
+             k == std::fwrite ( buffer.data () , 1 , k , file    ) ;
+        left -= k ;
+      }
+      ok = 0 == std::fseek ( spooled , 0 , SEEK_END ) && ok ;
+    }
+    written = header.sections [ s ] [ 0 ] + lengths [ s ] ;
+  }
+  ok = 0 == std::fclose ( file ) && ok ;
+  if ( !ok ) { return LoKi::Report::Error ( "HOPFileWriter: cannot write '" + name + "'" ) ; }
+  //
+  return StatusCode::SUCCESS ;
+}
+// ============================================================================
+// remove all candidates
+// ============================================================================
+void LoKi::Particles::HOPFileWriter::clear ()
+{
+  std::lock_guard<std::mutex> guard ( m_mutex ) ;
+  clearChunk () ;
+  close () ;
+  m_spooledCandidates = 0     ;
+  m_spooledNodes      = 0     ;
+  m_failed            = false ;
+}
+// ============================================================================
+// close the spool files
+// ============================================================================
+void LoKi::Particles::HOPFileWriter::close ()
+{
+  for ( std::FILE*& file : m_spool )
+  {
+    if ( 0 != file ) { std::fclose ( file ) ; }
+    file = 0 ;
+  }
+  m_spooled.fill ( 0 ) ;
+}
+// ============================================================================
+// clear the chunk in memory
+// ============================================================================
+void LoKi::Particles::HOPFileWriter::clearChunk ()
+{
+  m_offsets.assign ( 1 , 0 ) ;
+  for ( std::vector<int>* a : { &m_parent , &m_pid } ) { a->clear () ; }
+  for ( std::vector<double>* a : { &m_px , &m_py , &m_pz , &m_e ,
+                                   &m_endx , &m_endy , &m_endz ,
+                                   &m_pvx  , &m_pvy  , &m_pvz  ,
+                                   &m_momCov , &m_endCov , &m_pvCov } )
+  { a->clear () ; }
+}
+// ============================================================================
+// The END
+// ============================================================================
@@ -0,0 +1,254 @@
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <limits>
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/Report.h"
+#include "LoKi/HOPHistograms.h"
+// ============================================================================
+/** @file
+ *
+ *  Implementation file for class LoKi::Particles::HOPHistograms
+ */
+// ============================================================================
+namespace
+{
+  // ==========================================================================
+  /// the columns: HOP mass, HOP ratio, corrected mass
+  enum { HOPMassColumn = 0 , AlphaColumn , MCorrColumn , NColumns } ;
+  // ==========================================================================
+  /// add the counts
+  void add ( std::vector<std::uint64_t>& to , const std::vector<std::uint64_t>& from )
+  {
+    for ( std::size_t k = 0 ; k < from.size () ; ++k ) { to [ k ] += from [ k ] ; }
+  }
+  // ==========================================================================
+  /// write the axis and the non-empty bins
+  void writeAxis ( std::ostream& out , const LoKi::Particles::HOPHistograms::Axis& axis )
+  { out << ' ' << axis.bins << ' ' << axis.low << ' ' << axis.high ; }
+  void writeBins ( std::ostream& out , const std::vector<std::uint64_t>& counts )
+  {
+    for ( std::size_t k = 0 ; k < counts.size () ; ++k )
+    { if ( 0 < counts [ k ] ) { out << ' ' << k << ':' << counts [ k ] ; } }
+    out << '\n' ;
+  }
+  // ==========================================================================
+  /// the fill in progress, for the check of the merge
+  struct Filling
+  {
+    explicit Filling ( std::atomic<unsigned int>& n ) : m_n ( n ) { ++m_n ; }
+    ~Filling () { --m_n ; }
+    Filling            ( const Filling& ) = delete ;
+    Filling& operator= ( const Filling& ) = delete ;
+    std::atomic<unsigned int>& m_n ;
+  } ;
+  // ==========================================================================
+}
+// ============================================================================
+// the bin of the value, with the underflow and the overflow
+// ============================================================================
+std::size_t LoKi::Particles::HOPHistograms::Axis::bin ( const double x ) const
+{
+  if ( x <  low  ) { return 0        ; }
+  if ( x >= high ) { return bins + 1 ; }
+  const std::size_t k = static_cast<std::size_t> ( ( x - low ) / ( high - low ) * bins ) ;
+  return 1 + std::min ( k , bins - 1 ) ;
+}
+// ============================================================================
+// constructor
+// ============================================================================
+LoKi::Particles::HOPHistograms::HOPHistograms
+( const Axis& hopMass ,
+  const Axis& alpha   ,
+  const Axis& mCorr   )
+  : m_hopMass ( hopMass )
+  , m_alpha   ( alpha   )
+  , m_mCorr   ( mCorr   )
+  , m_columns ( { "BPVHOPM" , "BPVHOPALPHA" , "BPVCORRM" } )
+  , m_token   ( std::make_shared<char> () )
+{
+  for ( Axis* a : { &m_hopMass , &m_alpha , &m_mCorr } )
+  {
+    if ( 0 < a->bins && a->low < a->high ) { continue ; }
+    LoKi::Report::Error ( "HOPHistograms: invalid binning, use one bin [0,1)" ) ;
+    *a = Axis { 1 , 0 , 1 } ;
+  }
+}
+// ============================================================================
+// the shard of the current thread
+// ============================================================================
+LoKi::Particles::HOPHistograms::Shard&
+LoKi::Particles::HOPHistograms::shard () const
+{
+  // the shards of this thread, by the weak handle of the instance
+  typedef std::pair<std::weak_ptr<const void>,Shard*> Entry ;
+  static thread_local std::vector<Entry> s_shards ;
+  for ( const Entry& s : s_shards )
+  {
+    // the same control block: the weak handle keeps it, thus no reuse
+    if ( !s.first.owner_before ( m_token ) && !m_token.owner_before ( s.first ) )
+    { return *s.second ; }
+  }
+  // forget the shards of the destroyed instances
+  s_shards.erase ( std::remove_if ( s_shards.begin () , s_shards.end () ,
+                                    [] ( const Entry& s ) { return s.first.expired () ; } ) ,
+                   s_shards.end () ) ;
+  //
+  std::lock_guard<std::mutex> guard ( m_mutex ) ;
+  m_shards.emplace_back ( new Shard () ) ;
+  s_shards.emplace_back ( m_token , m_shards.back().get() ) ;
+  return *m_shards.back() ;
+}
+// ============================================================================
+// the set of the channel and run in the shard
+// ============================================================================
+LoKi::Particles::HOPHistograms::Set&
+LoKi::Particles::HOPHistograms::set
+( Shard&             shard   ,
+  const std::string& channel ,
+  const unsigned int run     ) const
+{
+  Set& s = shard [ Key ( channel , run ) ] ;
+  if ( s.hopMass.empty() )
+  {
+    s.hopMass      .assign ( m_hopMass.bins + 2 , 0 ) ;
+    s.alpha        .assign ( m_alpha  .bins + 2 , 0 ) ;
+    s.mCorr        .assign ( m_mCorr  .bins + 2 , 0 ) ;
+    s.hopMassAlpha .assign ( ( m_hopMass.bins + 2 ) * ( m_alpha.bins + 2 ) , 0 ) ;
+  }
+  return s ;
+}
+// ============================================================================
+// fill the values into the set
+// ============================================================================
+void LoKi::Particles::HOPHistograms::fill
+( Set&         set     ,
+  const double hopMass ,
+  const double alpha   ,
+  const double mCorr   ) const
+{
+  ++set.entries ;
+  // each quantity is binned or counted as NaN independently
+  const bool hopNaN   = std::isnan ( hopMass ) ;
+  const bool alphaNaN = std::isnan ( alpha   ) ;
+  const bool mCorrNaN = std::isnan ( mCorr   ) ;
+  if ( hopNaN   ) { ++set.nanHopMass ; } else { ++set.hopMass [ m_hopMass.bin ( hopMass ) ] ; }
+  if ( alphaNaN ) { ++set.nanAlpha   ; } else { ++set.alpha   [ m_alpha  .bin ( alpha   ) ] ; }
+  if ( mCorrNaN ) { ++set.nanMCorr   ; } else { ++set.mCorr   [ m_mCorr  .bin ( mCorr   ) ] ; }
+  if ( hopNaN || alphaNaN ) { return ; }
+  ++set.hopMassAlpha [ m_hopMass.bin ( hopMass ) * ( m_alpha.bins + 2 ) + m_alpha.bin ( alpha ) ] ;
+}
+// ============================================================================
+// evaluate and fill the candidates
+// ============================================================================
+void LoKi::Particles::HOPHistograms::fill
+( const std::string&           channel   ,
+  const unsigned int           run       ,
+  const LHCb::Particle::Range& particles ) const
+{
+  if ( particles.empty() ) { return ; }
+  //
+  const Filling filling ( m_filling ) ;
+  static thread_local std::vector<double> s_values ;
+  const std::size_t n = particles.size() ;
+  s_values.resize ( NColumns * n ) ;
+  double* const columns [ NColumns ] =
+    { s_values.data () , s_values.data () + n , s_values.data () + 2 * n } ;
+  m_columns.fill ( particles , columns ) ;
+  //
+  Set& s = set ( shard () , channel , run ) ;
+  for ( std::size_t i = 0 ; i < n ; ++i )
+  {
+    fill ( s , columns [ HOPMassColumn ] [ i ] ,
+               columns [ AlphaColumn   ] [ i ] ,
+               columns [ MCorrColumn   ] [ i ] ) ;
+  }
+}
+// ============================================================================
+// fill the values of one candidate
+// ============================================================================
+void LoKi::Particles::HOPHistograms::fill
+( const std::string& channel ,
+  const unsigned int run     ,
+  const double       hopMass ,
+  const double       alpha   ,
+  const double       mCorr   ) const
+{
+  const Filling filling ( m_filling ) ;
+  fill ( set ( shard () , channel , run ) , hopMass , alpha , mCorr ) ;
+}
+// ============================================================================
+// merge the shards of all threads
+// ============================================================================
+LoKi::Particles::HOPHistograms::Sets
+LoKi::Particles::HOPHistograms::merge () const
+{
+  // the shards are filled without locks: all fills must be finished
+  if ( 0 != m_filling.load () )
+  { LoKi::Report::Error ( "HOPHistograms: merge() while filling, the result is undefined" ) ; }
+  //
+  std::lock_guard<std::mutex> guard ( m_mutex ) ;
+  Sets result ;
+  for ( const std::unique_ptr<Shard>& shard : m_shards )
+  {
+    for ( const auto& entry : *shard )
+    {
+      Set& s = result [ entry.first ] ;
+      if ( s.hopMass.empty() ) { s = entry.second ; continue ; }
+      s.entries    += entry.second.entries    ;
+      s.nanHopMass += entry.second.nanHopMass ;
+      s.nanAlpha   += entry.second.nanAlpha   ;
+      s.nanMCorr   += entry.second.nanMCorr   ;
+      add ( s.hopMass      , entry.second.hopMass      ) ;
+      add ( s.alpha        , entry.second.alpha        ) ;
+      add ( s.mCorr        , entry.second.mCorr        ) ;
+      add ( s.hopMassAlpha , entry.second.hopMassAlpha ) ;
+    }
+  }
+  return result ;
+}
+// ============================================================================
+// merge and write the summary file
+// ============================================================================
+StatusCode LoKi::Particles::HOPHistograms::write ( const std::string& name ) const
+{
+  const Sets sets = merge () ;
+  //
+  std::ofstream out ( name ) ;
+  if ( !out ) { return LoKi::Report::Error ( "HOPHistograms: cannot open '" + name + "'" ) ; }
+  out.precision ( std::numeric_limits<double>::max_digits10 ) ;
+  out << "# LoKi::Particles::HOPHistograms 2\n" ;
+  for ( const auto& entry : sets )
+  {
+    std::string channel = entry.first.first ;
+    std::replace_if ( channel.begin () , channel.end () ,
+                      [] ( const char c ) { return 0 != std::isspace ( static_cast<unsigned char> ( c ) ) ; } ,
+                      '_' ) ;
+    const Set& s = entry.second ;
+    out << "SET " << channel << ' ' << entry.first.second << ' '
+        << s.entries    << ' ' << s.nanHopMass << ' '
+        << s.nanAlpha   << ' ' << s.nanMCorr   << '\n' ;
+    out << "H1 HOPM"     ; writeAxis ( out , m_hopMass ) ; writeBins ( out , s.hopMass ) ;
+    out << "H1 HOPALPHA" ; writeAxis ( out , m_alpha   ) ; writeBins ( out , s.alpha   ) ;
+    out << "H1 CORRM"    ; writeAxis ( out , m_mCorr   ) ; writeBins ( out , s.mCorr   ) ;
+    out << "H2 HOPM:HOPALPHA" ;
+    writeAxis ( out , m_hopMass ) ;
+    writeAxis ( out , m_alpha   ) ;
+    writeBins ( out , s.hopMassAlpha ) ;
+  }
+  out.close () ;
+  if ( !out ) { return LoKi::Report::Error ( "HOPHistograms: cannot write '" + name + "'" ) ; }
+  return StatusCode::SUCCESS ;
+}
+// ============================================================================
+// The END
+// ============================================================================
@@ -1,8 +1,25 @@
 // ============================================================================
 // Include files
 // ============================================================================
+// STD & STL 
+// ============================================================================
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+// ============================================================================
+// GaudiKernel
+// ============================================================================
+#include "GaudiKernel/ThreadLocalContext.h"
+// ============================================================================
 // LoKi
 // ============================================================================
+#include "LoKi/ErrorReport.h"
+#include "LoKi/Report.h"
 #include "LoKi/Particles38.h"
 // ============================================================================
 /** @file
@@ -29,6 +46,39 @@
  * <a href="https://cds.cern.ch/record/2102345?ln=en">LHCb-INT-2015-037</a>
  */
 
+namespace LoKi 
+{
+  namespace HOP 
+  {
+    // ========================================================================
+    /** @struct NodeTraits<LHCb::Particle>
+     *  Access to the reconstructed decay trees for the HOP core
+     *  @see LoKi::HOP::NodeTraits 
+     */
+    template <>
+    struct NodeTraits<LHCb::Particle> 
+    {
+      static P4 momentum ( const LHCb::Particle& p ) 
+      {
+        const LoKi::LorentzVector& v = p.momentum() ;
+        return P4 { v.Px () , v.Py () , v.Pz () , v.E () } ;
+      }
+      static unsigned    abspid     ( const LHCb::Particle& p ) 
+      { return p.particleID().abspid() ; }
+      static bool        isBasic    ( const LHCb::Particle& p ) 
+      { return p.isBasicParticle() ; }
+      static std::size_t nDaughters ( const LHCb::Particle& p ) 
+      { return p.daughtersVector().size() ; }
+      static const LHCb::Particle* daughter 
+      ( const LHCb::Particle& p , const std::size_t i ) 
+      { return p.daughtersVector() [ i ] ; }
+      static double      momCov     ( const LHCb::Particle& p , const int i , const int j ) 
+      { return p.momCovMatrix() ( i , j ) ; }
+    } ;
+    // ========================================================================
+  }
+}
+// ============================================================================
 /// anonymos namespace to hide local variables 
 namespace 
 {
@@ -38,8 +88,1079 @@ namespace
   /// the invalid 3Dpoint 
   const LoKi::Point3D     s_POINT  =  LoKi::Point3D     ( 0 , 0 , -1 * Gaudi::Units::km    ) ;
   // ==========================================================================
+  /// the scratch storage for the HOP tree walk 
+  typedef LoKi::HOP::Scratch<LHCb::Particle> HOPScratch ;
+  // ==========================================================================
+  /// the scratch storage for the tree walk, one per thread 
+  HOPScratch& hopScratch () 
+  {
+    static thread_local HOPScratch s_scratch ;
+    return s_scratch ;
+  }
+  // ==========================================================================
+  /// the compiled HOP classifications keyed by the topology, one per thread 
+  LoKi::HOP::PlanCache<LHCb::Particle>& hopPlans () 
+  {
+    static thread_local LoKi::HOP::PlanCache<LHCb::Particle> s_plans ;
+    return s_plans ;
+  }
+  // ==========================================================================
+  /// the switch of the event-scoped memo 
+  std::atomic<bool> s_memo { true } ;
+  /// the switches of the best-vertex association with the index 
+  std::atomic<bool> s_vertexIndex { false } ;
+  std::atomic<bool> s_verifyIndex { false } ;
+  // ==========================================================================
+  /// convert the 4-momentum 
+  inline LoKi::HOP::P4 p4 ( const LoKi::LorentzVector& v ) 
+  { return LoKi::HOP::P4 { v.Px () , v.Py () , v.Pz () , v.E () } ; }
+  // ==========================================================================
+  /** the hash of the address for the direct-mapped caches.
+   *  <code>std::hash</code> of a pointer is the address itself, whose 
+   *  low bits are always zero for aligned objects, and the objects of 
+   *  one event come with regular strides from few pools: the bits are 
+   *  mixed by the multiplicative (Fibonacci) hash, and its high bits 
+   *  are folded into the low ones used for the slot 
+   */
+  inline std::size_t hashAddress ( const void* address ) 
+  {
+    const std::uint64_t a = 
+      ( reinterpret_cast<std::uintptr_t> ( address ) >> 4 ) * 0x9E3779B97F4A7C15ull ;
+    return static_cast<std::size_t> ( a ^ ( a >> 29 ) ) ;
+  }
+  // ==========================================================================
+  /** @class EventCache
+   *  Small direct-mapped cache of per-candidate results, shared by 
+   *  all functors from this file.
+   *
+   *  Each entry is tagged with the event number from the current event 
+   *  context, thus entries from previous events are never used: 
+   *  the cache is effectively cleared at the event boundaries.
+   *  Outside of the event loop nothing is cached, nor if the memo 
+   *  is switched off (see LoKi::Particles::Memo).
+   *  The storage is fixed, there are no allocations.
+   *
+   *  KEY must provide <code>hash()</code> and <code>operator==</code>
+   */
+  template <class KEY, class VALUE, std::size_t N = 64>
+  class EventCache 
+  {
+  public:
+    // ========================================================================
+    /// get the cached value, nullptr if there is none 
+    const VALUE* find ( const KEY& key ) const 
+    {
+      const EventContext& ctx = Gaudi::Hive::currentContext() ;
+      if ( !ctx.valid() || !s_memo.load ( std::memory_order_relaxed ) ) { return nullptr ; }
+      const Entry& e = m_entries [ key.hash() % N ] ;
+      return e.valid && e.event == ctx.evt() && e.key == key ? &e.value : nullptr ;
+    }
+    /// store the value 
+    void insert ( const KEY& key , const VALUE& value ) 
+    {
+      const EventContext& ctx = Gaudi::Hive::currentContext() ;
+      if ( !ctx.valid() || !s_memo.load ( std::memory_order_relaxed ) ) { return ; }
+      Entry& e = m_entries [ key.hash() % N ] ;
+      e.valid = true      ;
+      e.event = ctx.evt() ;
+      e.key   = key       ;
+      e.value = value     ;
+    }
+    // ========================================================================
+  private:
+    // ========================================================================
+    struct Entry 
+    {
+      bool        valid = false ;
+      std::size_t event = 0     ;
+      KEY         key   {}      ;
+      VALUE       value {}      ;
+    } ;
+    std::array<Entry,N> m_entries ;
+    // ========================================================================
+  } ;
+  // ==========================================================================
+  /** @struct CandidateKey
+   *  The key for per-candidate results: the particle itself and its 
+   *  flight direction.
+   *  The decay vertex and the momentum guard against the reuse of the 
+   *  same address by another (temporary) candidate within the same event, 
+   *  e.g. a refitted clone with the same momentum.
+   */
+  struct CandidateKey 
+  {
+    const LHCb::Particle*   particle  ;
+    const LHCb::VertexBase* endVertex ;
+    LoKi::LorentzVector     momentum  ;
+    LoKi::ThreeVector       flight    ;
+    //
+    std::size_t hash () const { return hashAddress ( particle ) ; }
+    bool operator== ( const CandidateKey& right ) const 
+    {
+      return particle  == right.particle 
+        &&   endVertex == right.endVertex 
+        &&   momentum  == right.momentum 
+        &&   flight    == right.flight    ;
+    }
+  } ;
+  // ==========================================================================
+  /** @struct DesktopKey
+   *  The key for the best primary vertex: the particle itself and 
+   *  the desktop used for the association 
+   *  @see CandidateKey 
+   */
+  struct DesktopKey 
+  {
+    const LHCb::Particle*   particle  ;
+    const LHCb::VertexBase* endVertex ;
+    LoKi::LorentzVector     momentum  ;
+    const IDVAlgorithm*     desktop   ;
+    //
+    std::size_t hash () const { return hashAddress ( particle ) ; }
+    bool operator== ( const DesktopKey& right ) const 
+    {
+      return particle  == right.particle 
+        &&   endVertex == right.endVertex 
+        &&   momentum  == right.momentum 
+        &&   desktop   == right.desktop   ;
+    }
+  } ;
+  // ==========================================================================
+  /// the best primary vertex and the normalised flight direction 
+  struct FlightInfo 
+  {
+    const LHCb::VertexBase* pv     ;
+    LoKi::ThreeVector       flight ;
+  } ;
+  // ==========================================================================
+  /// the cache of the best vertices and flight directions, one per thread 
+  EventCache<DesktopKey,FlightInfo>& flightCache () 
+  {
+    static thread_local EventCache<DesktopKey,FlightInfo> s_cache ;
+    return s_cache ;
+  }
+  // ==========================================================================
+  /// the cache of the HOP evaluations, one per thread 
+  EventCache<CandidateKey,LoKi::Particles::HOPInfo>& hopCache () 
+  {
+    static thread_local EventCache<CandidateKey,LoKi::Particles::HOPInfo> s_cache ;
+    return s_cache ;
+  }
+  // ==========================================================================
+  /** @struct ParticleKey
+   *  The key for per-particle annotations 
+   *  @see CandidateKey 
+   */
+  struct ParticleKey 
+  {
+    const LHCb::Particle*   particle  ;
+    const LHCb::VertexBase* endVertex ;
+    LoKi::LorentzVector     momentum  ;
+    //
+    std::size_t hash () const { return hashAddress ( particle ) ; }
+    bool operator== ( const ParticleKey& right ) const 
+    {
+      return particle  == right.particle 
+        &&   endVertex == right.endVertex 
+        &&   momentum  == right.momentum  ;
+    }
+  } ;
+  // ==========================================================================
+  /** @struct EventAnnotations 
+   *  The event-scoped side table with the electron content of the 
+   *  composite particles, shared by all candidates of the event, 
+   *  one per thread.
+   *  @see LoKi::HOP::NoAnnotations 
+   *  @see LoKi::HOP::Content
+   */
+  struct EventAnnotations 
+  {
+    // ========================================================================
+    unsigned char find ( const LHCb::Particle& p ) const 
+    {
+      const unsigned char* content = table().find ( ParticleKey { &p , p.endVertex() , p.momentum() } ) ;
+      return content ? *content : static_cast<unsigned char> ( LoKi::HOP::Unknown ) ;
+    }
+    void insert ( const LHCb::Particle& p , const unsigned char content ) 
+    { table().insert ( ParticleKey { &p , p.endVertex() , p.momentum() } , content ) ; }
+    // ========================================================================
+    static EventCache<ParticleKey,unsigned char,256>& table () 
+    {
+      static thread_local EventCache<ParticleKey,unsigned char,256> s_table ;
+      return s_table ;
+    }
+    // ========================================================================
+  } ;
+  // ==========================================================================
+  /** @struct EventPartials 
+   *  The event-scoped side table with the HOP decompositions of the 
+   *  sub-decays, shared by all candidates of the event, one per thread.
+   *  The candidates of the combinatorics built from the same dielectron 
+   *  or the same hadronic system reuse its sums 
+   *  @see LoKi::HOP::NoPartials 
+   *  @see LoKi::HOP::Partial
+   */
+  struct EventPartials 
+  {
+    // ========================================================================
+    typedef LoKi::HOP::Partial<LHCb::Particle> Partial ;
+    // ========================================================================
+    const Partial* find ( const LHCb::Particle& p ) const 
+    { return table().find ( ParticleKey { &p , p.endVertex() , p.momentum() } ) ; }
+    void insert ( const LHCb::Particle& p , const Partial& partial ) 
+    { table().insert ( ParticleKey { &p , p.endVertex() , p.momentum() } , partial ) ; }
+    // ========================================================================
+    static EventCache<ParticleKey,Partial,256>& table () 
+    {
+      static thread_local EventCache<ParticleKey,Partial,256> s_table ;
+      return s_table ;
+    }
+    // ========================================================================
+  } ;
+  // ==========================================================================
+  /** evaluate all HOP quantities for the candidate 
+   *  The result is taken from the event cache, if available.
+   *  If the primary vertex is specified, the uncertainty of the HOP mass 
+   *  is evaluated in the same pass 
+   *  @param p       (INPUT)  the candidate
+   *  @param flight  (INPUT)  the flight direction of the candidate 
+   *  @param scratch (UPDATE) the scratch storage for the tree walk
+   *  @param holder  (INPUT)  the functor with the diagnostics 
+   *  @param pv      (INPUT)  the primary vertex, for the uncertainty 
+   *  @return all HOP quantities 
+   */
+  LoKi::Particles::HOPInfo hopEvaluate
+  ( const LHCb::Particle*                     p       , 
+    const LoKi::ThreeVector&                  flight  , 
+    HOPScratch&                               scratch , 
+    const LoKi::Particles::DiagnosticsHolder& holder  , 
+    const LHCb::VertexBase*                   pv      = 0 ) 
+  {
+    const CandidateKey key { p , p->endVertex() , p->momentum() , flight } ;
+    const LoKi::Particles::HOPInfo* cached = hopCache().find ( key ) ;
+    const bool hit = cached && ( 0 == pv || !std::isnan ( cached->massErr ) ) ;
+    holder.memo ( hit ) ;
+    if ( hit ) { return *cached ; }                                  // RETURN 
+    //
+    // the uncertainty needs the nodes: no partial results then 
+    EventAnnotations annotations ;
+    EventPartials    partials    ;
+    LoKi::HOP::P4 P_h , P_e ;
+    if ( 0 != pv ) 
+    { LoKi::HOP::walk ( p , scratch , hopPlans () , annotations ,            P_h , P_e ) ; }
+    else 
+    { LoKi::HOP::walk ( p , scratch , hopPlans () , annotations , partials , P_h , P_e ) ; }
+    LoKi::Particles::HOPInfo info = LoKi::HOP::complete 
+      ( scratch , P_h , P_e , flight.X () , flight.Y () , flight.Z () ) ;
+    //
+    if ( 0 != pv ) 
+    {
+      const LHCb::VertexBase* vx = p->endVertex() ;
+      const LoKi::ThreeVector d  = vx->position() - pv->position() ;
+      info.massErr = LoKi::HOP::hopMassError<LoKi::HOP::NodeTraits<LHCb::Particle> > 
+        ( scratch , P_h , P_e , info , d.X () , d.Y () , d.Z () , 
+          vx->covMatrix () , pv->covMatrix () ) ;
+    }
+    //
+    hopCache().insert ( key , info ) ;
+    return info ;
+  }
+  // ==========================================================================
+  /** evaluate the HOP mass of the candidate, unless the bounds already 
+   *  decide the side of the threshold: the mass of the hadronic part, 
+   *  then the bounds from the HOP ratio, without the correction of the 
+   *  electrons 
+   *  @param p       (INPUT)  the candidate
+   *  @param flight  (INPUT)  the flight direction of the candidate 
+   *  @param scratch (UPDATE) the scratch storage for the tree walk
+   *  @param holder  (INPUT)  the functor with the diagnostics 
+   *  @param cut     (INPUT)  the threshold 
+   *  @param side    (OUTPUT) +1 (-1) if the HOP mass is above (below) the 
+   *                          threshold by the bounds, 0 if it is evaluated 
+   *  @return the HOP mass, if evaluated 
+   *  @see LoKi::HOP::hopMassSide
+   */
+  double hopMassBounded
+  ( const LHCb::Particle*                     p       , 
+    const LoKi::ThreeVector&                  flight  , 
+    HOPScratch&                               scratch , 
+    const LoKi::Particles::DiagnosticsHolder& holder  , 
+    const double                              cut     , 
+    int&                                      side    ) 
+  {
+    side = 0 ;
+    const CandidateKey key { p , p->endVertex() , p->momentum() , flight } ;
+    const LoKi::Particles::HOPInfo* cached = hopCache().find ( key ) ;
+    holder.memo ( 0 != cached ) ;
+    if ( cached ) { return cached->mass ; }                          // RETURN 
+    //
+    EventAnnotations annotations ;
+    EventPartials    partials    ;
+    LoKi::HOP::P4 P_h , P_e ;
+    LoKi::HOP::walk ( p , scratch , hopPlans () , annotations , partials , P_h , P_e ) ;
+    //
+    side = LoKi::HOP::hopMassSide 
+      ( scratch , P_h , P_e , flight.X () , flight.Y () , flight.Z () , cut ) ;
+    if ( 0 != side ) { return std::numeric_limits<double>::quiet_NaN () ; } // RETURN 
+    //
+    const LoKi::Particles::HOPInfo info = LoKi::HOP::complete 
+      ( scratch , P_h , P_e , flight.X () , flight.Y () , flight.Z () ) ;
+    hopCache().insert ( key , info ) ;
+    return info.mass ;
+  }
+  // ==========================================================================
+  // Batch evaluation 
+  // ==========================================================================
+  /** @def LOKI_PARTICLES38_SIMD 
+   *  Build the batch kernels for AVX-512 and AVX2 in addition to the 
+   *  baseline instruction set; the best version is selected at load time.
+   *  The kernels are plain loops over contiguous arrays, any other 
+   *  compiler gets the baseline (scalar or auto-vectorised) version 
+   */
+#if defined ( __GNUC__ ) && !defined ( __clang__ ) && defined ( __x86_64__ ) 
+#define LOKI_PARTICLES38_SIMD \
+  __attribute__ (( target_clones ( "avx512f" , "avx2" , "default" ) ))
+#else 
+#define LOKI_PARTICLES38_SIMD 
+#endif 
+  // ==========================================================================
+  /// the status of the candidate in the batch evaluation 
+  enum BatchStatus { Valid = 0 , NoParticle , NoEndVertex , NoBestVertex } ;
+  // ==========================================================================
+  /** @struct Batch 
+   *  Structure-of-arrays scratch storage for the batch evaluation.
+   *  The arrays are resized for each batch, keeping their capacity 
+   */
+  struct Batch 
+  {
+    // ========================================================================
+    void resize ( const std::size_t n ) 
+    {
+      for ( std::vector<double>* a : { &px , &py , &pz , &e  , &dx , &dy , &dz , 
+                                       &hx , &hy , &hz , &he , 
+                                       &ex , &ey , &ez , &pt , &ptE } ) 
+      { a->resize ( n ) ; }
+      status . resize ( n     ) ;
+      known  . resize ( n     ) ;
+      infos  . resize ( n     ) ;
+      first  . resize ( n + 1 ) ;
+      leptons.clear () ;
+    }
+    // ========================================================================
+    /// the momenta of the candidates
+    std::vector<double> px , py , pz , e  ;
+    /// the flight directions of the candidates
+    std::vector<double> dx , dy , dz ;
+    /// the hadronic (HOP) 4-momenta 
+    std::vector<double> hx , hy , hz , he ;
+    /// the electronic (HOP) 3-momenta 
+    std::vector<double> ex , ey , ez ;
+    /// the kernel outputs 
+    std::vector<double> pt , ptE ;
+    /// HOP: the momenta of the electrons in single precision 
+    std::vector<float>  lx , ly , lz ;
+    /// the status of the candidates 
+    std::vector<BatchStatus>              status    ;
+    /// HOP: is the result already known from the event cache? 
+    std::vector<char>                     known     ;
+    /// HOP: the results 
+    std::vector<LoKi::Particles::HOPInfo> infos     ;
+    /// HOP: the momenta of the electrons of all candidates 
+    std::vector<LoKi::HOP::P4>            leptons   ;
+    /// HOP: the offset of the first electron of each candidate 
+    std::vector<std::size_t>              first     ;
+    // ========================================================================
+  } ;
+  // ==========================================================================
+  /// the scratch storage for the batch evaluation, one per thread 
+  Batch& batch () 
+  {
+    static thread_local Batch s_batch ;
+    return s_batch ;
+  }
+  // ==========================================================================
+  /** the transverse momentum with respect to the flight direction 
+   *  @see LoKi::HOP::ptDir 
+   */
+  LOKI_PARTICLES38_SIMD 
+  void ptKernel 
+  ( const std::size_t            n  , 
+    const double* __restrict__   px , 
+    const double* __restrict__   py , 
+    const double* __restrict__   pz , 
+    const double* __restrict__   dx , 
+    const double* __restrict__   dy , 
+    const double* __restrict__   dz , 
+    double*       __restrict__   pt ) 
+  {
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    { pt[i] = LoKi::HOP::ptDir ( px[i] , py[i] , pz[i] , dx[i] , dy[i] , dz[i] ) ; }
+  }
+  // ==========================================================================
+  /** the corrected mass from the 4-momentum and the transverse momentum 
+   *  @see LoKi::HOP::mCorr 
+   */
+  LOKI_PARTICLES38_SIMD 
+  void mCorrKernel 
+  ( const std::size_t            n  , 
+    const double* __restrict__   px , 
+    const double* __restrict__   py , 
+    const double* __restrict__   pz , 
+    const double* __restrict__   e  , 
+    const double* __restrict__   pt , 
+    double*       __restrict__   m  ) 
+  {
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    {
+      const double m2 = e[i] * e[i] - ( px[i] * px[i] + py[i] * py[i] + pz[i] * pz[i] ) ;
+      m[i] = LoKi::HOP::mCorr ( m2 , pt[i] ) ;
+    }
+  }
+  // ==========================================================================
+  /** the corrected mass in single precision, branch-free: only the squared 
+   *  mass is taken in double precision 
+   *  @see LoKi::HOP::mCorrFast 
+   */
+  LOKI_PARTICLES38_SIMD 
+  void mCorrKernelFast 
+  ( const std::size_t            n  , 
+    const double* __restrict__   px , 
+    const double* __restrict__   py , 
+    const double* __restrict__   pz , 
+    const double* __restrict__   e  , 
+    const double* __restrict__   ux , 
+    const double* __restrict__   uy , 
+    const double* __restrict__   uz , 
+    double*       __restrict__   m  ) 
+  {
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    {
+      const double m2 = e[i] * e[i] - ( px[i] * px[i] + py[i] * py[i] + pz[i] * pz[i] ) ;
+      const float  pt = LoKi::HOP::ptDirFast ( px[i] , py[i] , pz[i] , ux[i] , uy[i] , uz[i] ) ;
+      m[i] = LoKi::HOP::mCorrFast ( m2 , pt ) ;
+    }
+  }
+  // ==========================================================================
+  /** gather the momenta and flight directions into the batch 
+   *  @param particles (INPUT)  the candidates 
+   *  @param b         (UPDATE) the batch 
+   *  @param flight    (INPUT)  the flight direction <code>bool(p,dir&)</code>,
+   *                            called only for candidates with end-vertex
+   */
+  template <class FLIGHT>
+  void gather 
+  ( const LHCb::Particle::Range& particles , 
+    Batch&                       b         , 
+    FLIGHT                       flight    ) 
+  {
+    const std::size_t n = particles.size() ;
+    b.resize ( n ) ;
+    LoKi::ThreeVector dir ;
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    {
+      const LHCb::Particle* p = particles [ i ] ;
+      b.status [ i ] = 
+        0 == p                 ? NoParticle   : 
+        0 == p->endVertex()    ? NoEndVertex  : 
+        !flight ( p , dir )    ? NoBestVertex : Valid ;
+      if ( Valid != b.status [ i ] ) 
+      {
+        b.px [ i ] = b.py [ i ] = b.pz [ i ] = b.e  [ i ] = 0 ;
+        b.dx [ i ] = b.dy [ i ] = b.dz [ i ] = 0 ;
+        continue ;
+      }
+      const LoKi::LorentzVector& mom = p->momentum() ;
+      b.px [ i ] = mom.Px () ;
+      b.py [ i ] = mom.Py () ;
+      b.pz [ i ] = mom.Pz () ;
+      b.e  [ i ] = mom.E  () ;
+      b.dx [ i ] = dir.X  () ;
+      b.dy [ i ] = dir.Y  () ;
+      b.dz [ i ] = dir.Z  () ;
+    }
+  }
+  // ==========================================================================
+  /** set the invalid results, count the calls and the problems.
+   *  The messages are built only for the few reported problems 
+   *  @param b       (INPUT)  the batch 
+   *  @param results (UPDATE) the results 
+   *  @param invalid (INPUT)  the value for invalid candidates 
+   *  @param what    (INPUT)  the name of the invalid value 
+   *  @param holder  (INPUT)  the functor with the diagnostics 
+   */
+  void finalize 
+  ( const Batch&                               b       , 
+    double*                                    results , 
+    const double                               invalid , 
+    const char*                                what    , 
+    const LoKi::Particles::DiagnosticsHolder&  holder  ) 
+  {
+    typedef LoKi::Particles::Diagnostics D ;
+    holder.countCalls ( b.status.size() ) ;
+    for ( std::size_t i = 0 ; i < b.status.size() ; ++i ) 
+    {
+      switch ( b.status [ i ] ) 
+      {
+      case Valid        : continue ;
+      case NoParticle   : 
+        if ( holder.diagnose ( D::NoParticle   ) ) 
+        { holder.Error ( std::string ( "Invalid argument, return 'Invalid "  ) + what + "'" ) ; }
+        break ;
+      case NoEndVertex  : 
+        if ( holder.diagnose ( D::NoEndVertex  ) ) 
+        { holder.Error ( std::string ( "EndVertex is invalid, return 'Invalid " ) + what + "'" ) ; }
+        break ;
+      case NoBestVertex : 
+        if ( holder.diagnose ( D::NoBestVertex ) ) 
+        { holder.Error ( std::string ( "BestVertex is invalid, return 'Invalid " ) + what + "'" ) ; }
+        break ;
+      }
+      results [ i ] = invalid ;
+    }
+  }
+  // ==========================================================================
+  /** walk all decay trees of the batch 
+   *  @param particles (INPUT)  the candidates 
+   *  @param b         (UPDATE) the batch, gathered, on exit holds P_h, P_e and 
+   *                            the momenta of the electrons, or the known results
+   *  @param scratch   (UPDATE) the scratch storage for the tree walk 
+   *  @param holder    (INPUT)  the functor with the diagnostics 
+   *  @param cached    (INPUT)  take the known results from the event cache? 
+   */
+  void hopWalk 
+  ( const LHCb::Particle::Range&              particles , 
+    Batch&                                    b         , 
+    HOPScratch&                               scratch   , 
+    const LoKi::Particles::DiagnosticsHolder& holder    , 
+    const bool                                cached    = true ) 
+  {
+    const std::size_t n = particles.size() ;
+    std::size_t hits = 0 , misses = 0 ;
+    EventAnnotations annotations ;
+    EventPartials    partials    ;
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    {
+      b.first [ i ] = b.leptons.size() ;
+      b.known [ i ] = 0 ;
+      b.hx [ i ] = b.hy [ i ] = b.hz [ i ] = b.he [ i ] = 0 ;
+      b.ex [ i ] = b.ey [ i ] = b.ez [ i ] = 0 ;
+      if ( Valid != b.status [ i ] ) { continue ; }
+      //
+      const LHCb::Particle* p = particles [ i ] ;
+      const LoKi::Particles::HOPInfo* known = !cached ? 0 : hopCache().find 
+        ( CandidateKey { p , p->endVertex() , p->momentum() , 
+                         LoKi::ThreeVector ( b.dx [ i ] , b.dy [ i ] , b.dz [ i ] ) } ) ;
+      if ( known ) 
+      {
+        b.infos [ i ] = *known ;
+        b.known [ i ] = 1 ;
+        ++hits ;
+        continue ;
+      }
+      ++misses ;
+      //
+      LoKi::HOP::P4 P_h , P_e ;
+      LoKi::HOP::walk ( p , scratch , hopPlans () , annotations , partials , P_h , P_e ) ;
+      b.hx [ i ] = P_h.px ; 
+      b.hy [ i ] = P_h.py ; 
+      b.hz [ i ] = P_h.pz ; 
+      b.he [ i ] = P_h.e  ;
+      b.ex [ i ] = P_e.px ; 
+      b.ey [ i ] = P_e.py ; 
+      b.ez [ i ] = P_e.pz ;
+      b.leptons.insert ( b.leptons.end() , 
+                         scratch.leptons.begin () , 
+                         scratch.leptons.end   () ) ;
+    }
+    b.first [ n ] = b.leptons.size() ;
+    if ( cached ) 
+    {
+      holder.memo ( true  , hits   ) ;
+      holder.memo ( false , misses ) ;
+    }
+  }
+  // ==========================================================================
+  /** evaluate all HOP quantities for the whole batch.
+   *  The trees are walked candidate by candidate with the compiled plans 
+   *  (unless the result is already in the event cache), the flight 
+   *  projections for all candidates are done at once by the vectorised kernel 
+   *  @param particles (INPUT)  the candidates 
+   *  @param b         (UPDATE) the batch, gathered, on exit holds the results 
+   *  @param scratch   (UPDATE) the scratch storage for the tree walk 
+   *  @param holder    (INPUT)  the functor with the diagnostics 
+   */
+  void hopBatch 
+  ( const LHCb::Particle::Range&              particles , 
+    Batch&                                    b         , 
+    HOPScratch&                               scratch   , 
+    const LoKi::Particles::DiagnosticsHolder& holder    ) 
+  {
+    const std::size_t n = particles.size() ;
+    hopWalk ( particles , b , scratch , holder ) ;
+    //
+    ptKernel ( n , b.hx.data() , b.hy.data() , b.hz.data() , 
+               b.dx.data() , b.dy.data() , b.dz.data() , b.pt .data() ) ;
+    ptKernel ( n , b.ex.data() , b.ey.data() , b.ez.data() , 
+               b.dx.data() , b.dy.data() , b.dz.data() , b.ptE.data() ) ;
+    //
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    {
+      if ( Valid != b.status [ i ] || b.known [ i ] ) { continue ; }
+      //
+      LoKi::Particles::HOPInfo& info = b.infos [ i ] ;
+      info.ptH     = b.pt  [ i ] ;
+      info.ptE     = b.ptE [ i ] ;
+      info.massErr = std::numeric_limits<double>::quiet_NaN () ;
+      LoKi::HOP::correct 
+        ( b.leptons.begin () + b.first [ i     ] , 
+          b.leptons.begin () + b.first [ i + 1 ] , 
+          LoKi::HOP::P4 { b.hx [ i ] , b.hy [ i ] , b.hz [ i ] , b.he [ i ] } , info ) ;
+      //
+      const LHCb::Particle* p = particles [ i ] ;
+      hopCache().insert 
+        ( CandidateKey { p , p->endVertex() , p->momentum() , 
+                         LoKi::ThreeVector ( b.dx [ i ] , b.dy [ i ] , b.dz [ i ] ) } , 
+          info ) ;
+    }
+  }
+  // ==========================================================================
+  /** the HOP masses for the whole batch in single precision, branch-free.
+   *  The event cache of the exact results is bypassed: the fast results 
+   *  do not depend on the exact evaluations done before in the event 
+   *  @param particles (INPUT)  the candidates 
+   *  @param b         (UPDATE) the batch, gathered 
+   *  @param scratch   (UPDATE) the scratch storage for the tree walk 
+   *  @param results   (OUTPUT) the HOP masses 
+   *  @param holder    (INPUT)  the functor with the diagnostics 
+   *  @see LoKi::HOP::hopMassFast 
+   */
+  void hopBatchFast 
+  ( const LHCb::Particle::Range&              particles , 
+    Batch&                                    b         , 
+    HOPScratch&                               scratch   , 
+    double*                                   results   , 
+    const LoKi::Particles::DiagnosticsHolder& holder    ) 
+  {
+    const std::size_t n = particles.size() ;
+    hopWalk ( particles , b , scratch , holder , false ) ;
+    //
+    const std::size_t ne = b.leptons.size() ;
+    b.lx.resize ( ne ) ;
+    b.ly.resize ( ne ) ;
+    b.lz.resize ( ne ) ;
+    for ( std::size_t k = 0 ; k < ne ; ++k ) 
+    {
+      b.lx [ k ] = b.leptons [ k ].px ;
+      b.ly [ k ] = b.leptons [ k ].py ;
+      b.lz [ k ] = b.leptons [ k ].pz ;
+    }
+    //
+    std::size_t bad = 0 ;
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    {
+      if ( Valid != b.status [ i ] ) { continue ; }
+      const std::size_t first = b.first [ i ] ;
+      results [ i ] = LoKi::HOP::hopMassFast 
+        ( b.hx [ i ] , b.hy [ i ] , b.hz [ i ] , b.he [ i ] , 
+          b.ex [ i ] , b.ey [ i ] , b.ez [ i ] , 
+          b.dx [ i ] , b.dy [ i ] , b.dz [ i ] , 
+          b.lx.data() + first , b.ly.data() + first , b.lz.data() + first , 
+          b.first [ i + 1 ] - first ) ;
+      if ( !std::isfinite ( results [ i ] ) ) { ++bad ; }
+    }
+    if ( 0 < bad ) { holder.diagnose ( LoKi::Particles::Diagnostics::BadAlpha , bad ) ; }
+  }
+  // ==========================================================================
+  /** evaluate the functor for one particle through its batch evaluation, 
+   *  thus the scalar and the batch results are the same 
+   *  @param functor the functor 
+   *  @param p       the particle 
+   */
+  template <class FUNCTOR>
+  double evaluateOne ( const FUNCTOR& functor , const LHCb::Particle* p ) 
+  {
+    static thread_local LHCb::Particle::ConstVector s_one ( 1 ) ;
+    s_one [ 0 ] = p ;
+    double result = 0 ;
+    functor.evaluate ( LHCb::Particle::Range ( s_one ) , &result ) ;
+    return result ;
+  }
+  // ==========================================================================
+  /** copy the requested HOP quantity into the results 
+   *  and count the non-finite alpha 
+   *  @param b       (INPUT)  the batch with HOP results 
+   *  @param results (OUTPUT) the results 
+   *  @param field   (INPUT)  the requested quantity 
+   *  @param holder  (INPUT)  the functor with the diagnostics 
+   */
+  void hopSelect 
+  ( const Batch&                              b       , 
+    double*                                   results , 
+    double LoKi::Particles::HOPInfo::*        field   , 
+    const LoKi::Particles::DiagnosticsHolder& holder  ) 
+  {
+    std::size_t bad = 0 ;
+    for ( std::size_t i = 0 ; i < b.status.size() ; ++i ) 
+    { 
+      if ( Valid != b.status [ i ] ) { continue ; }
+      results [ i ] = b.infos [ i ] .* field ;
+      if ( !std::isfinite ( b.infos [ i ].alpha ) ) { ++bad ; }
+    }
+    if ( 0 < bad ) { holder.diagnose ( LoKi::Particles::Diagnostics::BadAlpha , bad ) ; }
+  }
+  // ==========================================================================
+  /** @struct VertexIndex 
+   *  The event-level index of the primary vertices: the vertices, their 
+   *  positions and the traces of their covariances as contiguous arrays, 
+   *  in the order of the container, and the order of the vertices in z.
+   *  It is built once per event and desktop, and shared by all candidates 
+   *  of PVSCANM and, if switched on, of the BPV* functors, one per thread. 
+   *  Outside of the event loop it is rebuilt for each call.
+   *  @see LoKi::Particles::BestVertexIndex 
+   */
+  struct VertexIndex 
+  {
+    // ========================================================================
+    /// get the index for the primary vertices of the desktop 
+    static const VertexIndex& get ( const IDVAlgorithm* desktop ) 
+    {
+      static thread_local VertexIndex s_index ;
+      const EventContext& ctx = Gaudi::Hive::currentContext() ;
+      if ( !ctx.valid() || !s_index.valid || 
+           s_index.event != ctx.evt() || s_index.desktop != desktop ) 
+      {
+        s_index.build ( desktop->primaryVertices() ) ;
+        s_index.valid   = ctx.valid () ;
+        s_index.event   = ctx.valid () ? ctx.evt () : 0 ;
+        s_index.desktop = desktop ;
+      }
+      return s_index ;
+    }
+    // ========================================================================
+    void build ( const LHCb::RecVertex::Range& pvs ) 
+    {
+      const std::size_t n = pvs.size() ;
+      vertices.assign ( pvs.begin () , pvs.end () ) ;
+      x     .resize ( n ) ;
+      y     .resize ( n ) ;
+      z     .resize ( n ) ;
+      spread.resize ( n ) ;
+      order .resize ( n ) ;
+      sorted.resize ( n ) ;
+      for ( std::size_t i = 0 ; i < n ; ++i ) 
+      {
+        const LoKi::Point3D&       pos = pvs [ i ]->position()  ;
+        const Gaudi::SymMatrix3x3& cov = pvs [ i ]->covMatrix() ;
+        x      [ i ] = pos.X () ;
+        y      [ i ] = pos.Y () ;
+        z      [ i ] = pos.Z () ;
+        spread [ i ] = std::max ( cov ( 0 , 0 ) + cov ( 1 , 1 ) + cov ( 2 , 2 ) , 0.0 ) ;
+        order  [ i ] = i ;
+      }
+      std::stable_sort ( order.begin () , order.end () , 
+                         [this] ( const std::size_t a , const std::size_t b ) 
+                         { return z [ a ] < z [ b ] ; } ) ;
+      for ( std::size_t i = 0 ; i < n ; ++i ) { sorted [ i ] = z [ order [ i ] ] ; }
+    }
+    // ========================================================================
+    std::size_t size () const { return vertices.size() ; }
+    // ========================================================================
+    /// the primary vertices 
+    std::vector<const LHCb::VertexBase*> vertices ;
+    /// their positions 
+    std::vector<double> x , y , z ;
+    /// the traces of their covariances, the bounds of the variances 
+    std::vector<double> spread ;
+    /// the vertices in the order of z, and their z in this order 
+    std::vector<std::size_t> order  ;
+    std::vector<double>      sorted ;
+    /// the event and the desktop 
+    bool                valid   = false   ;
+    std::size_t         event   = 0       ;
+    const IDVAlgorithm* desktop = nullptr ;
+    // ========================================================================
+  } ;
+  // ==========================================================================
+  /** the primary vertex with the smallest IP chi2 of the particle, from 
+   *  the event-level index, as the relator of the desktop finds it 
+   *  without the stored relations.
+   *
+   *  The vertices are visited outwards from the one closest in z to the 
+   *  point of the trajectory closest to the beam line. A vertex is passed 
+   *  to the distance calculator unless the lower bound of its IP chi2, 
+   *  the squared geometric impact parameter over the bound of its variance
+   *  \f$ \sigma^2 \le \mathrm{tr} C_{PV} + 
+   *      ( \sqrt{ \mathrm{tr} C_{x} } + L \sqrt{ \mathrm{tr} C_{p} } / p )^2 \f$, 
+   *  is above the best IP chi2 so far, with the covariances of the vertex, 
+   *  of the position and of the momentum of the particle, and L the 
+   *  distance along the trajectory. The equal IP chi2 values go to the 
+   *  first vertex in the container, as for the relator 
+   *  @param p   (INPUT) the particle with valid end-vertex 
+   *  @param pvs (INPUT) the index of the primary vertices 
+   *  @param dc  (INPUT) the distance calculator 
+   *  @return the best primary vertex, nullptr if there is none 
+   */
+  const LHCb::VertexBase* nearestVertex 
+  ( const LHCb::Particle*      p   , 
+    const VertexIndex&         pvs , 
+    const IDistanceCalculator& dc  ) 
+  {
+    const std::size_t n = pvs.size() ;
+    if ( 0 == n ) { return nullptr ; }                                // RETURN 
+    //
+    // the trajectory: the decay vertex, the direction and the spreads 
+    const LoKi::Point3D&       sv  = p->endVertex()->position() ;
+    const LoKi::LorentzVector& mom = p->momentum() ;
+    const double pp      = mom.P () ;
+    const bool   bounded = 0 < pp && std::isfinite ( pp ) ;
+    const double ux = bounded ? mom.Px () / pp : 0 ;
+    const double uy = bounded ? mom.Py () / pp : 0 ;
+    const double uz = bounded ? mom.Pz () / pp : 0 ;
+    const Gaudi::SymMatrix3x3& cx = p->posCovMatrix () ;
+    const Gaudi::SymMatrix4x4& cp = p->momCovMatrix () ;
+    const double sx = std::sqrt ( std::max ( cx ( 0 , 0 ) + cx ( 1 , 1 ) + cx ( 2 , 2 ) , 0.0 ) ) ;
+    const double sp = bounded ? 
+      std::sqrt ( std::max ( cp ( 0 , 0 ) + cp ( 1 , 1 ) + cp ( 2 , 2 ) , 0.0 ) ) / pp : 0 ;
+    //
+    // the start: the closest in z to the trajectory at the beam line 
+    const double ut2 = ux * ux + uy * uy ;
+    const double z0  = 0 < ut2 ? 
+      sv.Z () - ( sv.X () * ux + sv.Y () * uy ) / ut2 * uz : sv.Z () ;
+    std::size_t hi = std::lower_bound ( pvs.sorted.begin () , pvs.sorted.end () , z0 ) 
+      - pvs.sorted.begin () ;
+    std::size_t lo = hi ;
+    //
+    const LHCb::VertexBase* best      = nullptr ;
+    std::size_t             bestIndex = n ;
+    double                  bestChi2  = std::numeric_limits<double>::infinity () ;
+    while ( 0 < lo || hi < n ) 
+    {
+      // the next vertex, the closer in z from both sides 
+      const bool up = hi < n && 
+        ( 0 == lo || pvs.sorted [ hi ] - z0 <= z0 - pvs.sorted [ lo - 1 ] ) ;
+      const std::size_t k = up ? pvs.order [ hi++ ] : pvs.order [ --lo ] ;
+      //
+      // the lower bound of the IP chi2 
+      if ( bounded ) 
+      {
+        const double dx = pvs.x [ k ] - sv.X () ;
+        const double dy = pvs.y [ k ] - sv.Y () ;
+        const double dz = pvs.z [ k ] - sv.Z () ;
+        const double l  = dx * ux + dy * uy + dz * uz ;
+        const double d2 = std::max ( dx * dx + dy * dy + dz * dz - l * l , 0.0 ) ;
+        const double s  = sx + std::fabs ( l ) * sp ;
+        const double v  = pvs.spread [ k ] + s * s ;
+        if ( 0 < v && d2 > bestChi2 * v ) { continue ; }            // CONTINUE 
+      }
+      //
+      double ip = 0 , chi2 = 0 ;
+      if ( !dc.distance ( p , pvs.vertices [ k ] , ip , chi2 ).isSuccess() ) { continue ; }
+      if ( chi2 < bestChi2 || ( chi2 == bestChi2 && k < bestIndex ) ) 
+      {
+        best      = pvs.vertices [ k ] ;
+        bestIndex = k    ;
+        bestChi2  = chi2 ;
+      }
+    }
+    return best ;
+  }
+  // ==========================================================================
+  /** @struct VertexScan 
+   *  Structure-of-arrays scratch storage for the scan over primary vertices.
+   *  The arrays are resized for each candidate, keeping their capacity 
+   */
+  struct VertexScan 
+  {
+    // ========================================================================
+    void resize ( const std::size_t n ) 
+    {
+      corrected . resize ( n ) ;
+      hop       . resize ( n ) ;
+    }
+    // ========================================================================
+    /// the corrected and HOP masses for each primary vertex 
+    std::vector<double> corrected , hop ;
+    // ========================================================================
+  } ;
+  // ==========================================================================
+  /// the scratch storage for the scan over primary vertices, one per thread 
+  VertexScan& vertexScan () 
+  {
+    static thread_local VertexScan s_scan ;
+    return s_scan ;
+  }
+  // ==========================================================================
+  /** @struct DiagnosticsRegistry 
+   *  The diagnostics of all functors, for the report at finalize 
+   *  @see LoKi::Particles::Diagnostics::reportAll 
+   */
+  struct DiagnosticsRegistry 
+  {
+    std::mutex                                                mutex ;
+    std::vector<std::weak_ptr<LoKi::Particles::Diagnostics> > all   ;
+  } ;
+  // ==========================================================================
+  DiagnosticsRegistry& diagnosticsRegistry () 
+  {
+    static DiagnosticsRegistry s_registry ;
+    return s_registry ;
+  }
+  // ==========================================================================
 } //                                                  end of anonymos namespace 
 // ============================================================================
+// count the problem, return true if the message is to be printed 
+// ============================================================================
+bool LoKi::Particles::Diagnostics::problem 
+( const LoKi::Particles::Diagnostics::Category c , 
+  const std::size_t                            n ) 
+{
+  m_counters [ c ].fetch_add ( n , std::memory_order_relaxed ) ;
+  //
+  // the messages are limited per event: the event and the count of its 
+  // messages are swapped together, thus no message of the new event is lost 
+  // and no count is reset twice. With several events in flight each switch 
+  // of the event starts a new count 
+  const EventContext&      ctx     = Gaudi::Hive::currentContext() ;
+  const unsigned long long event   = ctx.valid() ? ctx.evt() + 1 : 0 ;
+  const unsigned long long tag     = event << s_countBits ;
+  unsigned long long       current = m_messages.load ( std::memory_order_relaxed ) ;
+  while ( true ) 
+  {
+    const unsigned long long count = 
+      tag == ( current >> s_countBits ) << s_countBits ? current & s_countMask : 0 ;
+    if ( s_maxMessages <= count ) { return false ; }                 // RETURN 
+    if ( m_messages.compare_exchange_weak 
+         ( current , tag | ( count + 1 ) , std::memory_order_relaxed ) ) { return true ; }
+  }
+}
+// ============================================================================
+// the summary, empty if there were no problems 
+// ============================================================================
+std::string LoKi::Particles::Diagnostics::summary () const 
+{
+  static const std::array<const char*,NCategories> s_names = 
+    {{ "invalid argument" , "no end-vertex"          , "no best vertex" , 
+       "no primary vertex" , "no distance calculator" , "non-finite HOP alpha" , 
+       "best vertex from the index differs from the relator" }} ;
+  //
+  std::string result ;
+  for ( unsigned i = 0 ; i < NCategories ; ++i ) 
+  {
+    const unsigned long long n = counter ( static_cast<Category> ( i ) ) ;
+    if ( 0 == n ) { continue ; }
+    result += ( result.empty() ? "" : ", " ) ;
+    result += s_names [ i ] + std::string ( ": " ) + std::to_string ( n ) ;
+  }
+  if ( result.empty() ) { return result ; }
+  //
+  result = "Summary of " + std::to_string ( calls () ) + " calls: " + result ;
+  if ( 0 < hits () + misses () ) 
+  { 
+    result += "; memo hits: "  + std::to_string ( hits   () ) 
+      +       ", misses: "     + std::to_string ( misses () ) ; 
+  }
+  return result ;
+}
+// ============================================================================
+// switch the memo on or off 
+// ============================================================================
+void LoKi::Particles::Memo::enable ( const bool value ) 
+{ s_memo.store ( value , std::memory_order_relaxed ) ; }
+// ============================================================================
+// is the memo on?
+// ============================================================================
+bool LoKi::Particles::Memo::enabled () 
+{ return s_memo.load ( std::memory_order_relaxed ) ; }
+// ============================================================================
+// switch the association with the index on or off 
+// ============================================================================
+void LoKi::Particles::BestVertexIndex::enable ( const bool value ) 
+{ s_vertexIndex.store ( value , std::memory_order_relaxed ) ; }
+// ============================================================================
+// is the association with the index on?
+// ============================================================================
+bool LoKi::Particles::BestVertexIndex::enabled () 
+{ return s_vertexIndex.load ( std::memory_order_relaxed ) ; }
+// ============================================================================
+// switch the comparison with the relator on or off 
+// ============================================================================
+void LoKi::Particles::BestVertexIndex::verify ( const bool value ) 
+{ s_verifyIndex.store ( value , std::memory_order_relaxed ) ; }
+// ============================================================================
+// is the comparison with the relator on?
+// ============================================================================
+bool LoKi::Particles::BestVertexIndex::verifying () 
+{ return s_verifyIndex.load ( std::memory_order_relaxed ) ; }
+// ============================================================================
+// report the summary, unless it is empty or already reported 
+// ============================================================================
+bool LoKi::Particles::Diagnostics::report () 
+{
+  const std::string text = summary () ;
+  if ( text.empty() || m_reported.exchange ( true ) ) { return false ; }
+  // no virtual calls of the functor here, it may be partly destroyed; 
+  // the reporter may be gone at the end of the job 
+  const std::string message = "LoKi::Particles: " + text ;
+  if ( 0 != LoKi::ErrorReport::instance().reporter() ) 
+  { LoKi::Report::Warning ( message ) ; }
+  else { std::cerr << "WARNING " << message << std::endl ; }
+  return true ;
+}
+// ============================================================================
+// report the summaries of all existing diagnostics 
+// ============================================================================
+std::size_t LoKi::Particles::Diagnostics::reportAll () 
+{
+  std::vector<std::shared_ptr<Diagnostics> > all ;
+  {
+    DiagnosticsRegistry& r = diagnosticsRegistry () ;
+    std::lock_guard<std::mutex> guard ( r.mutex ) ;
+    for ( const std::weak_ptr<Diagnostics>& d : r.all ) 
+    { if ( std::shared_ptr<Diagnostics> p = d.lock() ) { all.push_back ( p ) ; } }
+  }
+  std::size_t n = 0 ;
+  for ( const std::shared_ptr<Diagnostics>& d : all ) { if ( d->report () ) { ++n ; } }
+  return n ;
+}
+// ============================================================================
+// register the diagnostics for reportAll 
+// ============================================================================
+void LoKi::Particles::Diagnostics::record 
+( const std::shared_ptr<LoKi::Particles::Diagnostics>& diagnostics ) 
+{
+  DiagnosticsRegistry& r = diagnosticsRegistry () ;
+  std::lock_guard<std::mutex> guard ( r.mutex ) ;
+  // forget the destroyed functors before the storage grows 
+  if ( r.all.size() == r.all.capacity() ) 
+  {
+    r.all.erase ( std::remove_if ( r.all.begin() , r.all.end() , 
+                                   [] ( const std::weak_ptr<Diagnostics>& d ) 
+                                   { return d.expired() ; } ) , r.all.end() ) ;
+  }
+  r.all.push_back ( diagnostics ) ;
+}
+// ============================================================================
+// constructor: register the diagnostics for the report at finalize 
+// ============================================================================
+LoKi::Particles::DiagnosticsHolder::DiagnosticsHolder () 
+{ LoKi::Particles::Diagnostics::record ( m_diagnostics ) ; }
+// ============================================================================
+// destructor: report the summary when the last clone goes away 
+// ============================================================================
+LoKi::Particles::DiagnosticsHolder::~DiagnosticsHolder() 
+{
+  if ( !m_diagnostics || 1 != m_diagnostics.use_count() ) { return ; }
+  m_diagnostics->report () ;
+}
+// ============================================================================
+// load the desktop, unless it is already loaded 
+// ============================================================================
+void LoKi::Particles::DesktopHolder::loadDesktopOnce () const 
+{
+  std::call_once ( m_once.flag , [this] () 
+                   { if ( !validDesktop() ) { loadDesktop() ; } } ) ;
+}
+// ============================================================================
 /*  constructor from the primary vertex
  *  @param x the x-position of primary vertex 
  *  @param y the x-position of primary vertex 
@@ -88,25 +1209,43 @@ LoKi::Particles::PtFlight::result_type
 LoKi::Particles::PtFlight::operator() 
   ( LoKi::Particles::PtFlight::argument p ) const 
 {
+  countCalls () ;
   if ( 0 == p ) 
   {
-    Error("Invalid argument, return 'Invalid Momentum'") ;
+    if ( diagnose ( Diagnostics::NoParticle ) ) { Error("Invalid argument, return 'Invalid Momentum'") ; }
     return LoKi::Constants::InvalidMomentum ;
   }
   // get the decay vertex:
   const LHCb::VertexBase* vx = p->endVertex() ;
   if ( 0 == vx ) 
   {
-    Error("EndVertex is invalid, return 'Invalid Momentum'") ;
+    if ( diagnose ( Diagnostics::NoEndVertex ) ) { Error("EndVertex is invalid, return 'Invalid Momentum'") ; }
     return LoKi::Constants::InvalidMomentum ;
   }
   //
   Assert ( LoKi::Vertices::VertexHolder::valid() , 
            "Vertex-Information is not valid"     ) ;
   //
-  return ptFlight ( p  -> momentum() , 
-                    vx -> position() , position () ) ;
-  
+  const LoKi::ThreeVector flight = vx -> position() - position () ;
+  return LoKi::HOP::ptDir 
+    ( p4 ( p -> momentum() ) , flight.X () , flight.Y () , flight.Z () ) ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::PtFlight::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { dir = p->endVertex()->position() - position () ; return true ; } ) ;
+  //
+  Assert ( particles.empty() || LoKi::Vertices::VertexHolder::valid() , 
+           "Vertex-Information is not valid" ) ;
+  //
+  ptKernel ( b.status.size() , b.px.data() , b.py.data() , b.pz.data() , 
+             b.dx.data() , b.dy.data() , b.dz.data() , results ) ;
+  finalize ( b , results , LoKi::Constants::InvalidMomentum , "Momentum" , *this ) ;
 }
 // ============================================================================
 //  OPTIONAL: the specific printout 
@@ -168,25 +1307,45 @@ LoKi::Particles::MCorrected::result_type
 LoKi::Particles::MCorrected::operator() 
   ( LoKi::Particles::MCorrected::argument p ) const 
 {
+  countCalls () ;
   if ( 0 == p ) 
   {
-    Error("Invalid argument, return 'Invalid Mass'") ;
+    if ( diagnose ( Diagnostics::NoParticle ) ) { Error("Invalid argument, return 'Invalid Mass'") ; }
     return LoKi::Constants::InvalidMass ;
   }
   // get the decay vertex:
   const LHCb::VertexBase* vx = p->endVertex() ;
   if ( 0 == vx ) 
   {
-    Error("EndVertex is invalid, return 'Invalid Mass'") ;
+    if ( diagnose ( Diagnostics::NoEndVertex ) ) { Error("EndVertex is invalid, return 'Invalid Mass'") ; }
     return LoKi::Constants::InvalidMass ;
   }
   //
   Assert ( LoKi::Vertices::VertexHolder::valid() , 
            "Vertex-Information is not valid"     ) ;
   //
-  return mCorrFlight ( p  -> momentum() , 
-                       vx -> position() , position () ) ;
-  
+  const LoKi::ThreeVector flight = vx -> position() - position () ;
+  return LoKi::HOP::mCorrDir 
+    ( p4 ( p -> momentum() ) , flight.X () , flight.Y () , flight.Z () ) ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::MCorrected::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { dir = p->endVertex()->position() - position () ; return true ; } ) ;
+  //
+  Assert ( particles.empty() || LoKi::Vertices::VertexHolder::valid() , 
+           "Vertex-Information is not valid" ) ;
+  //
+  ptKernel    ( b.status.size() , b.px.data() , b.py.data() , b.pz.data() , 
+                b.dx.data() , b.dy.data() , b.dz.data() , b.pt.data() ) ;
+  mCorrKernel ( b.status.size() , b.px.data() , b.py.data() , b.pz.data() , 
+                b.e.data() , b.pt.data() , results ) ;
+  finalize ( b , results , LoKi::Constants::InvalidMass , "Mass" , *this ) ;
 }
 // ============================================================================
 //  OPTIONAL: the specific printout 
@@ -222,33 +1381,84 @@ LoKi::Particles::PtFlightWithBestVertex::result_type
 LoKi::Particles::PtFlightWithBestVertex::operator() 
   ( LoKi::Particles::PtFlightWithBestVertex::argument p ) const 
 {
+  countCalls () ;
   if ( 0 == p ) 
   {
-    Error("Invalid argument, return 'Invalid Momentum'") ;
+    if ( diagnose ( Diagnostics::NoParticle ) ) { Error("Invalid argument, return 'Invalid Momentum'") ; }
     return LoKi::Constants::InvalidMomentum ;
   }
   // get the decay vertex:
   const LHCb::VertexBase* vx = p->endVertex() ;
   if ( 0 == vx ) 
   {
-    Error("EndVertex is invalid, return 'Invalid Momentum'") ;
+    if ( diagnose ( Diagnostics::NoEndVertex ) ) { Error("EndVertex is invalid, return 'Invalid Momentum'") ; }
     return LoKi::Constants::InvalidMomentum ;
   }
   //
-  const LHCb::VertexBase* pv = bestVertex ( p ) ;
+  LoKi::ThreeVector flight ;
+  const LHCb::VertexBase* pv = bestFlight ( p , flight ) ;
   if ( 0 == pv ) 
   {
-    Error("BestVertex is invalid, return 'Invalid Momentum'") ;
+    if ( diagnose ( Diagnostics::NoBestVertex ) ) { Error("BestVertex is invalid, return 'Invalid Momentum'") ; }
     return LoKi::Constants::InvalidMomentum ;
   }
   //
-  setVertex ( pv ) ;
+  return LoKi::HOP::ptDir 
+    ( p4 ( p -> momentum() ) , flight.X () , flight.Y () , flight.Z () ) ;
+}
+// ============================================================================
+// get the best primary vertex and the flight direction of the particle 
+// ============================================================================
+const LHCb::VertexBase* 
+LoKi::Particles::PtFlightWithBestVertex::bestFlight 
+( LoKi::Particles::PtFlightWithBestVertex::argument p      , 
+  LoKi::ThreeVector&                                flight ) const 
+{
+  loadDesktopOnce () ;
+  //
+  const DesktopKey key { p , p->endVertex() , p->momentum() , desktop() } ;
+  const FlightInfo* cached = flightCache().find ( key ) ;
+  memo ( 0 != cached ) ;
+  if ( cached ) 
+  {
+    flight = cached->flight ;
+    return cached->pv ;                                              // RETURN 
+  }
   //
-  Assert ( LoKi::Vertices::VertexHolder::valid() , 
-           "Vertex-Information is not valid"     ) ;
+  const LHCb::VertexBase* pv = nullptr ;
+  const IDistanceCalculator* dc = 
+    s_vertexIndex.load ( std::memory_order_relaxed ) ? desktop()->distanceCalculator() : nullptr ;
+  if ( 0 == dc ) { pv = bestVertex ( p ) ; }
+  else 
+  {
+    pv = nearestVertex ( p , VertexIndex::get ( desktop() ) , *dc ) ;
+    if ( s_verifyIndex.load ( std::memory_order_relaxed ) ) 
+    {
+      const LHCb::VertexBase* relator = bestVertex ( p ) ;
+      if ( relator != pv && diagnose ( Diagnostics::VertexMismatch ) ) 
+      { Warning ( "The best vertex from the index differs from the relator" ) ; }
+      pv = relator ;
+    }
+  }
+  if ( 0 == pv ) { return nullptr ; }                                // RETURN 
+  //
+  flight = ( p->endVertex()->position() - pv->position() ).Unit() ;
+  flightCache().insert ( key , FlightInfo { pv , flight } ) ;
+  return pv ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::PtFlightWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != bestFlight ( p , dir ) ; } ) ;
   //
-  return ptFlight ( p  -> momentum() , 
-                    vx -> position() , position () ) ;
+  ptKernel ( b.status.size() , b.px.data() , b.py.data() , b.pz.data() , 
+             b.dx.data() , b.dy.data() , b.dz.data() , results ) ;
+  finalize ( b , results , LoKi::Constants::InvalidMomentum , "Momentum" , *this ) ;
 }
 // ============================================================================
 //  OPTIONAL: the specific printout 
@@ -258,6 +1468,16 @@ LoKi::Particles::PtFlightWithBestVertex::fillStream ( std::ostream& s ) const
 { return s << "BPVPTFLIGHT" ; }
 // ============================================================================
 
+// ============================================================================
+/*  constructor 
+ *  @param fast use the single precision evaluation 
+ */
+// ============================================================================
+LoKi::Particles::MCorrectedWithBestVertex::MCorrectedWithBestVertex 
+( const bool fast ) 
+  : AuxFunBase{ std::tie ( fast ) }
+  , m_fast ( fast ) 
+{}
 // ============================================================================
 // MANDATORY: clone method ("virtual constructor")
 // ============================================================================
@@ -271,40 +1491,63 @@ LoKi::Particles::MCorrectedWithBestVertex::result_type
 LoKi::Particles::MCorrectedWithBestVertex::operator() 
   ( LoKi::Particles::MCorrectedWithBestVertex::argument p ) const 
 {
+  if ( m_fast ) { return evaluateOne ( *this , p ) ; }                // RETURN 
+  //
+  countCalls () ;
   if ( 0 == p ) 
   {
-    Error("Invalid argument, return 'Invalid Mass'") ;
+    if ( diagnose ( Diagnostics::NoParticle ) ) { Error("Invalid argument, return 'Invalid Mass'") ; }
     return LoKi::Constants::InvalidMass ;
   }
   // get the decay vertex:
   const LHCb::VertexBase* vx = p->endVertex() ;
   if ( 0 == vx ) 
   {
-    Error("EndVertex is invalid, return 'Invalid Mass'") ;
+    if ( diagnose ( Diagnostics::NoEndVertex ) ) { Error("EndVertex is invalid, return 'Invalid Mass'") ; }
     return LoKi::Constants::InvalidMass ;
   }
   //
-  const LHCb::VertexBase* pv = bestVertex ( p ) ;
+  LoKi::ThreeVector flight ;
+  const LHCb::VertexBase* pv = bestFlight ( p , flight ) ;
   if ( 0 == pv ) 
   {
-    Error("BestVertex is invalid, return 'Invalid Mass'") ;
+    if ( diagnose ( Diagnostics::NoBestVertex ) ) { Error("BestVertex is invalid, return 'Invalid Mass'") ; }
     return LoKi::Constants::InvalidMass ;
   }
   //
-  setVertex ( pv ) ;
-  //
-  Assert ( LoKi::Vertices::VertexHolder::valid() , 
-           "Vertex-Information is not valid"     ) ;
+  return LoKi::HOP::mCorrDir 
+    ( p4 ( p -> momentum() ) , flight.X () , flight.Y () , flight.Z () ) ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::MCorrectedWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != bestFlight ( p , dir ) ; } ) ;
   //
-  return mCorrFlight ( p  -> momentum() , 
-                       vx -> position() , position () ) ;
+  if ( m_fast ) 
+  {
+    mCorrKernelFast ( b.status.size() , b.px.data() , b.py.data() , b.pz.data() , 
+                      b.e.data() , b.dx.data() , b.dy.data() , b.dz.data() , results ) ;
+  }
+  else 
+  {
+    ptKernel    ( b.status.size() , b.px.data() , b.py.data() , b.pz.data() , 
+                  b.dx.data() , b.dy.data() , b.dz.data() , b.pt.data() ) ;
+    mCorrKernel ( b.status.size() , b.px.data() , b.py.data() , b.pz.data() , 
+                  b.e.data() , b.pt.data() , results ) ;
+  }
+  finalize ( b , results , LoKi::Constants::InvalidMass , "Mass" , *this ) ;
 }
 // ============================================================================
 //  OPTIONAL: the specific printout 
 // ============================================================================
 std::ostream& 
 LoKi::Particles::MCorrectedWithBestVertex::fillStream ( std::ostream& s ) const 
-{ return s << "BPVCORRM" ; }
+{ return m_fast ? s << "BPVCORRMF" : s << "BPVCORRM" ; }
 // ============================================================================
 
 // ========== //00oo..oo00// ===============
@@ -354,110 +1597,56 @@ LoKi::Particles::BremMCorrected::result_type
 LoKi::Particles::BremMCorrected::operator()
   ( LoKi::Particles::BremMCorrected::argument p ) const
 {
+  HOPInfo info ;
+  if ( !hop ( p , info ) ) { return LoKi::Constants::InvalidMass ; }
+  return info.mass ;
+}
+// ============================================================================
+// evaluate all HOP quantities for the candidate 
+// ============================================================================
+bool LoKi::Particles::BremMCorrected::hop 
+( LoKi::Particles::BremMCorrected::argument p    , 
+  LoKi::Particles::HOPInfo&                 info ) const 
+{
+  countCalls () ;
   if ( 0 == p )
   {
-    Error("Invalid argument, return 'Invalid Mass'") ;
-    return LoKi::Constants::InvalidMass ;
+    if ( diagnose ( Diagnostics::NoParticle ) ) { Error("Invalid argument, return 'Invalid Mass'") ; }
+    return false ;
   }
   // get the decay vertex:
   const LHCb::VertexBase* vx = p->endVertex() ;
   if ( 0 == vx )
   {
-    Error("EndVertex is invalid, return 'Invalid Mass'") ;
-    return LoKi::Constants::InvalidMass ;
+    if ( diagnose ( Diagnostics::NoEndVertex ) ) { Error("EndVertex is invalid, return 'Invalid Mass'") ; }
+    return false ;
   }
   Assert ( LoKi::Vertices::VertexHolder::valid() ,
            "Vertex-Information is not valid"     ) ;
-
-  classify(p->clone());
-
-
-  LorentzVector P_h_tot, P_e_tot;
-  LorentzVector P_e_corr_tot, P_e_corr_temp;
-
-  for (const auto child : (*m_others) ) {
-    P_h_tot += (child->momentum());
-  }
-
-  for (const auto child : (*m_electron_mothers) ) {
-    P_e_tot += (child->momentum());
-  }
-
-  for (const auto child : (*m_rest_electrons) ) {
-    P_e_tot += (child->momentum());
-  }
-
-  double pt_h = ptFlight(P_h_tot, p->endVertex()->position(), position());
-  double pt_e = ptFlight(P_e_tot, p->endVertex()->position(), position());
-
-  double alpha = pt_h/pt_e;
-
-  for (const auto child : (*m_all_electrons) ) {
-    double E_e = sqrt(pow((alpha * child->momentum().X()), 2) + pow((alpha * child->momentum().Y()), 2) + pow((alpha * child->momentum().Z()), 2) + (m_e_PDG*m_e_PDG));
-    P_e_corr_temp.SetXYZT (alpha * child->momentum().X(), alpha * child->momentum().Y(), alpha * child->momentum().Z(), E_e);
-    P_e_corr_tot += P_e_corr_temp;
-  }
-
-  LorentzVector P = P_h_tot + P_e_corr_tot;
-
-  double corr_mass = P.M();
-
-  // Cleanup
-  m_rest_electrons->clear() ;
-  m_all_electrons->clear() ;
-  m_electron_mothers->clear() ;
-  m_others->clear() ;
-
-  return corr_mass ;
+  //
+  const LoKi::ThreeVector flight = ( vx->position() - position() ).Unit() ;
+  info = hopEvaluate ( p , flight , hopScratch () , *this ) ;
+  if ( !std::isfinite ( info.alpha ) ) { diagnose ( Diagnostics::BadAlpha ) ; }
+  return true ;
 }
 
-bool LoKi::Particles::BremMCorrected::classify (const LHCb::Particle *parent) const {
-
-  if (!parent->isBasicParticle()){
-    if (has_only_electrons(parent)) {
-      m_electron_mothers->emplace_back(parent->clone());
-      for (const auto &child : parent->daughtersVector()) {
-        m_all_electrons->emplace_back(child->clone());
-      }
-    }
-    else {
-      if (has_electron(parent)) {
-        for (const auto &child : parent->daughtersVector()) {
-          classify(child);
-        }
-      } else m_others->emplace_back(parent->clone());
-    }
-  }
-  else {
-    if (parent->particleID().abspid() == 11) {
-      m_all_electrons->emplace_back(parent->clone());
-      m_rest_electrons->emplace_back(parent->clone());
-    }
-    else m_others->emplace_back(parent->clone());
-  }
-  return true;
-}
-
-
-bool LoKi::Particles::BremMCorrected::has_only_electrons (const LHCb::Particle *parent) const {
-  for (const auto &child : parent->daughtersVector()) {
-    if (child->particleID().abspid() != 11) return false ;
-  }
-  return true;
-}
-
-bool LoKi::Particles::BremMCorrected::has_electron (const LHCb::Particle *parent) const {
-  for (const auto &child : parent->daughtersVector()) {
-    if (!child->isBasicParticle()) {
-      if (has_electron(child)) return true ;
-    }
-    else if (child->particleID().abspid() == 11) return true ;
-  }
-  return false ;
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::BremMCorrected::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { dir = ( p->endVertex()->position() - position () ).Unit() ; return true ; } ) ;
+  //
+  Assert ( particles.empty() || LoKi::Vertices::VertexHolder::valid() , 
+           "Vertex-Information is not valid" ) ;
+  //
+  hopBatch  ( particles , b , hopScratch () , *this ) ;
+  hopSelect ( b , results , &HOPInfo::mass , *this ) ;
+  finalize  ( b , results , LoKi::Constants::InvalidMass , "Mass" , *this ) ;
 }
-
-
-
 // ============================================================================
 //  OPTIONAL: the specific printout
 // ============================================================================
@@ -471,6 +1660,16 @@ LoKi::Particles::BremMCorrected::fillStream ( std::ostream& s ) const
 }
 // ============================================================================
 
+// ============================================================================
+/*  constructor 
+ *  @param fast use the single precision evaluation 
+ */
+// ============================================================================
+LoKi::Particles::BremMCorrectedWithBestVertex::BremMCorrectedWithBestVertex 
+( const bool fast ) 
+  : AuxFunBase{ std::tie ( fast ) }
+  , m_fast ( fast ) 
+{}
 // ============================================================================
 // MANDATORY: clone method ("virtual constructor")
 // ============================================================================
@@ -484,128 +1683,723 @@ LoKi::Particles::BremMCorrectedWithBestVertex::result_type
 LoKi::Particles::BremMCorrectedWithBestVertex::operator()
   ( LoKi::Particles::BremMCorrectedWithBestVertex::argument p ) const
 {
+  if ( m_fast ) { return evaluateOne ( *this , p ) ; }                // RETURN 
+  //
+  HOPInfo info ;
+  if ( !hop ( p , info ) ) { return LoKi::Constants::InvalidMass ; }
+  return info.mass ;
+}
+// ============================================================================
+// evaluate all HOP quantities for the candidate 
+// ============================================================================
+bool LoKi::Particles::BremMCorrectedWithBestVertex::hop 
+( LoKi::Particles::BremMCorrectedWithBestVertex::argument p     , 
+  LoKi::Particles::HOPInfo&                               info  , 
+  const bool                                              error , 
+  const char*                                             what  ) const 
+{
+  countCalls () ;
   if ( 0 == p )
   {
-    Error("Invalid argument, return 'Invalid Mass'") ;
-    return LoKi::Constants::InvalidMass ;
+    if ( diagnose ( Diagnostics::NoParticle ) ) 
+    { Error ( std::string ( "Invalid argument, return 'Invalid " ) + what + "'" ) ; }
+    return false ;
   }
   // get the decay vertex:
   const LHCb::VertexBase* vx = p->endVertex() ;
   if ( 0 == vx )
   {
-    Error("EndVertex is invalid, return 'Invalid Mass'") ;
-    return LoKi::Constants::InvalidMass ;
+    if ( diagnose ( Diagnostics::NoEndVertex ) ) 
+    { Error ( std::string ( "EndVertex is invalid, return 'Invalid " ) + what + "'" ) ; }
+    return false ;
   }
 
-  const LHCb::VertexBase* pv = bestVertex ( p ) ;
+  LoKi::ThreeVector flight ;
+  const LHCb::VertexBase* pv = bestFlight ( p , flight ) ;
   if ( 0 == pv )
   {
-    Error("BestVertex is invalid, return 'Invalid Mass'") ;
-    return LoKi::Constants::InvalidMass ;
+    if ( diagnose ( Diagnostics::NoBestVertex ) ) 
+    { Error ( std::string ( "BestVertex is invalid, return 'Invalid " ) + what + "'" ) ; }
+    return false ;
   }
+  //
+  info = hopEvaluate ( p , flight , hopScratch () , *this , error ? pv : 0 ) ;
+  if ( !std::isfinite ( info.alpha ) ) { diagnose ( Diagnostics::BadAlpha ) ; }
+  return true ;
+}
 
-  setVertex ( pv ) ;
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::BremMCorrectedWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != bestFlight ( p , dir ) ; } ) ;
+  //
+  if ( m_fast ) { hopBatchFast ( particles , b , hopScratch () , results , *this ) ; }
+  else 
+  {
+    hopBatch  ( particles , b , hopScratch () , *this ) ;
+    hopSelect ( b , results , &HOPInfo::mass , *this ) ;
+  }
+  finalize  ( b , results , LoKi::Constants::InvalidMass , "Mass" , *this ) ;
+}
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::BremMCorrectedWithBestVertex::fillStream ( std::ostream& s ) const
+{ return m_fast ? s << "BPVHOPMF" : s << "BPVHOPM" ; }
+// ============================================================================
 
-  Assert ( LoKi::Vertices::VertexHolder::valid() ,
-           "Vertex-Information is not valid"     ) ;
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::HOPAlphaWithBestVertex*
+LoKi::Particles::HOPAlphaWithBestVertex::clone() const
+{ return new LoKi::Particles::HOPAlphaWithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::HOPAlphaWithBestVertex::result_type
+LoKi::Particles::HOPAlphaWithBestVertex::operator()
+  ( LoKi::Particles::HOPAlphaWithBestVertex::argument p ) const
+{
+  HOPInfo info ;
+  if ( !hop ( p , info , false , "Ratio" ) ) { return LoKi::Constants::NegativeInfinity ; }
+  return info.alpha ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::HOPAlphaWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != bestFlight ( p , dir ) ; } ) ;
+  //
+  hopBatch  ( particles , b , hopScratch () , *this ) ;
+  hopSelect ( b , results , &HOPInfo::alpha , *this ) ;
+  finalize  ( b , results , LoKi::Constants::NegativeInfinity , "Ratio" , *this ) ;
+}
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::HOPAlphaWithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVHOPALPHA" ; }
+// ============================================================================
 
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::HOPPtEWithBestVertex*
+LoKi::Particles::HOPPtEWithBestVertex::clone() const
+{ return new LoKi::Particles::HOPPtEWithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::HOPPtEWithBestVertex::result_type
+LoKi::Particles::HOPPtEWithBestVertex::operator()
+  ( LoKi::Particles::HOPPtEWithBestVertex::argument p ) const
+{
+  HOPInfo info ;
+  if ( !hop ( p , info , false , "Pt" ) ) { return LoKi::Constants::InvalidMomentum ; }
+  return info.ptE ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::HOPPtEWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != bestFlight ( p , dir ) ; } ) ;
+  //
+  hopBatch  ( particles , b , hopScratch () , *this ) ;
+  hopSelect ( b , results , &HOPInfo::ptE , *this ) ;
+  finalize  ( b , results , LoKi::Constants::InvalidMomentum , "Pt" , *this ) ;
+}
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::HOPPtEWithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVHOPPTE" ; }
+// ============================================================================
 
-  //fill m_electrons and m_others respectively with electrons and all other particles
-  classify(p->clone());
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::HOPPtHWithBestVertex*
+LoKi::Particles::HOPPtHWithBestVertex::clone() const
+{ return new LoKi::Particles::HOPPtHWithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::HOPPtHWithBestVertex::result_type
+LoKi::Particles::HOPPtHWithBestVertex::operator()
+  ( LoKi::Particles::HOPPtHWithBestVertex::argument p ) const
+{
+  HOPInfo info ;
+  if ( !hop ( p , info , false , "Pt" ) ) { return LoKi::Constants::InvalidMomentum ; }
+  return info.ptH ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::HOPPtHWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != bestFlight ( p , dir ) ; } ) ;
+  //
+  hopBatch  ( particles , b , hopScratch () , *this ) ;
+  hopSelect ( b , results , &HOPInfo::ptH , *this ) ;
+  finalize  ( b , results , LoKi::Constants::InvalidMomentum , "Pt" , *this ) ;
+}
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::HOPPtHWithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVHOPPTH" ; }
+// ============================================================================
 
-  LorentzVector P_h_tot, P_e_tot;
-  LorentzVector P_e_corr_tot, P_e_corr_temp;
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::HOPElectronMassWithBestVertex*
+LoKi::Particles::HOPElectronMassWithBestVertex::clone() const
+{ return new LoKi::Particles::HOPElectronMassWithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::HOPElectronMassWithBestVertex::result_type
+LoKi::Particles::HOPElectronMassWithBestVertex::operator()
+  ( LoKi::Particles::HOPElectronMassWithBestVertex::argument p ) const
+{
+  HOPInfo info ;
+  if ( !hop ( p , info ) ) { return LoKi::Constants::InvalidMass ; }
+  return info.eMass ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::HOPElectronMassWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != bestFlight ( p , dir ) ; } ) ;
+  //
+  hopBatch  ( particles , b , hopScratch () , *this ) ;
+  hopSelect ( b , results , &HOPInfo::eMass , *this ) ;
+  finalize  ( b , results , LoKi::Constants::InvalidMass , "Mass" , *this ) ;
+}
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::HOPElectronMassWithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVHOPEM" ; }
+// ============================================================================
 
-  for (const auto child : (*m_others) ) {
-    P_h_tot += (child->momentum());
-  }
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::HOPQ2WithBestVertex*
+LoKi::Particles::HOPQ2WithBestVertex::clone() const
+{ return new LoKi::Particles::HOPQ2WithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::HOPQ2WithBestVertex::result_type
+LoKi::Particles::HOPQ2WithBestVertex::operator()
+  ( LoKi::Particles::HOPQ2WithBestVertex::argument p ) const
+{
+  HOPInfo info ;
+  if ( !hop ( p , info ) ) { return LoKi::Constants::InvalidMass ; }
+  return info.q2 ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::HOPQ2WithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != bestFlight ( p , dir ) ; } ) ;
+  //
+  hopBatch  ( particles , b , hopScratch () , *this ) ;
+  hopSelect ( b , results , &HOPInfo::q2 , *this ) ;
+  finalize  ( b , results , LoKi::Constants::InvalidMass , "Mass" , *this ) ;
+}
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::HOPQ2WithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVHOPQ2" ; }
+// ============================================================================
 
-  for (const auto child : (*m_electron_mothers) ) {
-    P_e_tot += (child->momentum());
-  }
 
-  for (const auto child : (*m_rest_electrons) ) {
-    P_e_tot += (child->momentum());
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::MCorrectedErrorWithBestVertex*
+LoKi::Particles::MCorrectedErrorWithBestVertex::clone() const
+{ return new LoKi::Particles::MCorrectedErrorWithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::MCorrectedErrorWithBestVertex::result_type
+LoKi::Particles::MCorrectedErrorWithBestVertex::operator()
+  ( LoKi::Particles::MCorrectedErrorWithBestVertex::argument p ) const
+{
+  countCalls () ;
+  if ( 0 == p )
+  {
+    if ( diagnose ( Diagnostics::NoParticle ) ) { Error("Invalid argument, return 'Invalid Mass'") ; }
+    return LoKi::Constants::InvalidMass ;
   }
-
-  double pt_h = ptFlight(P_h_tot, p->endVertex()->position(), position());
-  double pt_e = ptFlight(P_e_tot, p->endVertex()->position(), position());
-
-  double alpha = pt_h/pt_e;
-
-  for (const auto child : (*m_all_electrons) ) {
-    double E_e = sqrt(pow((alpha * child->momentum().X()), 2) + pow((alpha * child->momentum().Y()), 2) + pow((alpha * child->momentum().Z()), 2) + (m_e_PDG*m_e_PDG));
-    P_e_corr_temp.SetXYZT (alpha * child->momentum().X(), alpha * child->momentum().Y(), alpha * child->momentum().Z(), E_e);
-    P_e_corr_tot += P_e_corr_temp;
+  // get the decay vertex:
+  const LHCb::VertexBase* vx = p->endVertex() ;
+  if ( 0 == vx )
+  {
+    if ( diagnose ( Diagnostics::NoEndVertex ) ) { Error("EndVertex is invalid, return 'Invalid Mass'") ; }
+    return LoKi::Constants::InvalidMass ;
   }
-
-  LorentzVector P = P_h_tot + P_e_corr_tot;
-
-  double corr_mass = P.M();
-
-  // Cleanup
-  m_rest_electrons->clear() ;
-  m_all_electrons->clear() ;
-  m_electron_mothers->clear() ;
-  m_others->clear() ;
-
-  return corr_mass ;
+  //
+  LoKi::ThreeVector flight ;
+  const LHCb::VertexBase* pv = bestFlight ( p , flight ) ;
+  if ( 0 == pv )
+  {
+    if ( diagnose ( Diagnostics::NoBestVertex ) ) { Error("BestVertex is invalid, return 'Invalid Mass'") ; }
+    return LoKi::Constants::InvalidMass ;
+  }
+  //
+  const LoKi::ThreeVector d = vx->position() - pv->position() ;
+  const double error = LoKi::HOP::mCorrError 
+    ( p4 ( p -> momentum() ) , d.X () , d.Y () , d.Z () , 
+      p -> momCovMatrix    () , p -> posCovMatrix () , 
+      pv-> covMatrix       () , p -> posMomCovMatrix () ) ;
+  return std::isnan ( error ) ? LoKi::Constants::InvalidMass : error ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::MCorrectedErrorWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  for ( std::size_t i = 0 ; i < particles.size() ; ++i ) 
+  { results [ i ] = (*this) ( particles [ i ] ) ; }
 }
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::MCorrectedErrorWithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVCORRMERR" ; }
+// ============================================================================
 
-bool LoKi::Particles::BremMCorrectedWithBestVertex::classify (const LHCb::Particle *parent) const {
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::HOPMassErrorWithBestVertex*
+LoKi::Particles::HOPMassErrorWithBestVertex::clone() const
+{ return new LoKi::Particles::HOPMassErrorWithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::HOPMassErrorWithBestVertex::result_type
+LoKi::Particles::HOPMassErrorWithBestVertex::operator()
+  ( LoKi::Particles::HOPMassErrorWithBestVertex::argument p ) const
+{
+  HOPInfo info ;
+  if ( !hop ( p , info , true ) || std::isnan ( info.massErr ) ) 
+  { return LoKi::Constants::InvalidMass ; }
+  return info.massErr ;
+}
+// ============================================================================
+// OPTIONAL: evaluate the functor for all particles at once 
+// ============================================================================
+void LoKi::Particles::HOPMassErrorWithBestVertex::evaluate 
+( const LHCb::Particle::Range& particles , double* results ) const 
+{
+  for ( std::size_t i = 0 ; i < particles.size() ; ++i ) 
+  { results [ i ] = (*this) ( particles [ i ] ) ; }
+}
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::HOPMassErrorWithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVHOPMERR" ; }
+// ============================================================================
 
-  if (!parent->isBasicParticle()){
-    if (has_only_electrons(parent)) {
-      m_electron_mothers->emplace_back(parent->clone());
-      for (const auto &child : parent->daughtersVector()) {
-        m_all_electrons->emplace_back(child->clone());
-      }
+// ============================================================================
+/*  constructor 
+ *  @param mass      the mass: "CORRM" or "HOPM"
+ *  @param reduction the reduction: "MIN", "MAX" or "BESTIPCHI2"
+ *  @param index     return the index of the selected primary vertex 
+ */
+// ============================================================================
+LoKi::Particles::MassVertexScan::MassVertexScan 
+( const std::string& mass      , 
+  const std::string& reduction , 
+  const bool         index     ) 
+  : AuxFunBase{ std::tie ( mass , reduction , index ) }
+  , m_massName      ( mass      ) 
+  , m_reductionName ( reduction ) 
+  , m_mass          ( CorrectedMass ) 
+  , m_reduction     ( Minimum       ) 
+  , m_index         ( index     ) 
+{
+  if      ( "CORRM"      == mass      ) { m_mass      = CorrectedMass ; }
+  else if ( "HOPM"       == mass      ) { m_mass      = HOPMass       ; }
+  else { Exception ( "Unknown mass '"      + mass      + "'" ) ; }
+  //
+  if      ( "MIN"        == reduction ) { m_reduction = Minimum       ; }
+  else if ( "MAX"        == reduction ) { m_reduction = Maximum       ; }
+  else if ( "BESTIPCHI2" == reduction ) { m_reduction = BestIPChi2    ; }
+  else { Exception ( "Unknown reduction '" + reduction + "'" ) ; }
+}
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::MassVertexScan*
+LoKi::Particles::MassVertexScan::clone() const
+{ return new LoKi::Particles::MassVertexScan ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::MassVertexScan::result_type
+LoKi::Particles::MassVertexScan::operator()
+  ( LoKi::Particles::MassVertexScan::argument p ) const
+{
+  Result result ;
+  if ( !scan ( p , result ) ) 
+  { return m_index ? -1 : LoKi::Constants::InvalidMass ; }
+  return m_index ? result.index : result.value ;
+}
+// ============================================================================
+// scan all primary vertices 
+// ============================================================================
+bool LoKi::Particles::MassVertexScan::scan 
+( LoKi::Particles::MassVertexScan::argument p      , 
+  LoKi::Particles::MassVertexScan::Result&  result ) const 
+{
+  result = Result { LoKi::Constants::InvalidMass , -1 } ;
+  countCalls () ;
+  if ( 0 == p )
+  {
+    if ( diagnose ( Diagnostics::NoParticle ) ) { Error("Invalid argument, return 'Invalid Mass'") ; }
+    return false ;
+  }
+  // get the decay vertex:
+  const LHCb::VertexBase* vx = p->endVertex() ;
+  if ( 0 == vx )
+  {
+    if ( diagnose ( Diagnostics::NoEndVertex ) ) { Error("EndVertex is invalid, return 'Invalid Mass'") ; }
+    return false ;
+  }
+  //
+  loadDesktopOnce () ;
+  const VertexIndex& pvs = VertexIndex::get ( desktop() ) ;
+  if ( 0 == pvs.size() ) 
+  {
+    if ( diagnose ( Diagnostics::NoPrimaryVertex ) ) { Error("No primary vertices, return 'Invalid Mass'") ; }
+    return false ;
+  }
+  //
+  // the vertex-independent part: one walk over the decay tree 
+  HOPScratch& scratch = hopScratch () ;
+  LoKi::HOP::P4 P_h , P_e ;
+  if ( HOPMass == m_mass ) 
+  {
+    EventAnnotations annotations ;
+    EventPartials    partials    ;
+    LoKi::HOP::walk ( p , scratch , hopPlans () , annotations , partials , P_h , P_e ) ;
+  }
+  else { scratch.leptons.clear () ; }
+  //
+  // the vertex-dependent part 
+  const std::size_t n = pvs.size() ;
+  VertexScan& v = vertexScan () ;
+  v.resize ( n ) ;
+  const LoKi::Point3D& sv = vx->position() ;
+  LoKi::HOP::scan 
+    ( scratch , p4 ( p->momentum() ) , P_h , P_e , sv.X () , sv.Y () , sv.Z () , 
+      n , pvs.x.data() , pvs.y.data() , pvs.z.data() , v.corrected.data() , v.hop.data() ) ;
+  const std::vector<double>& values = CorrectedMass == m_mass ? v.corrected : v.hop ;
+  //
+  // the reduction 
+  if ( BestIPChi2 == m_reduction ) 
+  {
+    const IDistanceCalculator* dc = desktop()->distanceCalculator() ;
+    if ( 0 == dc ) 
+    {
+      if ( diagnose ( Diagnostics::NoTool ) ) { Error("Distance calculator is invalid, return 'Invalid Mass'") ; }
+      return false ;
     }
-    else {
-      if (has_electron(parent)) {
-        for (const auto &child : parent->daughtersVector()) {
-          classify(child);
-        }
-      } else m_others->emplace_back(parent->clone());
+    double best = std::numeric_limits<double>::max() ;
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    {
+      double ip = 0 , chi2 = 0 ;
+      if ( !dc->distance ( p , pvs.vertices [ i ] , ip , chi2 ).isSuccess() ) { continue ; }
+      if ( chi2 < best ) { best = chi2 ; result.index = static_cast<std::ptrdiff_t> ( i ) ; }
     }
   }
-  else {
-    if (parent->particleID().abspid() == 11) {
-      m_all_electrons->emplace_back(parent->clone());
-      m_rest_electrons->emplace_back(parent->clone());
+  else 
+  {
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    {
+      if ( std::isnan ( values [ i ] ) ) { continue ; }
+      if ( -1 == result.index || 
+           ( Minimum == m_reduction ? values [ i ] < values [ result.index ] 
+             :                        values [ i ] > values [ result.index ] ) ) 
+      { result.index = static_cast<std::ptrdiff_t> ( i ) ; }
     }
-    else m_others->emplace_back(parent->clone());
   }
-  return true;
-}
-
-
-
-bool LoKi::Particles::BremMCorrectedWithBestVertex::has_only_electrons (const LHCb::Particle *parent) const {
-  for (const auto &child : parent->daughtersVector()) {
-    if (child->particleID().abspid() != 11) return false ;
+  if ( -1 == result.index ) 
+  {
+    if ( diagnose ( Diagnostics::NoPrimaryVertex ) ) { Error("No valid primary vertex, return 'Invalid Mass'") ; }
+    return false ;
   }
-  return true;
+  //
+  result.value = values [ result.index ] ;
+  return true ;
+}
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::MassVertexScan::fillStream ( std::ostream& s ) const
+{
+  s << "PVSCANM('" << m_massName << "','" << m_reductionName << "'" ;
+  if ( m_index ) { s << ",True" ; }
+  return s << ")" ;
 }
+// ============================================================================
 
-bool LoKi::Particles::BremMCorrectedWithBestVertex::has_electron (const LHCb::Particle *parent) const {
-  for (const auto &child : parent->daughtersVector()) {
-    if (!child->isBasicParticle()) {
-      if (has_electron(child)) return true ;
-    }
-    else if (child->particleID().abspid() == 11) return true ;
+// ============================================================================
+/*  constructor 
+ *  @param cut     the threshold 
+ *  @param greater select the candidates above the threshold?
+ */
+// ============================================================================
+LoKi::Particles::MCorrectedCutWithBestVertex::MCorrectedCutWithBestVertex 
+( const double cut , const bool greater ) 
+  : AuxFunBase{ std::tie ( cut , greater ) }
+  , m_fun     () 
+  , m_cut     ( cut     ) 
+  , m_greater ( greater ) 
+{}
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::MCorrectedCutWithBestVertex*
+LoKi::Particles::MCorrectedCutWithBestVertex::clone() const
+{ return new LoKi::Particles::MCorrectedCutWithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::MCorrectedCutWithBestVertex::result_type
+LoKi::Particles::MCorrectedCutWithBestVertex::operator()
+  ( LoKi::Particles::MCorrectedCutWithBestVertex::argument p ) const
+{
+  // invalid input: the full evaluation reports it and gives 'Invalid Mass' 
+  LoKi::ThreeVector flight ;
+  if ( 0 == p || 0 == p->endVertex() || 0 == m_fun.bestFlight ( p , flight ) ) 
+  { return decide ( m_fun ( p ) ) ; }                                // RETURN 
+  //
+  m_fun.countCalls () ;
+  const LoKi::HOP::P4 mom = p4 ( p -> momentum() ) ;
+  double lo = 0 , hi = 0 ;
+  if ( LoKi::HOP::mCorrBounds ( mom , lo , hi ) && ( m_cut < lo || hi < m_cut ) ) 
+  {
+    m_early -> fetch_add ( 1 , std::memory_order_relaxed ) ;
+    return decide ( m_cut < lo ? lo : hi ) ;                         // RETURN 
   }
-  return false ;
+  //
+  return decide 
+    ( LoKi::HOP::mCorrDir ( mom , flight.X () , flight.Y () , flight.Z () ) ) ;
 }
+// ============================================================================
+//  OPTIONAL: the specific printout
+// ============================================================================
+std::ostream&
+LoKi::Particles::MCorrectedCutWithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVCORRMCUT(" << m_cut << "," << ( m_greater ? "True" : "False" ) << ")" ; }
+// ============================================================================
 
+// ============================================================================
+/*  constructor 
+ *  @param cut     the threshold 
+ *  @param greater select the candidates above the threshold?
+ */
+// ============================================================================
+LoKi::Particles::BremMCorrectedCutWithBestVertex::BremMCorrectedCutWithBestVertex 
+( const double cut , const bool greater ) 
+  : AuxFunBase{ std::tie ( cut , greater ) }
+  , m_fun     () 
+  , m_cut     ( cut     ) 
+  , m_greater ( greater ) 
+{}
+// ============================================================================
+// MANDATORY: clone method ("virtual constructor")
+// ============================================================================
+LoKi::Particles::BremMCorrectedCutWithBestVertex*
+LoKi::Particles::BremMCorrectedCutWithBestVertex::clone() const
+{ return new LoKi::Particles::BremMCorrectedCutWithBestVertex ( *this ) ; }
+// ============================================================================
+// MANDATORY: the only one essential method
+// ============================================================================
+LoKi::Particles::BremMCorrectedCutWithBestVertex::result_type
+LoKi::Particles::BremMCorrectedCutWithBestVertex::operator()
+  ( LoKi::Particles::BremMCorrectedCutWithBestVertex::argument p ) const
+{
+  // invalid input: the full evaluation reports it and gives 'Invalid Mass' 
+  LoKi::ThreeVector flight ;
+  if ( 0 == p || 0 == p->endVertex() || 0 == m_fun.bestFlight ( p , flight ) ) 
+  { return decide ( m_fun ( p ) ) ; }                                // RETURN 
+  //
+  m_fun.countCalls () ;
+  int side = 0 ;
+  const double mass = hopMassBounded ( p , flight , hopScratch () , m_fun , m_cut , side ) ;
+  if ( 0 == side ) { return decide ( mass ) ; }                      // RETURN 
+  //
+  // the bounds are on one side of the threshold: the same decision as the mass 
+  m_early -> fetch_add ( 1 , std::memory_order_relaxed ) ;
+  return m_greater == ( 0 < side ) ;
+}
 // ============================================================================
 //  OPTIONAL: the specific printout
 // ============================================================================
 std::ostream&
-LoKi::Particles::BremMCorrectedWithBestVertex::fillStream ( std::ostream& s ) const
-{ return s << "BPVHOPM" ; }
+LoKi::Particles::BremMCorrectedCutWithBestVertex::fillStream ( std::ostream& s ) const
+{ return s << "BPVHOPMCUT(" << m_cut << "," << ( m_greater ? "True" : "False" ) << ")" ; }
 // ============================================================================
 
+// ============================================================================
+/*  constructor 
+ *  @param variables the names of the variables, as in LoKi::Cuts 
+ */
+// ============================================================================
+LoKi::Particles::BestVertexColumns::BestVertexColumns 
+( const std::vector<std::string>& variables ) 
+{
+  static const std::array<const char*,NVariables> s_names = 
+    {{ "BPVPTFLIGHT" , "BPVCORRM"  , "BPVHOPM"  , "BPVHOPALPHA" , 
+       "BPVHOPPTE"   , "BPVHOPPTH" , "BPVHOPEM" , "BPVHOPQ2"    }} ;
+  //
+  m_variables.reserve ( variables.size() ) ;
+  for ( const std::string& name : variables ) 
+  {
+    const auto found = std::find ( s_names.begin() , s_names.end() , name ) ;
+    if ( s_names.end() == found ) 
+    { m_fun.Exception ( "Unknown variable '" + name + "'" ) ; }
+    m_variables.push_back ( static_cast<Variable> ( found - s_names.begin() ) ) ;
+  }
+}
+// ============================================================================
+// evaluate all variables for all particles 
+// ============================================================================
+void LoKi::Particles::BestVertexColumns::fill 
+( const LHCb::Particle::Range& particles , 
+  double* const*               columns   ) const 
+{
+  static const std::array<double HOPInfo::*,NVariables> s_fields = 
+    {{ nullptr           , nullptr        , &HOPInfo::mass  , &HOPInfo::alpha , 
+       &HOPInfo::ptE     , &HOPInfo::ptH  , &HOPInfo::eMass , &HOPInfo::q2    }} ;
+  static const std::array<double,NVariables> s_invalid = 
+    {{ LoKi::Constants::InvalidMomentum , LoKi::Constants::InvalidMass      , 
+       LoKi::Constants::InvalidMass     , LoKi::Constants::NegativeInfinity , 
+       LoKi::Constants::InvalidMomentum , LoKi::Constants::InvalidMomentum  , 
+       LoKi::Constants::InvalidMass     , LoKi::Constants::InvalidMass      }} ;
+  //
+  if ( m_variables.empty() ) { return ; }                            // RETURN 
+  //
+  const std::size_t n = particles.size() ;
+  Batch& b = batch () ;
+  gather ( particles , b , [this] ( const LHCb::Particle* p , LoKi::ThreeVector& dir ) 
+           { return 0 != m_fun.bestFlight ( p , dir ) ; } ) ;
+  //
+  bool head = false , hop = false ;
+  for ( const Variable v : m_variables ) 
+  { ( PtFlight == v || MCorrected == v ? head : hop ) = true ; }
+  //
+  // the head: the transverse momentum and the corrected mass 
+  if ( head ) 
+  {
+    ptKernel ( n , b.px.data() , b.py.data() , b.pz.data() , 
+               b.dx.data() , b.dy.data() , b.dz.data() , b.pt.data() ) ;
+    for ( std::size_t k = 0 ; k < m_variables.size() ; ++k ) 
+    {
+      if      ( PtFlight   == m_variables [ k ] ) 
+      { std::copy ( b.pt.begin() , b.pt.begin() + n , columns [ k ] ) ; }
+      else if ( MCorrected == m_variables [ k ] ) 
+      {
+        mCorrKernel ( n , b.px.data() , b.py.data() , b.pz.data() , 
+                      b.e.data() , b.pt.data() , columns [ k ] ) ; 
+      }
+    }
+  }
+  //
+  // the HOP quantities: one walk for all of them 
+  if ( hop ) 
+  {
+    hopBatch ( particles , b , hopScratch () , m_fun ) ;
+    std::size_t bad = 0 ;
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    { if ( Valid == b.status [ i ] && !std::isfinite ( b.infos [ i ].alpha ) ) { ++bad ; } }
+    if ( 0 < bad ) { m_fun.diagnose ( Diagnostics::BadAlpha , bad ) ; }
+    //
+    for ( std::size_t k = 0 ; k < m_variables.size() ; ++k ) 
+    {
+      double HOPInfo::* field = s_fields [ m_variables [ k ] ] ;
+      if ( 0 == field ) { continue ; }
+      double* column = columns [ k ] ;
+      for ( std::size_t i = 0 ; i < n ; ++i ) 
+      { if ( Valid == b.status [ i ] ) { column [ i ] = b.infos [ i ] .* field ; } }
+    }
+  }
+  //
+  // the invalid candidates: counted and reported once for all columns 
+  finalize ( b , columns [ 0 ] , s_invalid [ m_variables [ 0 ] ] , "Value" , m_fun ) ;
+  for ( std::size_t k = 1 ; k < m_variables.size() ; ++k ) 
+  {
+    const double invalid = s_invalid [ m_variables [ k ] ] ;
+    double*      column  = columns [ k ] ;
+    for ( std::size_t i = 0 ; i < n ; ++i ) 
+    { if ( Valid != b.status [ i ] ) { column [ i ] = invalid ; } }
+  }
+}
+// ============================================================================
+// evaluate all variables for all particles 
+// ============================================================================
+void LoKi::Particles::BestVertexColumns::fill 
+( const LHCb::Particle::Range&       particles , 
+  std::vector<std::vector<double> >& columns   ) const 
+{
+  columns.resize ( m_variables.size() ) ;
+  std::vector<double*> buffers ;
+  buffers.reserve ( columns.size() ) ;
+  for ( std::vector<double>& c : columns ) 
+  {
+    c.resize ( particles.size() ) ;
+    buffers.push_back ( c.data() ) ;
+  }
+  fill ( particles , buffers.data() ) ;
+}
+// ============================================================================
 
 // ============================================================================
 // The END
@@ -0,0 +1,68 @@
+// ============================================================================
+#ifndef LOKI_HOPALLOCATIONS_H
+#define LOKI_HOPALLOCATIONS_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+// ============================================================================
+/** @file HOPAllocations.h
+ *
+ *  The replaced global <code>operator new</code> and <code>operator
+ *  delete</code> that count the allocations of the whole program, for
+ *  the standalone tests and the benchmark.
+ *
+ *  The replacement functions are defined here: include the file in
+ *  one translation unit of the program only
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace HOP
+  {
+    // ========================================================================
+    namespace Tests
+    {
+      // ======================================================================
+      /// the number of allocations since the start of the program
+      inline std::atomic<unsigned long long>& allocations ()
+      {
+        static std::atomic<unsigned long long> s_allocations { 0 } ;
+        return s_allocations ;
+      }
+      // ======================================================================
+    } //                                       end of namespace LoKi::HOP::Tests
+    // ========================================================================
+  } //                                               end of namespace LoKi::HOP
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+/// not inlined: the compiler would see free() applied to the result of new
+#if defined ( __GNUC__ )
+#define LOKI_HOPALLOCATIONS_NOINLINE __attribute__ (( noinline ))
+#else
+#define LOKI_HOPALLOCATIONS_NOINLINE
+#endif
+// ============================================================================
+LOKI_HOPALLOCATIONS_NOINLINE void* operator new ( std::size_t size )
+{
+  LoKi::HOP::Tests::allocations ().fetch_add ( 1 , std::memory_order_relaxed ) ;
+  if ( void* p = std::malloc ( 0 < size ? size : 1 ) ) { return p ; }
+  throw std::bad_alloc () ;
+}
+void* operator new [] ( std::size_t size ) { return ::operator new ( size ) ; }
+LOKI_HOPALLOCATIONS_NOINLINE void operator delete ( void* p ) noexcept { std::free ( p ) ; }
+void operator delete [] ( void* p ) noexcept { ::operator delete ( p ) ; }
+void operator delete    ( void* p , std::size_t ) noexcept { ::operator delete ( p ) ; }
+void operator delete [] ( void* p , std::size_t ) noexcept { ::operator delete ( p ) ; }
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOPALLOCATIONS_H
+// ============================================================================
@@ -0,0 +1,479 @@
+// ============================================================================
+#ifndef LOKI_HOPTESTTREES_H
+#define LOKI_HOPTESTTREES_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/HOP.h"
+#include "LoKi/HOPColumns.h"
+// ============================================================================
+/** @file HOPTestTrees.h
+ *
+ *  Helpers for the standalone tests and the benchmark of the
+ *  framework-independent HOP core, LoKi/HOP.h:
+ *   - the plain decay-tree node and its LoKi::HOP::NodeTraits
+ *   - the typical B-decay topologies, deep chains and random trees
+ *   - the flattening of the trees into the columns of LoKi/HOPColumns.h
+ *   - the baseline recursive algorithm of HOPM, CORRM and PTFLIGHT,
+ *     as it was before the single-pass walk, as the reference
+ *
+ *  The tests need only a C++17 compiler and the Boost headers, e.g.
+ *  from the directory of the package:
+ *  @code
+ *   g++ -std=c++17 -O2 -I. -Itests tests/test_hop_reference.cpp -o test_hop_reference
+ *   ./test_hop_reference
+ *  @endcode
+ *  Each test returns non-zero on failure.
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace HOP
+  {
+    // ========================================================================
+    namespace Tests
+    {
+      // ======================================================================
+      /** @struct Node
+       *  The plain decay-tree node
+       */
+      struct Node
+      {
+        // ====================================================================
+        /// the 4-momentum
+        P4                       momentum  ;
+        /// the particle identifier
+        int                      pid = 0   ;
+        /// the daughters, none for basic particles
+        std::vector<const Node*> daughters ;
+        // ====================================================================
+      } ;
+      // ======================================================================
+    } //                                     end of namespace LoKi::HOP::Tests
+    // ========================================================================
+    template <>
+    struct NodeTraits<Tests::Node>
+    {
+      // ======================================================================
+      static P4 momentum ( const Tests::Node& n ) { return n.momentum ; }
+      static unsigned abspid ( const Tests::Node& n ) { return std::abs ( n.pid ) ; }
+      static bool isBasic ( const Tests::Node& n ) { return n.daughters.empty () ; }
+      static std::size_t nDaughters ( const Tests::Node& n ) { return n.daughters.size () ; }
+      static const Tests::Node* daughter ( const Tests::Node& n , const std::size_t i )
+      { return n.daughters [ i ] ; }
+      // ======================================================================
+    } ;
+    // ========================================================================
+    namespace Tests
+    {
+      // ======================================================================
+      /// the mass of the final-state particle
+      inline double mass ( const int pid )
+      {
+        switch ( std::abs ( pid ) )
+        {
+        case  11 : return   0.510998910 ;
+        case  13 : return 105.6583715   ;
+        case 211 : return 139.57018     ;
+        case 321 : return 493.677       ;
+        default  : return   0           ;
+        }
+      }
+      // ======================================================================
+      /** @class Forest
+       *  The owner of the decay trees and their generators
+       */
+      class Forest
+      {
+      public:
+        // ====================================================================
+        explicit Forest ( const unsigned int seed = 42 ) : m_rng ( seed ) {}
+        // ====================================================================
+        /// the uniform random number in [a,b)
+        double uniform ( const double a , const double b )
+        { return std::uniform_real_distribution<double> ( a , b ) ( m_rng ) ; }
+        /// the random integer in [0,n)
+        unsigned int integer ( const unsigned int n ) { return m_rng () % n ; }
+        /// the gaussian random number with the mean 0
+        double gauss ( const double sigma )
+        { return std::normal_distribution<double> ( 0 , sigma ) ( m_rng ) ; }
+        // ====================================================================
+        /// the final-state particle
+        const Node* basic ( const int pid , const double px , const double py , const double pz )
+        {
+          const double m = mass ( pid ) ;
+          Node* n = make () ;
+          n->pid      = pid ;
+          n->momentum = P4 { px , py , pz , std::sqrt ( px * px + py * py + pz * pz + m * m ) } ;
+          return n ;
+        }
+        /// the final-state particle with the random forward momentum
+        const Node* basic ( const int pid )
+        { return basic ( pid , uniform ( -3000 , 3000 ) , uniform ( -3000 , 3000 ) , uniform ( 5000 , 80000 ) ) ; }
+        /// the composite particle, the sum of the daughters
+        const Node* composite ( const int pid , const std::vector<const Node*>& daughters )
+        {
+          Node* n = make () ;
+          n->pid       = pid       ;
+          n->daughters = daughters ;
+          for ( const Node* d : daughters ) { n->momentum += d->momentum ; }
+          return n ;
+        }
+        // ====================================================================
+        /// B0 -> ( K*0 -> K+ pi- ) ( J/psi -> e+ e- )
+        const Node* B2KstJpsiEE ()
+        {
+          return composite ( 511 , { composite ( 313 , { basic ( 321 ) , basic ( -211 ) } ) ,
+                                     composite ( 443 , { basic ( -11 ) , basic (   11 ) } ) } ) ;
+        }
+        /// B+ -> K+ ( J/psi -> e+ e- )
+        const Node* B2KJpsiEE ()
+        { return composite ( 521 , { basic ( 321 ) , composite ( 443 , { basic ( -11 ) , basic ( 11 ) } ) } ) ; }
+        /// B+ -> K+ e+ mu-
+        const Node* B2KEMu ()
+        { return composite ( 521 , { basic ( 321 ) , basic ( -11 ) , basic ( 13 ) } ) ; }
+        /** the deep chain with n >= 2 final-state particles:
+         *  each level has one hadron and the next level,
+         *  the last level is the electron pair
+         */
+        const Node* chain ( const std::size_t n )
+        {
+          const Node* node = composite ( 443 , { basic ( -11 ) , basic ( 11 ) } ) ;
+          for ( std::size_t k = 2 ; k < n ; ++k )
+          { node = composite ( 511 , { basic ( 0 == k % 2 ? 321 : -211 ) , node } ) ; }
+          return node ;
+        }
+        /// the random topology with 2-4 daughters per level, electrons and hadrons
+        const Node* random ( const unsigned int depth )
+        {
+          std::vector<const Node*> daughters ;
+          const unsigned int n = 2 + integer ( 3 ) ;
+          for ( unsigned int i = 0 ; i < n ; ++i )
+          {
+            const unsigned int r = integer ( 6 ) ;
+            if      ( 0 < depth && r < 2 ) { daughters.push_back ( random ( depth - 1 ) ) ; }
+            else if ( r < 4 ) { daughters.push_back ( basic ( integer ( 2 ) ? 11  : -11 ) ) ; }
+            else              { daughters.push_back ( basic ( integer ( 2 ) ? 211 : 321 ) ) ; }
+          }
+          return composite ( 0 < depth ? 511 : 443 , daughters ) ;
+        }
+        // ====================================================================
+        /// 2 pi
+        static constexpr double s_twoPi = 6.283185307179586 ;
+        /// the kinds of the B0 -> K*0 e+ e- candidates with the kinematics
+        enum Kind { Signal = 0 , PartReco = 1 , Combinatorial = 2 } ;
+        /** the B0 -> ( K*0 -> K+ pi- ) ( J/psi -> e+ e- ) candidate with
+         *  the kinematics of the LHCb acceptance: the B0 with pT of 1-10 GeV
+         *  and pz of 20-150 GeV, the electron pair with q2 of 1.1-6 GeV2,
+         *  the bremsstrahlung loss of the electrons, and the flight direction
+         *  with the resolution of 3 mrad
+         *   - Signal:        the full decay
+         *   - PartReco:      B0 -> K*0 e+ e- pi0 with the pi0 lost
+         *   - Combinatorial: random K+, pi-, e+, e- with the flight along
+         *                    their momentum, with the resolution of 30 mrad
+         *  @param kind     (INPUT)  the kind of the candidate
+         *  @param dx,dy,dz (OUTPUT) the flight direction
+         *  @return the head of the decay tree
+         */
+        const Node* B2KstEE ( const Kind kind , double& dx , double& dy , double& dz )
+        {
+          std::array<P4,4> fs ;                        // K+ pi- e+ e-
+          double sigma = 0.003 ;
+          if ( Combinatorial == kind )
+          {
+            for ( P4& p : fs )
+            {
+              p.px = gauss ( 1500 ) ; p.py = gauss ( 1500 ) ; p.pz = uniform ( 3000 , 60000 ) ;
+            }
+            sigma = 0.03 ;
+          }
+          else
+          {
+            const double phi = uniform ( 0 , s_twoPi ) , pt = uniform ( 1000 , 10000 ) ;
+            P4 B { pt * std::cos ( phi ) , pt * std::sin ( phi ) , uniform ( 20000 , 150000 ) , 0 } ;
+            B.e = std::sqrt ( B.px * B.px + B.py * B.py + B.pz * B.pz + 5279.58 * 5279.58 ) ;
+            const double mee  = std::sqrt ( uniform ( 1.1e6 , 6.e6 ) ) ;
+            const double mKst = uniform ( 795 , 995 ) ;
+            P4 X = B , pi0 , Kst , ee ;
+            if ( PartReco == kind )
+            { decay ( B , uniform ( mKst + mee , 5279.58 - 134.977 ) , 134.977 , X , pi0 ) ; }
+            decay ( X   , mKst , mee , Kst , ee ) ;
+            decay ( Kst , mass ( 321 ) , mass ( 211 ) , fs [ 0 ] , fs [ 1 ] ) ;
+            decay ( ee  , mass (  11 ) , mass (  11 ) , fs [ 2 ] , fs [ 3 ] ) ;
+            // the bremsstrahlung: the electrons lose a part of the momentum
+            for ( std::size_t i = 2 ; i < 4 ; ++i )
+            {
+              if ( uniform ( 0 , 1 ) < 0.4 ) { continue ; }
+              const double x = uniform ( 0.4 , 1 ) ;
+              fs [ i ].px *= x ; fs [ i ].py *= x ; fs [ i ].pz *= x ;
+            }
+            dx = B.px ; dy = B.py ; dz = B.pz ;
+          }
+          const Node* K  = basic (  321 , fs [ 0 ].px , fs [ 0 ].py , fs [ 0 ].pz ) ;
+          const Node* pi = basic ( -211 , fs [ 1 ].px , fs [ 1 ].py , fs [ 1 ].pz ) ;
+          const Node* ep = basic (  -11 , fs [ 2 ].px , fs [ 2 ].py , fs [ 2 ].pz ) ;
+          const Node* em = basic (   11 , fs [ 3 ].px , fs [ 3 ].py , fs [ 3 ].pz ) ;
+          const Node* head = composite ( 511 , { composite ( 313 , { K , pi } ) ,
+                                                 composite ( 443 , { ep , em } ) } ) ;
+          if ( Combinatorial == kind )
+          { dx = head->momentum.px ; dy = head->momentum.py ; dz = head->momentum.pz ; }
+          // the resolution of the flight direction
+          const double d = std::sqrt ( dx * dx + dy * dy + dz * dz ) ;
+          dx = dx / d + gauss ( sigma ) ; dy = dy / d + gauss ( sigma ) ; dz = dz / d ;
+          return head ;
+        }
+        // ====================================================================
+        /// remove all trees
+        void clear () { m_nodes.clear () ; }
+        // ====================================================================
+      private:
+        // ====================================================================
+        /// the isotropic two-body decay of the parent
+        void decay ( const P4& parent , const double m1 , const double m2 , P4& d1 , P4& d2 )
+        {
+          const double M  = std::sqrt ( parent.m2 () ) ;
+          const double q  = std::sqrt ( ( M * M - ( m1 + m2 ) * ( m1 + m2 ) ) *
+                                        ( M * M - ( m1 - m2 ) * ( m1 - m2 ) ) ) / ( 2 * M ) ;
+          const double c  = uniform ( -1 , 1 ) , s = std::sqrt ( 1 - c * c ) ;
+          const double f  = uniform ( 0 , s_twoPi ) ;
+          const double qx = q * s * std::cos ( f ) , qy = q * s * std::sin ( f ) , qz = q * c ;
+          d1 = boost ( P4 {  qx ,  qy ,  qz , std::sqrt ( q * q + m1 * m1 ) } , parent , M ) ;
+          d2 = boost ( P4 { -qx , -qy , -qz , std::sqrt ( q * q + m2 * m2 ) } , parent , M ) ;
+        }
+        /// the boost from the rest frame of the parent of the mass M
+        static P4 boost ( const P4& p , const P4& parent , const double M )
+        {
+          const double bx = parent.px / parent.e , by = parent.py / parent.e , bz = parent.pz / parent.e ;
+          const double g  = parent.e / M ;
+          const double bp = bx * p.px + by * p.py + bz * p.pz ;
+          const double k  = ( g - 1 ) * bp / ( bx * bx + by * by + bz * bz ) + g * p.e ;
+          return P4 { p.px + k * bx , p.py + k * by , p.pz + k * bz , g * ( p.e + bp ) } ;
+        }
+        // ====================================================================
+        Node* make ()
+        {
+          m_nodes.emplace_back ( new Node () ) ;
+          return m_nodes.back ().get () ;
+        }
+        // ====================================================================
+      private:
+        // ====================================================================
+        std::mt19937                       m_rng   ;
+        std::vector<std::unique_ptr<Node> > m_nodes ;
+        // ====================================================================
+      } ;
+      // ======================================================================
+      /** @class Flat
+       *  The decay trees flattened into the columns of LoKi/HOPColumns.h
+       */
+      class Flat
+      {
+      public:
+        // ====================================================================
+        /// add the candidate with its decay and primary vertices
+        void add ( const Node*  head ,
+                   const double ex , const double ey , const double ez ,
+                   const double vx , const double vy , const double vz )
+        {
+          node ( head , -1 , parent.size () ) ;
+          offsets.push_back ( parent.size () ) ;
+          endx.push_back ( ex ) ; endy.push_back ( ey ) ; endz.push_back ( ez ) ;
+          pvx .push_back ( vx ) ; pvy .push_back ( vy ) ; pvz .push_back ( vz ) ;
+        }
+        /// the views of the columns
+        Columns columns () const
+        {
+          Columns c ;
+          c.size    = offsets.size () - 1 ;
+          c.offsets = offsets.data () ;
+          c.parent  = parent.data () ; c.pid = pid.data () ;
+          c.px   = px  .data () ; c.py   = py  .data () ; c.pz   = pz  .data () ; c.e = e.data () ;
+          c.endx = endx.data () ; c.endy = endy.data () ; c.endz = endz.data () ;
+          c.pvx  = pvx .data () ; c.pvy  = pvy .data () ; c.pvz  = pvz .data () ;
+          return c ;
+        }
+        // ====================================================================
+      public:
+        // ====================================================================
+        std::vector<std::size_t> offsets { 0 } ;
+        std::vector<int>         parent , pid ;
+        std::vector<double>      px , py , pz , e ;
+        std::vector<double>      endx , endy , endz , pvx , pvy , pvz ;
+        // ====================================================================
+      private:
+        // ====================================================================
+        void node ( const Node* n , const int mother , const std::size_t head )
+        {
+          const int self = parent.size () - head ;
+          parent.push_back ( mother ) ;
+          pid   .push_back ( n->pid ) ;
+          px.push_back ( n->momentum.px ) ; py.push_back ( n->momentum.py ) ;
+          pz.push_back ( n->momentum.pz ) ; e .push_back ( n->momentum.e  ) ;
+          for ( const Node* d : n->daughters ) { node ( d , self , head ) ; }
+        }
+        // ====================================================================
+      } ;
+      // ======================================================================
+      /** The baseline recursive algorithm: the classification with
+       *  <code>has_only_electrons</code>/<code>has_electron</code> and the
+       *  sums over the classified lists, as in BremMCorrected before the
+       *  single-pass walk
+       */
+      namespace Reference
+      {
+        // ====================================================================
+        struct Classes
+        {
+          std::vector<const Node*> all , rest , mothers , others ;
+        } ;
+        // ====================================================================
+        inline bool hasOnlyElectrons ( const Node& p )
+        {
+          for ( const Node* d : p.daughters ) { if ( 11 != std::abs ( d->pid ) ) { return false ; } }
+          return true ;
+        }
+        inline bool hasElectron ( const Node& p )
+        {
+          for ( const Node* d : p.daughters )
+          {
+            if ( !d->daughters.empty () ) { if ( hasElectron ( *d ) ) { return true ; } }
+            else if ( 11 == std::abs ( d->pid ) ) { return true ; }
+          }
+          return false ;
+        }
+        inline void classify ( const Node& p , Classes& c )
+        {
+          if ( !p.daughters.empty () )
+          {
+            if ( hasOnlyElectrons ( p ) )
+            {
+              c.mothers.push_back ( &p ) ;
+              for ( const Node* d : p.daughters ) { c.all.push_back ( d ) ; }
+            }
+            else if ( hasElectron ( p ) )
+            { for ( const Node* d : p.daughters ) { classify ( *d , c ) ; } }
+            else { c.others.push_back ( &p ) ; }
+          }
+          else if ( 11 == std::abs ( p.pid ) )
+          {
+            c.all .push_back ( &p ) ;
+            c.rest.push_back ( &p ) ;
+          }
+          else { c.others.push_back ( &p ) ; }
+        }
+        // ====================================================================
+        /// the transverse momentum with respect to the flight direction
+        inline double ptFlight ( const P4& p , const double dx , const double dy , const double dz )
+        {
+          const double f  = ( p.px * dx + p.py * dy + p.pz * dz ) / ( dx * dx + dy * dy + dz * dz ) ;
+          const double tx = p.px - f * dx , ty = p.py - f * dy , tz = p.pz - f * dz ;
+          return std::sqrt ( tx * tx + ty * ty + tz * tz ) ;
+        }
+        /// the corrected mass
+        inline double mCorr ( const Node& head , const double dx , const double dy , const double dz )
+        {
+          const double pt = ptFlight ( head.momentum , dx , dy , dz ) ;
+          return std::sqrt ( head.momentum.m2 () + pt * pt ) + pt ;
+        }
+        /// the HOP mass, and the HOP ratio
+        inline double hopMass ( const Node&  head ,
+                                const double dx   , const double dy , const double dz ,
+                                double*      alpha = 0 )
+        {
+          Classes c ;
+          classify ( head , c ) ;
+          P4 P_h , P_e , P_e_corr ;
+          for ( const Node* n : c.others  ) { P_h += n->momentum ; }
+          for ( const Node* n : c.mothers ) { P_e += n->momentum ; }
+          for ( const Node* n : c.rest    ) { P_e += n->momentum ; }
+          const double a = ptFlight ( P_h , dx , dy , dz ) / ptFlight ( P_e , dx , dy , dz ) ;
+          const double m = mass ( 11 ) ;
+          for ( const Node* n : c.all )
+          {
+            const double x = a * n->momentum.px , y = a * n->momentum.py , z = a * n->momentum.pz ;
+            P_e_corr += P4 { x , y , z , std::sqrt ( x * x + y * y + z * z + m * m ) } ;
+          }
+          if ( alpha ) { *alpha = a ; }
+          return ( P_h + P_e_corr ).m () ;
+        }
+        // ====================================================================
+      } //                          end of namespace LoKi::HOP::Tests::Reference
+      // ======================================================================
+      /** @class Partials
+       *  The partial results of the sub-decays for the walk with partials,
+       *  a direct-mapped table keyed by the node, as the event cache of
+       *  the functors: a collision evicts the older partial.
+       *  The small tables evict often
+       *  @see LoKi::HOP::NoPartials
+       */
+      template <std::size_t N = 256>
+      class Partials
+      {
+      public:
+        // ====================================================================
+        const Partial<Node>* find ( const Node& node ) const
+        {
+          const Slot& slot = m_slots [ index ( node ) ] ;
+          return &node == slot.node ? &slot.partial : nullptr ;
+        }
+        void insert ( const Node& node , const Partial<Node>& partial )
+        {
+          Slot& slot = m_slots [ index ( node ) ] ;
+          slot.node    = &node   ;
+          slot.partial = partial ;
+        }
+        /// forget all partials, e.g. at the end of the event
+        void clear () { for ( Slot& slot : m_slots ) { slot.node = nullptr ; } }
+        // ====================================================================
+      private:
+        // ====================================================================
+        static std::size_t index ( const Node& node )
+        { return ( reinterpret_cast<std::uintptr_t> ( &node ) >> 4 ) % N ; }
+        // ====================================================================
+        struct Slot
+        {
+          const Node*   node    = nullptr ;
+          Partial<Node> partial {}        ;
+        } ;
+        std::array<Slot,N> m_slots ;
+        // ====================================================================
+      } ;
+      // ======================================================================
+      /** compare two values with the relative tolerance,
+       *  equal infinities and NaN values are equal, report the difference
+       */
+      inline bool close ( const char* what , const double a , const double b ,
+                          const double tolerance )
+      {
+        if ( a == b || ( std::isnan ( a ) && std::isnan ( b ) ) ) { return true ; }
+        if ( std::fabs ( a - b ) <= tolerance * std::max ( 1.0 , std::fabs ( b ) ) ) { return true ; }
+        std::printf ( "FAILED %s: %.12g != %.12g\n" , what , a , b ) ;
+        return false ;
+      }
+      // ======================================================================
+    } //                                     end of namespace LoKi::HOP::Tests
+    // ========================================================================
+  } //                                             end of namespace LoKi::HOP
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOPTESTTREES_H
+// ============================================================================
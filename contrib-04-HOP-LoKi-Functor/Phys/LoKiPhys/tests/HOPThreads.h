@@ -0,0 +1,91 @@
+// ============================================================================
+#ifndef LOKI_HOPTHREADS_H
+#define LOKI_HOPTHREADS_H 1
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+// ============================================================================
+// LoKi
+// ============================================================================
+#include "LoKi/Particles38.h"
+// ============================================================================
+/** @file HOPThreads.h
+ *
+ *  The helper of tests/test_hop_threads.py: one functor shared by many
+ *  threads, the values compared bit by bit with the serial ones.
+ *  The particles are the candidates and their composite sub-decays:
+ *  the random order of each thread evaluates the sub-decays as the heads
+ *  before, after and between the candidates that share them
+ */
+// ============================================================================
+namespace LoKi
+{
+  // ==========================================================================
+  namespace HOP
+  {
+    // ========================================================================
+    namespace Tests
+    {
+      // ======================================================================
+      /** evaluate the same functor for all candidates from many threads at
+       *  once, each thread repeatedly and in its own random order
+       *  @param fun       the shared functor, not evaluated before
+       *  @param particles the candidates and their sub-decays
+       *  @param serial    the serial values, one per particle
+       *  @param threads   the number of threads
+       *  @param repeat    the number of passes of each thread
+       *  @return the number of values that differ from the serial ones
+       */
+      inline std::size_t stress
+      ( const LoKi::BasicFunctors<const LHCb::Particle*>::Function& fun       ,
+        const LHCb::Particle::ConstVector&                          particles ,
+        const std::vector<double>&                                  serial    ,
+        const unsigned int                                          threads   ,
+        const unsigned int                                          repeat    )
+      {
+        std::atomic<std::size_t> differences { 0 } ;
+        std::vector<std::thread> pool ;
+        for ( unsigned int t = 0 ; t < threads ; ++t )
+        {
+          pool.emplace_back
+            ( [&fun,&particles,&serial,&differences,repeat,t] ()
+              {
+                std::vector<std::size_t> order ( particles.size () ) ;
+                std::iota ( order.begin () , order.end () , std::size_t ( 0 ) ) ;
+                std::mt19937 rng ( t ) ;
+                for ( unsigned int r = 0 ; r < repeat ; ++r )
+                {
+                  std::shuffle ( order.begin () , order.end () , rng ) ;
+                  for ( const std::size_t i : order )
+                  {
+                    const double value = fun ( particles [ i ] ) ;
+                    if ( 0 != std::memcmp ( &value , &serial [ i ] , sizeof ( double ) ) )
+                    { ++differences ; }
+                  }
+                }
+              } ) ;
+        }
+        for ( std::thread& t : pool ) { t.join () ; }
+        return differences ;
+      }
+      // ======================================================================
+    } //                                       end of namespace LoKi::HOP::Tests
+    // ========================================================================
+  } //                                               end of namespace LoKi::HOP
+  // ==========================================================================
+} //                                                      end of namespace LoKi
+// ============================================================================
+//                                                                      The END
+// ============================================================================
+#endif // LOKI_HOPTHREADS_H
+// ============================================================================
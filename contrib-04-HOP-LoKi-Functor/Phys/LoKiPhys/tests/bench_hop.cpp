@@ -0,0 +1,405 @@
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+// ============================================================================
+// local
+// ============================================================================
+#include "HOPTestTrees.h"
+#include "HOPAllocations.h"
+// ============================================================================
+/** @file bench_hop.cpp
+ *
+ *  The micro-benchmark of the framework-independent HOP core, LoKi/HOP.h:
+ *  the time per candidate, the allocations per candidate and the scaling
+ *  with the size of the tree for
+ *   - <code>reference</code> the baseline recursive algorithm
+ *   - <code>walk</code>      the single-pass walk, LoKi::HOP::evaluate
+ *   - <code>plans</code>     the walk with the compiled plans
+ *   - <code>columns</code>   the columnar evaluation, LoKi/HOPColumns.h
+ *  the time per candidate of PTFLIGHT, CORRM and HOPM by the scalar path
+ *  of the functors, one virtual call per candidate, and by their batch
+ *  path, the gather into the arrays and the loops over them, as
+ *  <code>evaluate(Range,double*)</code> in Particles38.cpp, with the ratio,
+ *  and the time per candidate of the cut <code>BPVHOPM > cut</code> on the
+ *  B0 -> K*0 e+ e- candidates with the kinematics, evaluated in full and
+ *  decided by the bounds, LoKi::HOP::hopMassSide, with the fraction of
+ *  the candidates decided by the bounds
+ *
+ *  In the first table each evaluation gives HOPM and CORRM; the trees are
+ *  built before the timing, the scratch storage is reused as in the functors
+ *
+ *  @code
+ *   g++ -std=c++17 -O2 -I. -Itests tests/bench_hop.cpp -o bench_hop
+ *   ./bench_hop
+ *  @endcode
+ */
+// ============================================================================
+namespace
+{
+  // ==========================================================================
+  using namespace LoKi::HOP ;
+  using namespace LoKi::HOP::Tests ;
+  // ==========================================================================
+  /// the sink of the results, against the dead-code elimination
+  volatile double s_sink = 0 ;
+  // ==========================================================================
+  /// the candidates of one topology with their flight directions
+  struct Sample
+  {
+    std::string              name   ;
+    std::size_t              size   ;    // the final-state particles
+    std::vector<const Node*> heads  ;
+    std::vector<double>      dx , dy , dz ;
+    Flat                     flat   ;
+  } ;
+  // ==========================================================================
+  /// the number of the final-state particles
+  std::size_t basics ( const Node& n )
+  {
+    if ( n.daughters.empty () ) { return 1 ; }
+    std::size_t k = 0 ;
+    for ( const Node* d : n.daughters ) { k += basics ( *d ) ; }
+    return k ;
+  }
+  // ==========================================================================
+  Sample sample ( Forest& forest , const std::string& name ,
+                  const std::function<const Node*()>& make , const std::size_t n = 4096 )
+  {
+    Sample s ;
+    s.name = name ;
+    for ( std::size_t i = 0 ; i < n ; ++i )
+    {
+      const Node* head = make () ;
+      s.heads.push_back ( head ) ;
+      const double ex = forest.uniform ( -1 , 1 ) , ey = forest.uniform ( -1 , 1 ) , ez = forest.uniform ( 5 , 50 ) ;
+      s.flat.add ( head , ex , ey , ez , 0 , 0 , 0 ) ;
+      s.dx.push_back ( ex ) ; s.dy.push_back ( ey ) ; s.dz.push_back ( ez ) ;
+    }
+    s.size = basics ( *s.heads.front () ) ;
+    return s ;
+  }
+  // ==========================================================================
+  /// the time and the allocations per candidate
+  struct Timing { double ns ; double allocations ; } ;
+  // ==========================================================================
+  /** run the pass over all candidates until at least 50 ms are spent,
+   *  after one pass to warm up the caches and the scratch storage
+   */
+  Timing measure ( const std::size_t n , const std::function<void()>& pass )
+  {
+    typedef std::chrono::steady_clock Clock ;
+    pass () ;
+    const unsigned long long a0 = allocations ().load () ;
+    const Clock::time_point  t0 = Clock::now () ;
+    std::size_t passes = 0 ;
+    double      spent  = 0 ;
+    do
+    {
+      pass () ;
+      ++passes ;
+      spent = std::chrono::duration<double,std::nano> ( Clock::now () - t0 ).count () ;
+    }
+    while ( spent < 5.e7 ) ;
+    const double calls = double ( passes ) * n ;
+    return Timing { spent / calls , ( allocations ().load () - a0 ) / calls } ;
+  }
+  // ==========================================================================
+  void run ( const Sample& s )
+  {
+    const std::size_t n = s.heads.size () ;
+    Scratch<Node>       scratch ;
+    PlanCache<Node>     plans   ;
+    NoAnnotations       annotations ;
+    ColumnScratch       cs      ;
+    std::vector<double> hopm ( n ) , corrm ( n ) ;
+    ColumnResults       r       ;
+    r.hopMass = hopm .data () ;
+    r.mCorr   = corrm.data () ;
+    const Columns       c       = s.flat.columns () ;
+    //
+    const Timing reference = measure ( n , [&] () {
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        s_sink = Reference::hopMass ( *s.heads [ i ] , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] )
+          +      Reference::mCorr   ( *s.heads [ i ] , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ) ;
+      } } ) ;
+    const Timing walk = measure ( n , [&] () {
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        s_sink = evaluate ( s.heads [ i ] , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] , scratch ).mass
+          +      mCorrDir ( s.heads [ i ]->momentum , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ) ;
+      } } ) ;
+    const Timing planned = measure ( n , [&] () {
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        s_sink = evaluate ( s.heads [ i ] , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ,
+                            scratch , plans , annotations ).mass
+          +      mCorrDir ( s.heads [ i ]->momentum , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ) ;
+      } } ) ;
+    const Timing columns = measure ( n , [&] () {
+      evaluate ( c , r , cs ) ;
+      s_sink = hopm [ n - 1 ] + corrm [ n - 1 ] ;
+    } ) ;
+    //
+    std::printf ( "%-22s %5zu | %9.1f %6.2f | %9.1f %6.2f | %9.1f %6.2f | %9.1f %6.2f\n" ,
+                  s.name.c_str () , s.size ,
+                  reference.ns , reference.allocations ,
+                  walk     .ns , walk     .allocations ,
+                  planned  .ns , planned  .allocations ,
+                  columns  .ns , columns  .allocations ) ;
+  }
+  // ==========================================================================
+  /** the scalar path of the functors: one virtual call per candidate,
+   *  as <code>operator()</code> of the LoKi functors
+   */
+  struct Scalar
+  {
+    virtual ~Scalar () = default ;
+    virtual double operator() ( std::size_t i ) const = 0 ;
+  } ;
+  // ==========================================================================
+  /** the batch path of the functors, as <code>evaluate(Range,double*)</code>
+   *  of Particles38.cpp: the momenta and the flight directions are gathered
+   *  into the contiguous arrays, the decay trees are walked candidate by
+   *  candidate, the projections and the masses are loops over the arrays
+   */
+  struct Batch
+  {
+    // ========================================================================
+    void resize ( const std::size_t n )
+    {
+      for ( std::vector<double>* a : { &px , &py , &pz , &e , &dx , &dy , &dz ,
+                                       &hx , &hy , &hz , &he , &ex , &ey , &ez ,
+                                       &pt , &ptE , &result } )
+      { a->resize ( n ) ; }
+      first.resize ( n + 1 ) ;
+      leptons.clear () ;
+    }
+    /// gather the momenta and the flight directions
+    void gather ( const Sample& s )
+    {
+      const std::size_t n = s.heads.size () ;
+      resize ( n ) ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        const P4& p = s.heads [ i ]->momentum ;
+        px [ i ] = p.px ; py [ i ] = p.py ; pz [ i ] = p.pz ; e [ i ] = p.e ;
+        dx [ i ] = s.dx [ i ] ; dy [ i ] = s.dy [ i ] ; dz [ i ] = s.dz [ i ] ;
+      }
+    }
+    /// the transverse momenta, the kernel of PTFLIGHT
+    static void ptKernel
+    ( const std::size_t n , const double* __restrict__ x , const double* __restrict__ y ,
+      const double* __restrict__ z , const double* __restrict__ ux ,
+      const double* __restrict__ uy , const double* __restrict__ uz , double* __restrict__ out )
+    {
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      { out [ i ] = ptDir ( x [ i ] , y [ i ] , z [ i ] , ux [ i ] , uy [ i ] , uz [ i ] ) ; }
+    }
+    /// the corrected masses, the kernel of CORRM
+    void mCorrKernel ( const std::size_t n )
+    {
+      const double* __restrict__ x = px.data () ;
+      const double* __restrict__ y = py.data () ;
+      const double* __restrict__ z = pz.data () ;
+      const double* __restrict__ t = e .data () ;
+      const double* __restrict__ q = pt.data () ;
+      double*       __restrict__ m = result.data () ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      { m [ i ] = mCorr ( t [ i ] * t [ i ] - ( x [ i ] * x [ i ] + y [ i ] * y [ i ] + z [ i ] * z [ i ] ) , q [ i ] ) ; }
+    }
+    // ========================================================================
+    std::vector<double>      px , py , pz , e , dx , dy , dz ;
+    std::vector<double>      hx , hy , hz , he , ex , ey , ez ;
+    std::vector<double>      pt , ptE , result ;
+    std::vector<P4>          leptons ;
+    std::vector<std::size_t> first   ;
+    // ========================================================================
+  } ;
+  // ==========================================================================
+  /** the batch evaluation against the scalar one for PTFLIGHT, CORRM and
+   *  HOPM, with the walk with the plans for HOPM in both paths
+   */
+  void batch ( const Sample& s )
+  {
+    const std::size_t n = s.heads.size () ;
+    Scratch<Node>     scratch ;
+    PlanCache<Node>   plans   ;
+    NoAnnotations     annotations ;
+    Batch             b ;
+    //
+    struct PtFlight : Scalar
+    {
+      const Sample& s ;
+      explicit PtFlight ( const Sample& sample ) : s ( sample ) {}
+      double operator() ( std::size_t i ) const override
+      { return ptDir ( s.heads [ i ]->momentum , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ) ; }
+    } ;
+    struct MCorrected : Scalar
+    {
+      const Sample& s ;
+      explicit MCorrected ( const Sample& sample ) : s ( sample ) {}
+      double operator() ( std::size_t i ) const override
+      { return mCorrDir ( s.heads [ i ]->momentum , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ) ; }
+    } ;
+    struct HOPMass : Scalar
+    {
+      const Sample&    s ;
+      Scratch<Node>&   scratch ;
+      PlanCache<Node>& plans ;
+      NoAnnotations&   annotations ;
+      HOPMass ( const Sample& sample , Scratch<Node>& sc , PlanCache<Node>& pl , NoAnnotations& an )
+        : s ( sample ) , scratch ( sc ) , plans ( pl ) , annotations ( an ) {}
+      double operator() ( std::size_t i ) const override
+      { return evaluate ( s.heads [ i ] , s.dx [ i ] , s.dy [ i ] , s.dz [ i ] ,
+                          scratch , plans , annotations ).mass ; }
+    } ;
+    const PtFlight   ptflight ( s ) ;
+    const MCorrected corrm    ( s ) ;
+    const HOPMass    hopm     ( s , scratch , plans , annotations ) ;
+    //
+    // the functor is behind the opaque pointer: the calls are not inlined,
+    // as for the functors from the other library
+    auto scalar = [&] ( const Scalar& fun ) {
+      const Scalar* volatile f = &fun ;
+      return measure ( n , [&] () {
+        for ( std::size_t i = 0 ; i < n ; ++i ) { s_sink = ( *f ) ( i ) ; } } ) ; } ;
+    //
+    const Timing ptScalar  = scalar ( ptflight ) ;
+    const Timing ptBatch   = measure ( n , [&] () {
+      b.gather ( s ) ;
+      Batch::ptKernel ( n , b.px.data () , b.py.data () , b.pz.data () ,
+                        b.dx.data () , b.dy.data () , b.dz.data () , b.result.data () ) ;
+      s_sink = b.result [ n - 1 ] ; } ) ;
+    const Timing mScalar   = scalar ( corrm ) ;
+    const Timing mBatch    = measure ( n , [&] () {
+      b.gather ( s ) ;
+      Batch::ptKernel ( n , b.px.data () , b.py.data () , b.pz.data () ,
+                        b.dx.data () , b.dy.data () , b.dz.data () , b.pt.data () ) ;
+      b.mCorrKernel ( n ) ;
+      s_sink = b.result [ n - 1 ] ; } ) ;
+    const Timing hopScalar = scalar ( hopm ) ;
+    const Timing hopBatch  = measure ( n , [&] () {
+      b.gather ( s ) ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        P4 P_h , P_e ;
+        walk ( s.heads [ i ] , scratch , plans , annotations , P_h , P_e ) ;
+        b.first [ i ] = b.leptons.size () ;
+        b.hx [ i ] = P_h.px ; b.hy [ i ] = P_h.py ; b.hz [ i ] = P_h.pz ; b.he [ i ] = P_h.e ;
+        b.ex [ i ] = P_e.px ; b.ey [ i ] = P_e.py ; b.ez [ i ] = P_e.pz ;
+        b.leptons.insert ( b.leptons.end () , scratch.leptons.begin () , scratch.leptons.end () ) ;
+      }
+      b.first [ n ] = b.leptons.size () ;
+      Batch::ptKernel ( n , b.hx.data () , b.hy.data () , b.hz.data () ,
+                        b.dx.data () , b.dy.data () , b.dz.data () , b.pt .data () ) ;
+      Batch::ptKernel ( n , b.ex.data () , b.ey.data () , b.ez.data () ,
+                        b.dx.data () , b.dy.data () , b.dz.data () , b.ptE.data () ) ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        Info info ;
+        info.ptH = b.pt  [ i ] ;
+        info.ptE = b.ptE [ i ] ;
+        correct ( b.leptons.begin () + b.first [ i ] , b.leptons.begin () + b.first [ i + 1 ] ,
+                  P4 { b.hx [ i ] , b.hy [ i ] , b.hz [ i ] , b.he [ i ] } , info ) ;
+        b.result [ i ] = info.mass ;
+      }
+      s_sink = b.result [ n - 1 ] ; } ) ;
+    //
+    std::printf ( "%-22s | %7.1f %7.1f %5.1fx | %7.1f %7.1f %5.1fx | %7.1f %7.1f %5.1fx\n" ,
+                  s.name.c_str () ,
+                  ptScalar .ns , ptBatch .ns , ptScalar .ns / ptBatch .ns ,
+                  mScalar  .ns , mBatch  .ns , mScalar  .ns / mBatch  .ns ,
+                  hopScalar.ns , hopBatch.ns , hopScalar.ns / hopBatch.ns ) ;
+  }
+  // ==========================================================================
+  /** the cut <code>BPVHOPM > cut</code> on the B0 -> K*0 e+ e- candidates
+   *  with the kinematics, evaluated in full and decided by the bounds
+   *  (BPVHOPMCUT), with the walk with the plans for both
+   */
+  void cut ( Forest& forest , const Forest::Kind kind , const char* name , const double value )
+  {
+    const std::size_t n = 4096 ;
+    std::vector<const Node*> heads ;
+    std::vector<double>      dx ( n ) , dy ( n ) , dz ( n ) ;
+    for ( std::size_t i = 0 ; i < n ; ++i )
+    { heads.push_back ( forest.B2KstEE ( kind , dx [ i ] , dy [ i ] , dz [ i ] ) ) ; }
+    //
+    Scratch<Node>   scratch ;
+    PlanCache<Node> plans   ;
+    NoAnnotations   annotations ;
+    std::size_t     decided = 0 ;
+    //
+    const Timing full = measure ( n , [&] () {
+      std::size_t passed = 0 ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        P4 P_h , P_e ;
+        walk ( heads [ i ] , scratch , plans , annotations , P_h , P_e ) ;
+        passed += value < complete ( scratch , P_h , P_e , dx [ i ] , dy [ i ] , dz [ i ] ).mass ;
+      }
+      s_sink = passed ; } ) ;
+    const Timing bounded = measure ( n , [&] () {
+      std::size_t passed = 0 ;
+      decided = 0 ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        P4 P_h , P_e ;
+        walk ( heads [ i ] , scratch , plans , annotations , P_h , P_e ) ;
+        const int side = hopMassSide ( scratch , P_h , P_e , dx [ i ] , dy [ i ] , dz [ i ] , value ) ;
+        decided += 0 != side ;
+        passed  += 0 != side ? 0 < side :
+          value < complete ( scratch , P_h , P_e , dx [ i ] , dy [ i ] , dz [ i ] ).mass ;
+      }
+      s_sink = passed ; } ) ;
+    //
+    std::printf ( "%-22s %5.0f | %9.1f | %9.1f | %8.1f%%\n" , name , value ,
+                  full.ns , bounded.ns , 100.0 * decided / n ) ;
+  }
+  // ==========================================================================
+}
+// ============================================================================
+int main ()
+{
+  Forest forest ( 7 ) ;
+  //
+  std::printf ( "%-22s %5s | %16s | %16s | %16s | %16s\n" , "" , "" ,
+                "reference" , "walk" , "plans" , "columns" ) ;
+  std::printf ( "%-22s %5s | %9s %6s | %9s %6s | %9s %6s | %9s %6s\n" , "topology" , "final" ,
+                "ns/cand" , "alloc" , "ns/cand" , "alloc" , "ns/cand" , "alloc" , "ns/cand" , "alloc" ) ;
+  //
+  run ( sample ( forest , "B0->K*0(Kpi)J/psi(ee)" , [&] () { return forest.B2KstJpsiEE () ; } ) ) ;
+  run ( sample ( forest , "B+->K+J/psi(ee)"       , [&] () { return forest.B2KJpsiEE   () ; } ) ) ;
+  run ( sample ( forest , "B+->K+emu"             , [&] () { return forest.B2KEMu      () ; } ) ) ;
+  for ( std::size_t k = 2 ; k <= 12 ; ++k )
+  {
+    run ( sample ( forest , "chain " + std::to_string ( k ) ,
+                   [&] () { return forest.chain ( k ) ; } ) ) ;
+  }
+  //
+  std::printf ( "\n%-22s | %21s | %21s | %21s\n" , "scalar/batch ns/cand" ,
+                "PTFLIGHT" , "CORRM" , "HOPM" ) ;
+  batch ( sample ( forest , "B0->K*0(Kpi)J/psi(ee)" , [&] () { return forest.B2KstJpsiEE () ; } ) ) ;
+  batch ( sample ( forest , "B+->K+J/psi(ee)"       , [&] () { return forest.B2KJpsiEE   () ; } ) ) ;
+  batch ( sample ( forest , "chain 8"               , [&] () { return forest.chain ( 8 ) ; } ) ) ;
+  //
+  std::printf ( "\n%-22s %5s | %9s | %9s | %9s\n" , "BPVHOPM > cut" , "cut" ,
+                "full" , "bounds" , "decided" ) ;
+  for ( const double value : { 4500.0 , 5000.0 } )
+  {
+    cut ( forest , Forest::Signal        , "B0->K*0ee signal"    , value ) ;
+    cut ( forest , Forest::PartReco      , "B0->K*0ee part-reco" , value ) ;
+    cut ( forest , Forest::Combinatorial , "B0->K*0ee combinat." , value ) ;
+  }
+  return 0 ;
+}
+// ============================================================================
+// The END
+// ============================================================================
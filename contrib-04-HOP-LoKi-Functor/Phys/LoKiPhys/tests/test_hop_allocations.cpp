@@ -0,0 +1,114 @@
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <cstdio>
+#include <functional>
+#include <vector>
+// ============================================================================
+// local
+// ============================================================================
+#include "HOPTestTrees.h"
+#include "HOPAllocations.h"
+// ============================================================================
+/** @file test_hop_allocations.cpp
+ *
+ *  The evaluation of the HOP quantities does not allocate: once the scratch
+ *  storage, the plans and the column buffers have grown to the largest
+ *  candidate, the next evaluations of all candidates make no allocation, for
+ *   - the single-pass walk, LoKi::HOP::evaluate, as BremMCorrected
+ *   - the walk with the bounds, LoKi::HOP::walk and LoKi::HOP::hopMassSide
+ *   - the walk with the compiled plans, as BremMCorrectedWithBestVertex
+ *   - the columnar evaluation, LoKi/HOPColumns.h
+ *
+ *  @code
+ *   g++ -std=c++17 -O2 -I. -Itests tests/test_hop_allocations.cpp -o test_hop_allocations
+ *  @endcode
+ */
+// ============================================================================
+namespace
+{
+  // ==========================================================================
+  using namespace LoKi::HOP ;
+  using namespace LoKi::HOP::Tests ;
+  // ==========================================================================
+  /// the sink of the results, against the dead-code elimination
+  volatile double s_sink = 0 ;
+  // ==========================================================================
+  /// the allocations of the pass, after one pass to warm up
+  bool check ( const char* what , const std::function<void()>& pass )
+  {
+    pass () ;
+    const unsigned long long before = allocations ().load () ;
+    pass () ;
+    const unsigned long long made   = allocations ().load () - before ;
+    std::printf ( "%-8s allocations %llu\n" , what , made ) ;
+    return 0 == made ;
+  }
+  // ==========================================================================
+}
+// ============================================================================
+int main ()
+{
+  Forest forest ( 23 ) ;
+  //
+  std::vector<const Node*> heads ;
+  std::vector<double>      dx , dy , dz ;
+  Flat                     flat ;
+  for ( unsigned int i = 0 ; i < 2000 ; ++i )
+  {
+    const Node* head = 0 ;
+    switch ( i % 5 )
+    {
+    case 0  : head = forest.B2KstJpsiEE () ; break ;
+    case 1  : head = forest.B2KJpsiEE   () ; break ;
+    case 2  : head = forest.B2KEMu      () ; break ;
+    case 3  : head = forest.chain ( 2 + i % 11 ) ; break ;
+    default : head = forest.random ( i % 3 ) ; break ;
+    }
+    const double ex = forest.uniform ( -1 , 1 ) , ey = forest.uniform ( -1 , 1 ) , ez = forest.uniform ( 5 , 50 ) ;
+    heads.push_back ( head ) ;
+    dx.push_back ( ex ) ; dy.push_back ( ey ) ; dz.push_back ( ez ) ;
+    flat.add ( head , ex , ey , ez , 0 , 0 , 0 ) ;
+  }
+  //
+  const std::size_t   n = heads.size () ;
+  Scratch<Node>       scratch ;
+  PlanCache<Node>     plans       ;
+  NoAnnotations       annotations ;
+  ColumnScratch       cs ;
+  std::vector<double> hopm ( n ) , alpha ( n ) , corrm ( n ) , pt ( n ) ;
+  ColumnResults       r ;
+  r.hopMass  = hopm .data () ;
+  r.alpha    = alpha.data () ;
+  r.mCorr    = corrm.data () ;
+  r.ptFlight = pt   .data () ;
+  const Columns       c = flat.columns () ;
+  //
+  bool ok = true ;
+  ok = check ( "walk" , [&] () {
+    for ( std::size_t i = 0 ; i < n ; ++i )
+    { s_sink = evaluate ( heads [ i ] , dx [ i ] , dy [ i ] , dz [ i ] , scratch ).mass ; } } ) && ok ;
+  ok = check ( "bound" , [&] () {
+    for ( std::size_t i = 0 ; i < n ; ++i )
+    {
+      P4 P_h , P_e ;
+      walk<Node> ( heads [ i ] , scratch , P_h , P_e ) ;
+      s_sink = 0 != hopMassSide ( scratch , P_h , P_e , dx [ i ] , dy [ i ] , dz [ i ] , 5000 ) ? 1 :
+        complete ( scratch , P_h , P_e , dx [ i ] , dy [ i ] , dz [ i ] ).mass ;
+    } } ) && ok ;
+  ok = check ( "plans" , [&] () {
+    for ( std::size_t i = 0 ; i < n ; ++i )
+    { s_sink = evaluate ( heads [ i ] , dx [ i ] , dy [ i ] , dz [ i ] ,
+                          scratch , plans , annotations ).mass ; } } ) && ok ;
+  ok = check ( "columns" , [&] () {
+    evaluate ( c , r , cs ) ;
+    s_sink = hopm [ n - 1 ] ; } ) && ok ;
+  //
+  std::printf ( ok ? "OK\n" : "FAILED\n" ) ;
+  return ok ? 0 : 1 ;
+}
+// ============================================================================
+// The END
+// ============================================================================
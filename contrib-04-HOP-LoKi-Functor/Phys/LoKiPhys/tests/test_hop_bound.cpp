@@ -0,0 +1,172 @@
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+// ============================================================================
+// local
+// ============================================================================
+#include "HOPTestTrees.h"
+// ============================================================================
+/** @file test_hop_bound.cpp
+ *
+ *  The cut with the bounds (BPVHOPMCUT) agrees with the cut on the
+ *  evaluated HOP mass (BPVHOPM > cut, BPVHOPM < cut) on both sides of
+ *  the threshold:
+ *   - the thresholds just below and just above the HOP mass and the mass
+ *     of the hadronic part of each candidate, with the degenerate
+ *     candidate with the electrons along the flight;
+ *   - the fixed thresholds of the B0 -> K*0 e+ e- selections on the
+ *     candidates with the kinematics of the LHCb acceptance, for the
+ *     signal, the partially reconstructed and the combinatorial
+ *     candidates; the fractions of the candidates decided by the bounds
+ *     of the HOP mass (and of the corrected mass, BPVCORRMCUT) are printed
+ *
+ *  @code
+ *   g++ -std=c++17 -O2 -I. -Itests tests/test_hop_bound.cpp -o test_hop_bound
+ *  @endcode
+ *
+ *  @see LoKi::HOP::hopMassSide
+ *  @see LoKi::HOP::mCorrBounds
+ */
+// ============================================================================
+namespace
+{
+  // ==========================================================================
+  using namespace LoKi::HOP ;
+  using namespace LoKi::HOP::Tests ;
+  // ==========================================================================
+  /// the decisions by the bounds
+  struct Counts
+  {
+    long checked  = 0 ;
+    long hadronic = 0 ;     // by the mass of the hadronic part
+    long above    = 0 ;     // by the lower bound from the HOP ratio
+    long below    = 0 ;     // by the upper bound from the HOP ratio
+    long corrm    = 0 ;     // the corrected mass by its bounds
+    long failed   = 0 ;
+  } ;
+  // ==========================================================================
+  /// check the decision of the bounds against the HOP mass
+  void check
+  ( const Scratch<Node>& scratch , const P4& P_h , const P4& P_e ,
+    const double dx , const double dy , const double dz ,
+    const double mass , const double cut , Counts& counts )
+  {
+    const int  side     = hopMassSide  ( scratch , P_h , P_e , dx , dy , dz , cut ) ;
+    const bool hadronic = hopMassAbove ( scratch , P_h , P_e , dx , dy , dz , cut ) ;
+    ++counts.checked ;
+    if      ( hadronic  ) { ++counts.hadronic ; }
+    else if ( 0 < side  ) { ++counts.above    ; }
+    else if ( side < 0  ) { ++counts.below    ; }
+    //
+    const bool greater = 0 < side ? true  : side < 0 ? false : mass > cut ;
+    const bool less    = 0 < side ? false : side < 0 ? true  : mass < cut ;
+    if ( greater == ( mass > cut ) && less == ( mass < cut ) ) { return ; }
+    ++counts.failed ;
+    std::printf ( "FAILED HOPM %.17g cut %.17g, side %d\n" , mass , cut , side ) ;
+  }
+  // ==========================================================================
+}
+// ============================================================================
+int main ()
+{
+  Forest        forest  ( 17 ) ;
+  Scratch<Node> scratch ;
+  bool          ok = true ;
+  //
+  // the thresholds at the values of each candidate
+  // ==========================================================================
+  std::vector<const Node*> heads ;
+  for ( unsigned int i = 0 ; i < 5000 ; ++i )
+  {
+    switch ( i % 5 )
+    {
+    case 0  : heads.push_back ( forest.B2KstJpsiEE () ) ; break ;
+    case 1  : heads.push_back ( forest.B2KJpsiEE   () ) ; break ;
+    case 2  : heads.push_back ( forest.B2KEMu      () ) ; break ;
+    case 3  : heads.push_back ( forest.chain ( 2 + i % 11 ) ) ; break ;
+    default : heads.push_back ( forest.random ( i % 3 ) ) ; break ;
+    }
+  }
+  // the electrons along the flight direction: the HOP mass is not a number
+  const Node* degenerate = forest.composite
+    ( 521 , { forest.basic ( 321 , 800 , 300 , 30000 ) ,
+              forest.composite ( 443 , { forest.basic ( -11 , 0 , 0 , 10000 ) ,
+                                         forest.basic (  11 , 0 , 0 ,  5000 ) } ) } ) ;
+  //
+  Counts own ;
+  for ( std::size_t i = 0 ; i <= heads.size () ; ++i )
+  {
+    const bool   special = heads.size () == i ;
+    const Node*  head    = special ? degenerate : heads [ i ] ;
+    const double dx = special ? 0 : forest.uniform ( -1 , 1 ) ;
+    const double dy = special ? 0 : forest.uniform ( -1 , 1 ) ;
+    const double dz = special ? 1 : forest.uniform ( 5 , 50 ) ;
+    //
+    P4 P_h , P_e ;
+    walk<Node> ( head , scratch , P_h , P_e ) ;
+    const double mass = complete ( scratch , P_h , P_e , dx , dy , dz ).mass ;
+    const double hadr = std::sqrt ( std::max ( P_h.m2 () , 0.0 ) ) ;
+    //
+    for ( const double scale : { 1 - 1.e-6 , 1 - 1.e-12 , 1.0 , 1 + 1.e-12 , 1 + 1.e-6 } )
+    {
+      for ( const double cut : { mass * scale , hadr * scale } )
+      {
+        if ( std::isnan ( cut ) ) { continue ; }
+        check ( scratch , P_h , P_e , dx , dy , dz , mass , cut , own ) ;
+      }
+    }
+  }
+  std::printf ( "own thresholds %ld: decided by the hadronic mass %ld, by the HOP ratio %ld above"
+                " and %ld below, failed %ld\n" ,
+                own.checked , own.hadronic , own.above , own.below , own.failed ) ;
+  ok = ok && 0 == own.failed && 0 < own.hadronic && 0 < own.above && 0 < own.below ;
+  //
+  // the fixed thresholds of the B0 -> K*0 e+ e- selections
+  // ==========================================================================
+  const std::array<double,4>      cuts  = {{ 4000 , 4500 , 5000 , 5500 }} ;
+  const std::array<const char*,3> names = {{ "signal" , "part-reco" , "combinatorial" }} ;
+  const unsigned int              n     = 20000 ;
+  std::printf ( "%-14s %6s %9s %9s %9s %9s %9s\n" , "B0->K*0ee" , "cut" ,
+                "hadronic" , "above" , "below" , "HOPM" , "CORRM" ) ;
+  for ( unsigned int kind = Forest::Signal ; kind <= Forest::Combinatorial ; ++kind )
+  {
+    forest.clear () ;
+    std::array<Counts,4> counts ;
+    for ( unsigned int i = 0 ; i < n ; ++i )
+    {
+      double dx = 0 , dy = 0 , dz = 0 ;
+      const Node* head = forest.B2KstEE ( static_cast<Forest::Kind> ( kind ) , dx , dy , dz ) ;
+      P4 P_h , P_e ;
+      walk<Node> ( head , scratch , P_h , P_e ) ;
+      const double mass = complete ( scratch , P_h , P_e , dx , dy , dz ).mass ;
+      double lo = 0 , hi = 0 ;
+      const bool bounds = mCorrBounds ( head->momentum , lo , hi ) ;
+      for ( std::size_t c = 0 ; c < cuts.size () ; ++c )
+      {
+        check ( scratch , P_h , P_e , dx , dy , dz , mass , cuts [ c ] , counts [ c ] ) ;
+        if ( bounds && ( cuts [ c ] < lo || hi < cuts [ c ] ) ) { ++counts [ c ].corrm ; }
+      }
+    }
+    for ( std::size_t c = 0 ; c < cuts.size () ; ++c )
+    {
+      const Counts& k = counts [ c ] ;
+      const double  f = 100.0 / k.checked ;
+      std::printf ( "%-14s %6.0f %8.1f%% %8.1f%% %8.1f%% %8.1f%% %8.1f%%\n" ,
+                    names [ kind ] , cuts [ c ] , f * k.hadronic , f * k.above , f * k.below ,
+                    f * ( k.hadronic + k.above + k.below ) , f * k.corrm ) ;
+      ok = ok && 0 == k.failed ;
+    }
+  }
+  //
+  std::printf ( ok ? "OK\n" : "FAILED\n" ) ;
+  return ok ? 0 : 1 ;
+}
+// ============================================================================
+// The END
+// ============================================================================
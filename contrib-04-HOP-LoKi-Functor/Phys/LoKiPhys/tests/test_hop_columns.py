@@ -0,0 +1,110 @@
+#!/usr/bin/env python
+# =============================================================================
+## @file test_hop_columns.py
+#  Test of LoKiPhys.columns:
+#   - the columnar PTFLIGHT, CORRM, HOPM and HOPALPHA agree with the scalar
+#     evaluation of LoKi/HOP.h on random decay trees
+#   - the arrays of other types are accepted (and copied)
+#   - inconsistent lengths and decay trees raise ValueError
+#
+#  The trees are generated by tests/HOPTestTrees.h
+# =============================================================================
+import os
+import numpy as np
+
+from LoKiCore.basic   import cpp
+from LoKiPhys.columns import evaluate
+
+cpp.gInterpreter.AddIncludePath ( os.path.dirname ( os.path.abspath ( __file__ ) ) )
+cpp.gInterpreter.Declare ( '#include "HOPTestTrees.h"' )
+
+HOP  = cpp.LoKi.HOP
+Node = 'LoKi::HOP::Tests::Node'
+
+# =============================================================================
+## the random candidates, the trees and their flattened columns
+def candidates ( n = 2000 , seed = 7 ) :
+    forest = HOP.Tests.Forest ( seed )
+    flat   = HOP.Tests.Flat   ()
+    heads  = []
+    for i in range ( n ) :
+        head = forest.random ( i % 3 )
+        heads.append ( head )
+        flat.add ( head ,
+                   forest.uniform ( -1 , 1 ) , forest.uniform ( -1 , 1 ) , forest.uniform ( 5 , 50 ) ,
+                   forest.uniform ( -0.1 , 0.1 ) , forest.uniform ( -0.1 , 0.1 ) , forest.uniform ( -1 , 1 ) )
+    return forest , flat , heads
+
+## the column as NumPy array
+def column ( v , dtype ) :
+    return np.fromiter ( v , dtype = dtype , count = v.size () )
+
+## the arguments of evaluate
+def arguments ( flat ) :
+    return ( [ column ( flat.offsets , np.uintp ) ,
+               column ( flat.parent  , np.int32 ) ,
+               column ( flat.pid     , np.int32 ) ] +
+             [ column ( getattr ( flat , a ) , np.float64 ) for a in
+               ( 'px' , 'py' , 'pz' , 'e' , 'endx' , 'endy' , 'endz' , 'pvx' , 'pvy' , 'pvz' ) ] )
+
+## compare with the relative tolerance, NaN values are equal
+def check ( what , a , b , tolerance = 1.e-9 ) :
+    ok = np.isclose ( a , b , rtol = tolerance , atol = tolerance , equal_nan = True )
+    assert ok.all () , '%s: %d differences, first at %d' % ( what , ( ~ok ).sum () , np.argmin ( ok ) )
+
+# =============================================================================
+## the columnar evaluation agrees with the scalar one
+def test_scalar () :
+    forest , flat , heads = candidates ()
+    r = evaluate ( *arguments ( flat ) )
+    #
+    scratch = HOP.Scratch [ Node ] ()
+    ref     = dict ( ( q , np.empty ( len ( heads ) ) ) for q in r )
+    for i , head in enumerate ( heads ) :
+        dx = flat.endx [ i ] - flat.pvx [ i ]
+        dy = flat.endy [ i ] - flat.pvy [ i ]
+        dz = flat.endz [ i ] - flat.pvz [ i ]
+        info = HOP.evaluate ( head , dx , dy , dz , scratch )
+        ref [ 'HOPM'     ] [ i ] = info.mass
+        ref [ 'HOPALPHA' ] [ i ] = info.alpha
+        ref [ 'PTFLIGHT' ] [ i ] = HOP.ptDir    ( head.momentum , dx , dy , dz )
+        ref [ 'CORRM'    ] [ i ] = HOP.mCorrDir ( head.momentum , dx , dy , dz )
+    for q in r : check ( q , r [ q ] , ref [ q ] )
+
+## the arrays of other types give the same results
+def test_types () :
+    forest , flat , heads = candidates ( 200 )
+    args  = arguments ( flat )
+    r     = evaluate ( *args )
+    other = [ args [ 0 ].astype ( np.int64 ) , args [ 1 ].astype ( np.int64 ) , list ( args [ 2 ] ) ] + \
+            [ np.repeat ( a , 2 ) [ : : 2 ] for a in args [ 3 : ] ]   # not contiguous
+    o     = evaluate ( *other )
+    for q in r : check ( q , o [ q ] , r [ q ] )
+
+## inconsistent lengths and decay trees raise ValueError
+def test_invalid () :
+    forest , flat , heads = candidates ( 10 )
+    def mother  ( args ) : args [ 1 ] [ 3 ] = 1000                      # beyond the tree
+    def itself  ( args ) : args [ 1 ] [ 3 ] = 3                         # the node itself
+    def head    ( args ) : args [ 1 ] [ 0 ] = 0                         # the head with the mother
+    def offsets ( args ) : args [ 0 ] [ 1 ] = args [ 0 ] [ 2 ] + 1      # decreasing offsets
+    def length  ( args ) : args [ 3 ] = args [ 3 ] [ : -1 ]             # the length of px
+    for corrupt in ( mother , itself , head , offsets , length ) :
+        args = arguments ( flat )
+        corrupt ( args )
+        try :
+            evaluate ( *args )
+        except ValueError :
+            continue
+        raise AssertionError ( 'No ValueError for %s' % corrupt.__name__ )
+
+# =============================================================================
+if '__main__' == __name__ :
+
+    for test in ( test_scalar , test_types , test_invalid ) :
+        test ()
+        print ( '%s: OK' % test.__name__ )
+
+# =============================================================================
+# The END
+# =============================================================================
@@ -0,0 +1,104 @@
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <cmath>
+#include <cstdio>
+#include <random>
+// ============================================================================
+// local
+// ============================================================================
+#include "HOPTestTrees.h"
+// ============================================================================
+/** @file test_hop_fast.cpp
+ *
+ *  The single precision evaluation (BPVCORRMF, BPVHOPMF) against the
+ *  double precision one: the relative deviations stay within the bounds
+ *  documented in LoKi/HOP.h for B+ -> K+ ( J/psi -> e+ e- ) with the
+ *  bremsstrahlung losses and momenta up to 200 GeV
+ *
+ *  @code
+ *   g++ -std=c++17 -O2 -I. -Itests tests/test_hop_fast.cpp -o test_hop_fast
+ *  @endcode
+ *
+ *  @see LoKi::HOP::hopMassFast
+ *  @see LoKi::HOP::mCorrFast
+ */
+// ============================================================================
+int main ()
+{
+  using namespace LoKi::HOP ;
+  using namespace LoKi::HOP::Tests ;
+  //
+  const double maxCorr   = 1.e-5 ; // the corrected mass
+  const double maxHOP    = 5.e-3 ; // the HOP mass
+  const double maxHOPAbove4GeV = 3.e-3 ;
+  //
+  Forest                           forest ( 16 ) ;
+  std::mt19937                     rng    ( 16 ) ;
+  std::normal_distribution<double> gauss  ( 0 , 1 ) ;
+  Scratch<Node>                    scratch ;
+  //
+  double worstCorr = 0 , worstHOP = 0 , worstHOPAbove4GeV = 0 ;
+  long   mismatch  = 0 ;
+  const long n = 200000 ;
+  for ( long i = 0 ; i < n ; ++i )
+  {
+    forest.clear () ;
+    // the B momentum and the momenta of the daughters, as fractions of it
+    const double p  = forest.uniform ( 20000 , 200000 ) ;
+    const double th = forest.uniform ( 0.01 , 0.3 ) , ph = forest.uniform ( 0 , 6.283 ) ;
+    const double bx = p * std::sin ( th ) * std::cos ( ph ) ;
+    const double by = p * std::sin ( th ) * std::sin ( ph ) ;
+    const double bz = p * std::cos ( th ) ;
+    auto daughter = [&] ( const int pid , const double f )
+      { return forest.basic ( pid , gauss ( rng ) * 1500 + f * bx ,
+                                    gauss ( rng ) * 1500 + f * by ,
+                                    gauss ( rng ) * 1500 + f * bz ) ; } ;
+    // the electrons lose a part of their momenta
+    const Node* B = forest.composite
+      ( 521 , { daughter ( 321 , 0.4 ) ,
+                forest.composite ( 443 , { daughter ( -11 , 0.3 * forest.uniform ( 0.5 , 1 ) ) ,
+                                           daughter (  11 , 0.3 * forest.uniform ( 0.5 , 1 ) ) } ) } ) ;
+    // the flight direction, smeared, normalised
+    double ux = bx / p + gauss ( rng ) * 0.01 , uy = by / p + gauss ( rng ) * 0.01 , uz = bz / p ;
+    const double u = std::sqrt ( ux * ux + uy * uy + uz * uz ) ;
+    ux /= u ; uy /= u ; uz /= u ;
+    //
+    // double precision
+    const Info   exact = evaluate ( B , ux , uy , uz , scratch ) ;
+    const double corr  = mCorrDir ( B->momentum , ux , uy , uz ) ;
+    //
+    // single precision
+    P4 P_h , P_e ;
+    walk<Node> ( B , scratch , P_h , P_e ) ;
+    float lx [ 8 ] , ly [ 8 ] , lz [ 8 ] ;
+    std::size_t ne = 0 ;
+    for ( const P4& q : scratch.leptons )
+    { lx [ ne ] = q.px ; ly [ ne ] = q.py ; lz [ ne ] = q.pz ; ++ne ; }
+    const float hop  = hopMassFast ( P_h.px , P_h.py , P_h.pz , P_h.e ,
+                                     P_e.px , P_e.py , P_e.pz ,
+                                     ux , uy , uz , lx , ly , lz , ne ) ;
+    const float fast = mCorrFast ( B->momentum.m2 () ,
+                                   ptDirFast ( B->momentum.px , B->momentum.py , B->momentum.pz ,
+                                               ux , uy , uz ) ) ;
+    //
+    if ( std::isnan ( exact.mass ) != std::isnan ( hop ) ) { ++mismatch ; continue ; }
+    worstCorr = std::max ( worstCorr , std::fabs ( fast - corr ) / corr ) ;
+    if ( std::isnan ( exact.mass ) ) { continue ; }
+    const double d = std::fabs ( hop - exact.mass ) / std::fabs ( exact.mass ) ;
+    worstHOP = std::max ( worstHOP , d ) ;
+    if ( 4000 < exact.mass ) { worstHOPAbove4GeV = std::max ( worstHOPAbove4GeV , d ) ; }
+  }
+  //
+  std::printf ( "candidates %ld, worst relative deviation: CORRM %.3g HOPM %.3g ( %.3g above 4 GeV ), NaN mismatches %ld\n" ,
+                n , worstCorr , worstHOP , worstHOPAbove4GeV , mismatch ) ;
+  const bool ok = worstCorr <= maxCorr && worstHOP <= maxHOP
+    && worstHOPAbove4GeV <= maxHOPAbove4GeV && 0 == mismatch ;
+  std::printf ( ok ? "OK\n" : "FAILED\n" ) ;
+  return ok ? 0 : 1 ;
+}
+// ============================================================================
+// The END
+// ============================================================================
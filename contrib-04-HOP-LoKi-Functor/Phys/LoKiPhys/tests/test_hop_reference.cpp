@@ -0,0 +1,442 @@
+// ============================================================================
+// Include files
+// ============================================================================
+// STD & STL
+// ============================================================================
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+// ============================================================================
+// local
+// ============================================================================
+#include "HOPTestTrees.h"
+// ============================================================================
+/** @file test_hop_reference.cpp
+ *
+ *  The regression test of HOPM, HOPALPHA, CORRM and PTFLIGHT:
+ *   - fixed candidates against the values of the baseline recursive
+ *     algorithm, written down once, thus any change of the results shows up;
+ *   - random trees of all topologies against the baseline algorithm,
+ *     for the single-pass walk, the walk with the plans and the columns;
+ *   - the events with the combinatorics, the candidates sharing their
+ *     sub-decays: the walk with partials against the baseline algorithm,
+ *     and the same bits as the walk with the plans in any order of the
+ *     evaluations, with and without the evictions of the partials;
+ *   - the time per candidate of the walk, the plans and the columns
+ *     against the stored baseline: the test fails if any is slower than
+ *     the baseline by more than the allowed fraction.
+ *
+ *  By default one million random trees are checked, in batches, thus
+ *  the memory does not grow with the number of trees. The baseline is
+ *  specific to the machine and the compiler, rewrite it with
+ *  <code>--update</code> after a deliberate change of the performance.
+ *
+ *  @code
+ *   g++ -std=c++17 -O2 -I. -Itests tests/test_hop_reference.cpp -o test_hop_reference
+ *   ./test_hop_reference [-n trees] [-b baseline] [-s slower] [--update]
+ *  @endcode
+ *   - <code>-n</code> the number of the random trees, 1000000 by default
+ *   - <code>-b</code> the file with the baseline time per candidate,
+ *     <code>tests/test_hop_reference.baseline</code> by default
+ *   - <code>-s</code> the allowed slowdown, 0.25 (25%) by default
+ *   - <code>--update</code> write the measured time as the new baseline
+ */
+// ============================================================================
+namespace
+{
+  // ==========================================================================
+  using namespace LoKi::HOP ;
+  using namespace LoKi::HOP::Tests ;
+  // ==========================================================================
+  /** the fixed candidate with the values of the baseline algorithm,
+   *  HOPM, HOPALPHA, CORRM and PTFLIGHT
+   */
+  struct Fixed
+  {
+    const char* name ;
+    const Node* head ;
+    double      dx , dy , dz ;
+    double      hopMass , alpha , mCorr , ptFlight ;
+  } ;
+  // ==========================================================================
+  /// the tolerance: the algorithms add the momenta in different order
+  const double s_tolerance = 1.e-9 ;
+  // ==========================================================================
+  /// compare all quantities of the candidate with the expected values
+  bool compare ( const char*  what    , const Node& head ,
+                 const double dx      , const double dy , const double dz ,
+                 const Info&  info    ,
+                 const double hopMass , const double alpha ,
+                 const double mCorr   , const double ptFlight )
+  {
+    char name [ 128 ] ;
+    bool ok = true ;
+    std::snprintf ( name , sizeof ( name ) , "%s HOPM"     , what ) ;
+    ok = close ( name , info.mass  , hopMass , s_tolerance ) && ok ;
+    std::snprintf ( name , sizeof ( name ) , "%s HOPALPHA" , what ) ;
+    ok = close ( name , info.alpha , alpha   , s_tolerance ) && ok ;
+    std::snprintf ( name , sizeof ( name ) , "%s CORRM"    , what ) ;
+    ok = close ( name , mCorrDir ( head.momentum , dx , dy , dz ) , mCorr    , s_tolerance ) && ok ;
+    std::snprintf ( name , sizeof ( name ) , "%s PTFLIGHT" , what ) ;
+    ok = close ( name , ptDir    ( head.momentum , dx , dy , dz ) , ptFlight , s_tolerance ) && ok ;
+    return ok ;
+  }
+  // ==========================================================================
+  /// the same bits, NaN values are the same
+  bool same ( const char* what , const double a , const double b )
+  {
+    if ( a == b || ( std::isnan ( a ) && std::isnan ( b ) ) ) { return true ; }
+    std::printf ( "FAILED %s: %.17g != %.17g\n" , what , a , b ) ;
+    return false ;
+  }
+  // ==========================================================================
+  /** the events with the combinatorics: the candidates are built from the
+   *  pool of the sub-decays of the event. The walk with partials gives the
+   *  values of the baseline algorithm and the same bits as the walk with
+   *  the plans, whatever the order of the evaluations:
+   *   - the candidates in order, the sub-decays recorded on the way;
+   *   - the sub-decays first, as the heads of their own, then the
+   *     candidates in the reverse order, with the small table that evicts.
+   *  @return the number of the failed candidates
+   */
+  long combinatorics ( const unsigned int events )
+  {
+    Forest          forest ( 13 ) ;
+    Scratch<Node>   scratch     ;
+    PlanCache<Node> plans       ;
+    NoAnnotations   annotations ;
+    Partials<>      partials    ;
+    Partials<7>     evicting    ;
+    long            failed = 0  ;
+    for ( unsigned int event = 0 ; event < events ; ++event )
+    {
+      std::vector<const Node*> subs ;
+      for ( unsigned int i = 0 ; i < 4 ; ++i )
+      {
+        subs.push_back ( forest.composite ( 313 , { forest.basic ( 321 ) , forest.basic ( -211 ) } ) ) ;
+        subs.push_back ( forest.composite ( 443 , { forest.basic ( -11 ) , forest.basic (   11 ) } ) ) ;
+        subs.push_back ( forest.random ( 1 ) ) ;
+      }
+      std::vector<const Node*> heads ;
+      std::vector<double>      dx , dy , dz ;
+      for ( unsigned int c = 0 ; c < 40 ; ++c )
+      {
+        const std::size_t first  = forest.integer ( subs.size () ) ;
+        const std::size_t second = ( first + 1 + forest.integer ( subs.size () - 1 ) ) % subs.size () ;
+        std::vector<const Node*> daughters { subs [ first ] , subs [ second ] } ;
+        if ( forest.integer ( 2 ) ) { daughters.push_back ( forest.basic ( forest.integer ( 2 ) ? 11 : 321 ) ) ; }
+        heads.push_back ( forest.composite ( 511 , daughters ) ) ;
+        dx.push_back ( forest.uniform ( -1 , 1 ) ) ;
+        dy.push_back ( forest.uniform ( -1 , 1 ) ) ;
+        dz.push_back ( forest.uniform ( 5 , 50 ) ) ;
+      }
+      //
+      const std::size_t n = heads.size () ;
+      std::vector<Info> expected ( n ) , inOrder ( n ) , reversed ( n ) ;
+      P4 P_h , P_e ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        walk ( heads [ i ] , scratch , plans , annotations , P_h , P_e ) ;
+        expected [ i ] = complete ( scratch , P_h , P_e , dx [ i ] , dy [ i ] , dz [ i ] ) ;
+      }
+      partials.clear () ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        walk ( heads [ i ] , scratch , plans , annotations , partials , P_h , P_e ) ;
+        inOrder [ i ] = complete ( scratch , P_h , P_e , dx [ i ] , dy [ i ] , dz [ i ] ) ;
+      }
+      evicting.clear () ;
+      for ( const Node* sub : subs )
+      { walk ( sub , scratch , plans , annotations , evicting , P_h , P_e ) ; }
+      for ( std::size_t i = n ; 0 < i-- ; )
+      {
+        walk ( heads [ i ] , scratch , plans , annotations , evicting , P_h , P_e ) ;
+        reversed [ i ] = complete ( scratch , P_h , P_e , dx [ i ] , dy [ i ] , dz [ i ] ) ;
+      }
+      //
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        double a = 0 ;
+        const double m = Reference::hopMass ( *heads [ i ] , dx [ i ] , dy [ i ] , dz [ i ] , &a ) ;
+        const bool good =
+          close ( "partials HOPM"              , inOrder  [ i ].mass  , m , s_tolerance ) &&
+          close ( "partials HOPALPHA"          , inOrder  [ i ].alpha , a , s_tolerance ) &&
+          same  ( "partials HOPM bits"         , inOrder  [ i ].mass  , expected [ i ].mass  ) &&
+          same  ( "partials HOPALPHA bits"     , inOrder  [ i ].alpha , expected [ i ].alpha ) &&
+          same  ( "partials reversed HOPM"     , reversed [ i ].mass  , expected [ i ].mass  ) &&
+          same  ( "partials reversed HOPALPHA" , reversed [ i ].alpha , expected [ i ].alpha ) ;
+        if ( !good ) { ++failed ; }
+      }
+      forest.clear () ;
+    }
+    return failed ;
+  }
+  // ==========================================================================
+  /// the time per candidate of the evaluations of the random trees, ns
+  struct Timing
+  {
+    double walk    = 0 ;
+    double plans   = 0 ;
+    double columns = 0 ;
+  } ;
+  // ==========================================================================
+  /// the time since the start, ns
+  double since ( const std::chrono::steady_clock::time_point start )
+  {
+    return std::chrono::duration<double,std::nano>
+      ( std::chrono::steady_clock::now () - start ).count () ;
+  }
+  // ==========================================================================
+  /** the random trees of all topologies, in batches: the single-pass
+   *  walk, the walk with the plans and the columns against the baseline
+   *  algorithm. The evaluations are timed separately from the checks
+   *  @param trees  (INPUT)  the number of the trees
+   *  @param timing (OUTPUT) the time per candidate
+   *  @return the number of the failed candidates
+   */
+  long randomTrees ( const std::size_t trees , Timing& timing )
+  {
+    typedef std::chrono::steady_clock Clock ;
+    const std::size_t batch = 10000 ;
+    //
+    Forest          forest ( 11 ) ;
+    Scratch<Node>   scratch     ;
+    PlanCache<Node> plans       ;
+    NoAnnotations   annotations ;
+    ColumnScratch   cs          ;
+    long   failed = 0 ;
+    double walked = 0 , planned = 0 , columned = 0 ;
+    for ( std::size_t done = 0 ; done < trees ; done += batch )
+    {
+      const std::size_t n = std::min ( batch , trees - done ) ;
+      std::vector<const Node*> heads ;
+      std::vector<double>      dx , dy , dz ;
+      Flat                     flat ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        const Node* head = 0 ;
+        switch ( i % 6 )
+        {
+        case 0  : head = forest.B2KstJpsiEE () ; break ;
+        case 1  : head = forest.B2KJpsiEE   () ; break ;
+        case 2  : head = forest.B2KEMu      () ; break ;
+        case 3  : head = forest.chain ( 2 + i % 11 ) ; break ;
+        default : head = forest.random ( i % 3 ) ; break ;
+        }
+        heads.push_back ( head ) ;
+        dx.push_back ( forest.uniform ( -1 , 1 ) ) ;
+        dy.push_back ( forest.uniform ( -1 , 1 ) ) ;
+        dz.push_back ( forest.uniform ( 5 , 50 ) ) ;
+        flat.add ( head , dx.back () , dy.back () , dz.back () , 0 , 0 , 0 ) ;
+      }
+      //
+      std::vector<Info> walkInfo ( n ) , planInfo ( n ) ;
+      Clock::time_point start = Clock::now () ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      { walkInfo [ i ] = evaluate ( heads [ i ] , dx [ i ] , dy [ i ] , dz [ i ] , scratch ) ; }
+      walked += since ( start ) ;
+      start = Clock::now () ;
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      { planInfo [ i ] = evaluate ( heads [ i ] , dx [ i ] , dy [ i ] , dz [ i ] , scratch , plans , annotations ) ; }
+      planned += since ( start ) ;
+      std::vector<double> hopm ( n ) , alpha ( n ) , corrm ( n ) , pt ( n ) ;
+      ColumnResults r ;
+      r.hopMass  = hopm .data () ;
+      r.alpha    = alpha.data () ;
+      r.mCorr    = corrm.data () ;
+      r.ptFlight = pt   .data () ;
+      start = Clock::now () ;
+      evaluate ( flat.columns () , r , cs ) ;
+      columned += since ( start ) ;
+      //
+      for ( std::size_t i = 0 ; i < n ; ++i )
+      {
+        double a = 0 ;
+        const Node&  head = *heads [ i ] ;
+        const double m = Reference::hopMass  ( head , dx [ i ] , dy [ i ] , dz [ i ] , &a ) ;
+        const double c = Reference::mCorr    ( head , dx [ i ] , dy [ i ] , dz [ i ] ) ;
+        const double p = Reference::ptFlight ( head.momentum , dx [ i ] , dy [ i ] , dz [ i ] ) ;
+        const bool good =
+          compare ( "walk"  , head , dx [ i ] , dy [ i ] , dz [ i ] , walkInfo [ i ] , m , a , c , p ) &&
+          compare ( "plans" , head , dx [ i ] , dy [ i ] , dz [ i ] , planInfo [ i ] , m , a , c , p ) &&
+          close ( "columns HOPM"     , hopm  [ i ] , m , s_tolerance ) &&
+          close ( "columns HOPALPHA" , alpha [ i ] , a , s_tolerance ) &&
+          close ( "columns CORRM"    , corrm [ i ] , c , s_tolerance ) &&
+          close ( "columns PTFLIGHT" , pt    [ i ] , p , s_tolerance ) ;
+        if ( !good ) { ++failed ; }
+      }
+      forest.clear () ;
+    }
+    //
+    const double count = std::max<std::size_t> ( trees , 1 ) ;
+    timing.walk    = walked   / count ;
+    timing.plans   = planned  / count ;
+    timing.columns = columned / count ;
+    return failed ;
+  }
+  // ==========================================================================
+  /** read the baseline: the lines <code>name ns/candidate</code>,
+   *  the lines starting with <code>#</code> are comments
+   */
+  bool readBaseline ( const std::string& name , Timing& timing )
+  {
+    std::ifstream file ( name ) ;
+    if ( !file ) { return false ; }
+    std::string line ;
+    while ( std::getline ( file , line ) )
+    {
+      if ( line.empty () || '#' == line [ 0 ] ) { continue ; }
+      char   what [ 32 ] ;
+      double ns = 0 ;
+      if ( 2 != std::sscanf ( line.c_str () , "%31s %lf" , what , &ns ) ) { return false ; }
+      const std::string key ( what ) ;
+      if      ( "walk"    == key ) { timing.walk    = ns ; }
+      else if ( "plans"   == key ) { timing.plans   = ns ; }
+      else if ( "columns" == key ) { timing.columns = ns ; }
+      else                         { return false ;        }
+    }
+    return true ;
+  }
+  // ==========================================================================
+  /// write the baseline
+  bool writeBaseline ( const std::string& name , const Timing& timing )
+  {
+    std::ofstream file ( name ) ;
+    file << "# test_hop_reference: ns per candidate of the random trees\n"
+         << "# rewrite with: test_hop_reference --update\n"
+         << "walk    " << timing.walk    << "\n"
+         << "plans   " << timing.plans   << "\n"
+         << "columns " << timing.columns << "\n" ;
+    return static_cast<bool> ( file ) ;
+  }
+  // ==========================================================================
+  /// compare the time per candidate with the baseline
+  bool faster ( const char* what , const double ns , const double baseline ,
+                const double slower )
+  {
+    const bool ok = ns <= baseline * ( 1 + slower ) ;
+    std::printf ( "%s%-8s %8.1f ns/candidate, baseline %8.1f\n" ,
+                  ok ? "" : "FAILED " , what , ns , baseline ) ;
+    return ok ;
+  }
+  // ==========================================================================
+  int usage ()
+  {
+    std::cerr << "Usage: test_hop_reference [-n trees] [-b baseline] [-s slower] [--update]"
+              << std::endl ;
+    return 2 ;
+  }
+  // ==========================================================================
+}
+// ============================================================================
+int main ( int argc , char** argv )
+{
+  std::size_t trees    = 1000000 ;
+  std::string stored   = "tests/test_hop_reference.baseline" ;
+  double      slower   = 0.25 ;
+  bool        update   = false ;
+  for ( int a = 1 ; a < argc ; ++a )
+  {
+    const std::string arg = argv [ a ] ;
+    if      ( "-n" == arg && a + 1 < argc ) { trees    = std::strtoul ( argv [ ++a ] , nullptr , 10 ) ; }
+    else if ( "-b" == arg && a + 1 < argc ) { stored   = argv [ ++a ] ; }
+    else if ( "-s" == arg && a + 1 < argc ) { slower   = std::strtod  ( argv [ ++a ] , nullptr ) ; }
+    else if ( "--update" == arg           ) { update   = true ; }
+    else                                    { return usage () ; }
+  }
+  //
+  Forest forest ( 11 ) ;
+  bool   ok = true ;
+  //
+  // the fixed candidates, momenta in MeV, flight in mm
+  const Fixed fixed [] =
+  {
+    { "B+ -> K+ ( J/psi -> e+ e- )" ,
+      forest.composite ( 521 , { forest.basic ( 321 , 1200 , -800 , 42000 ) ,
+                                 forest.composite ( 443 , { forest.basic ( -11 ,  600 , 300 , 15000 ) ,
+                                                            forest.basic (  11 , -200 , 900 , 11000 ) } ) } ) ,
+      0.5 , 0.2 , 30 ,
+      3135.79808026718 , 1.15862435671375 , 3394.10587280335 , 469.645771390323 } ,
+    { "B0 -> ( K*0 -> K+ pi- ) ( J/psi -> e+ e- )" ,
+      forest.composite ( 511 , { forest.composite ( 313 , { forest.basic (  321 , 900 , -300 , 30000 ) ,
+                                                            forest.basic ( -211 , 400 ,  100 , 12000 ) } ) ,
+                                 forest.composite ( 443 , { forest.basic (  -11 , 300 ,  700 , 14000 ) ,
+                                                            forest.basic (   11 , -500 , 200 ,  9000 ) } ) } ) ,
+      0.4 , 0.1 , 25 ,
+      2198.61584828625 , 0.736929231382128 , 3049.43865129489 , 444.063738231143 } ,
+    { "B+ -> K+ e+ mu-" ,
+      forest.composite ( 521 , { forest.basic ( 321 ,  700 , 1100 , 38000 ) ,
+                                 forest.basic ( -11 , -300 ,  400 , 16000 ) ,
+                                 forest.basic (  13 ,  200 , -600 , 21000 ) } ) ,
+      0.3 , 0.6 , 40 ,
+      2455.86312009433 , 1.33038882444238 , 2542.94075210998 , 228.082619684415 } ,
+    { "B0 -> K+ pi-, no electrons" ,
+      forest.composite ( 511 , { forest.basic ( 321 , 1500 , 200 , 40000 ) ,
+                                 forest.basic ( -211 , -700 , 300 , 20000 ) } ) ,
+      0.2 , 0.1 , 20 ,
+      2170.02616054339 , std::numeric_limits<double>::infinity () , 2471.20623615129 , 282.826804113152 } ,
+  } ;
+  //
+  Scratch<Node> scratch ;
+  for ( const Fixed& f : fixed )
+  {
+    double a = 0 ;
+    const double m = Reference::hopMass ( *f.head , f.dx , f.dy , f.dz , &a ) ;
+    std::printf ( "%s: HOPM %.15g HOPALPHA %.15g CORRM %.15g PTFLIGHT %.15g\n" , f.name , m , a ,
+                  Reference::mCorr ( *f.head , f.dx , f.dy , f.dz ) ,
+                  Reference::ptFlight ( f.head->momentum , f.dx , f.dy , f.dz ) ) ;
+    // the baseline algorithm itself did not change
+    Info baseline ;
+    baseline.mass  = m ;
+    baseline.alpha = a ;
+    ok = compare ( f.name , *f.head , f.dx , f.dy , f.dz , baseline ,
+                   f.hopMass , f.alpha , f.mCorr , f.ptFlight ) && ok ;
+    // the current algorithm gives the same values
+    ok = compare ( f.name , *f.head , f.dx , f.dy , f.dz ,
+                   evaluate ( f.head , f.dx , f.dy , f.dz , scratch ) ,
+                   f.hopMass , f.alpha , f.mCorr , f.ptFlight ) && ok ;
+  }
+  //
+  // the random trees: the walk, the plans and the columns against the baseline algorithm
+  Timing timing ;
+  const long failed = randomTrees ( trees , timing ) ;
+  std::printf ( "random candidates %zu, failed %ld\n" , trees , failed ) ;
+  ok = ok && 0 == failed ;
+  //
+  const unsigned int events = std::max<std::size_t> ( trees / 5000 , 200 ) ;
+  const long shared = combinatorics ( events ) ;
+  std::printf ( "events with the combinatorics %u, failed %ld\n" , events , shared ) ;
+  ok = ok && 0 == shared ;
+  //
+  // the time per candidate against the baseline
+  Timing expected ;
+  if      ( update )
+  {
+    const bool written = writeBaseline ( stored , timing ) ;
+    std::printf ( "%s the baseline %s\n" , written ? "written" : "FAILED to write" , stored.c_str () ) ;
+    ok = ok && written ;
+  }
+  else if ( !readBaseline ( stored , expected ) )
+  {
+    std::printf ( "FAILED to read the baseline %s\n" , stored.c_str () ) ;
+    ok = false ;
+  }
+  else
+  {
+    ok = faster ( "walk"    , timing.walk    , expected.walk    , slower ) && ok ;
+    ok = faster ( "plans"   , timing.plans   , expected.plans   , slower ) && ok ;
+    ok = faster ( "columns" , timing.columns , expected.columns , slower ) && ok ;
+  }
+  std::printf ( ok ? "OK\n" : "FAILED\n" ) ;
+  return ok ? 0 : 1 ;
+}
+// ============================================================================
+// The END
+// ============================================================================
@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+# =============================================================================
+## @file test_hop_threads.py
+#  Stress test of the concurrent evaluation: for each event one BPVHOPM
+#  (and one BPVHOPMERR, PVSCANM) is shared by many threads, the values
+#  are bit-identical to the serial ones.
+#
+#  The composite sub-decays of the candidates are evaluated as well, as
+#  the heads of their own, thus each thread meets the sub-decays before,
+#  after and between the candidates built from them: the values must not
+#  depend on what the event caches already hold.
+#
+#  The serial values are evaluated by another functor with the memo off,
+#  the shared functor is not evaluated before the threads start, thus
+#  the loading of the desktop, the event caches and the diagnostics are
+#  all exercised concurrently.
+#
+#  It runs the Bender algorithm on the input of HOP_Ntuples.py, e.g.
+#  @code
+#   lb-run Bender/latest python tests/test_hop_threads.py [input.dst]
+#  @endcode
+#
+#  The threads are spawned by tests/HOPThreads.h
+# =============================================================================
+import os
+import sys
+
+from Bender.Main import *
+
+cpp.gInterpreter.AddIncludePath ( os.path.dirname ( os.path.abspath ( __file__ ) ) )
+cpp.gInterpreter.Declare ( '#include "HOPThreads.h"' )
+
+stress = cpp.LoKi.HOP.Tests.stress
+Memo   = cpp.LoKi.Particles.Memo
+
+## the threads and the passes of each thread
+THREADS = 16
+REPEAT  = 20
+
+# =============================================================================
+## the functors to compare
+def functors () :
+    Particles = cpp.LoKi.Particles
+    return { 'BPVHOPM'    : lambda : Particles.BremMCorrectedWithBestVertex ()                 ,
+             'BPVHOPMERR' : lambda : Particles.HOPMassErrorWithBestVertex   ()                 ,
+             'PVSCANM'    : lambda : Particles.MassVertexScan               ( 'HOPM' , 'MIN' ) }
+
+# =============================================================================
+## the composite sub-decays of the candidates, at all depths
+def subdecays ( particles ) :
+    result = []
+    todo   = list ( particles )
+    while todo :
+        p = todo.pop ()
+        for d in p.daughters () :
+            d = d.target ()
+            if d.isBasicParticle () : continue
+            result.append ( d )
+            todo  .append ( d )
+    return result
+
+# =============================================================================
+## @class HOPThreads
+#  Compares the concurrent evaluation with the serial one, event by event
+class HOPThreads ( Algo ) :
+
+    def initialize ( self ) :
+        sc = Algo.initialize ( self )
+        self.differences = 0
+        self.candidates  = 0
+        return sc
+
+    def analyse ( self ) :
+        particles = self.select ( 'B' , PALL )
+        if particles.empty () : return SUCCESS
+        #
+        vector = std.vector ( 'const LHCb::Particle*' ) ()
+        for p in particles               : vector.push_back ( p )
+        for p in subdecays ( particles ) : vector.push_back ( p )
+        #
+        for name , make in functors ().items () :
+            # the serial values, evaluated from scratch
+            Memo.enable ( False )
+            serial = std.vector ( 'double' ) ()
+            fun    = make ()
+            for p in vector : serial.push_back ( fun ( p ) )
+            Memo.enable ( True  )
+            # the shared functor, first evaluated by all threads at once
+            d = stress ( make () , vector , serial , THREADS , REPEAT )
+            if d : self.Error ( '%s: %d values differ from the serial ones' % ( name , d ) )
+            self.differences += d
+        self.candidates += len ( vector )
+        return SUCCESS
+
+    def finalize ( self ) :
+        self.Print ( 'candidates %d, differences %d' % ( self.candidates , self.differences ) )
+        return Algo.finalize ( self )
+
+# =============================================================================
+## configure the job as HOP_Ntuples.py
+def configure ( inputdata , evtmax = 500 ) :
+    from Configurables import DaVinci
+    DaVinci ( InputType  = 'DST'                    ,
+              DataType   = '2011'                   ,
+              Simulation = True                     ,
+              EvtMax     = evtmax                   ,
+              CondDBtag  = 'sim-20130522-vc-md100'  ,
+              DDDBtag    = 'dddb-20130929'          )
+    setData ( inputdata )
+    gaudi = appMgr ()
+    alg   = HOPThreads ( 'HOPThreads' ,
+                         Inputs = [ '/Event/AllStreams/Phys/Bu2LLK_eeLine2/Particles' ] )
+    gaudi.setAlgorithms ( [ alg ] )
+    return alg
+
+# =============================================================================
+if '__main__' == __name__ :
+
+    inputdata = sys.argv [ 1 : ] or [
+        'root://eoslhcb.cern.ch//eos/lhcb/user/s/simone/RD/DST/MC11_Bd2KstEE.dst' ]
+    alg = configure ( inputdata )
+    run ( -1 )
+    ok = 0 < alg.candidates and 0 == alg.differences
+    print ( 'candidates %d, differences %d: %s' % ( alg.candidates , alg.differences ,
+                                                   'OK' if ok else 'FAILED' ) )
+    sys.exit ( 0 if ok else 1 )
+
+# =============================================================================
+# The END
+# =============================================================================
@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+# =============================================================================
+## @file test_hop_tuple_columns.py
+#  Test of LoKiPhys.columns.Filler, the batched evaluation for the ntuples:
+#  for each event the columns of all BPV* variables are bit-identical to
+#  the values of the individual functors, as filled by
+#  LoKi::Hybrid::TupleTool in HOP_Ntuples.py
+#
+#  It runs the Bender algorithm on the input of HOP_Ntuples.py, e.g.
+#  @code
+#   lb-run Bender/latest python tests/test_hop_tuple_columns.py [input.dst]
+#  @endcode
+# =============================================================================
+import struct
+import sys
+
+from Bender.Main       import *
+from LoKiPhys.columns  import Filler
+import LoKiPhys.functions as F
+
+## the variables with their functors
+VARIABLES = ( 'BPVPTFLIGHT' , 'BPVCORRM' , 'BPVHOPM'  , 'BPVHOPALPHA' ,
+              'BPVHOPPTE'   , 'BPVHOPPTH' , 'BPVHOPEM' , 'BPVHOPQ2'    )
+
+## the bits of the value
+def bits ( value ) : return struct.pack ( 'd' , value )
+
+# =============================================================================
+## @class HOPTupleColumns
+#  Compares the batched columns with the functors, event by event
+class HOPTupleColumns ( Algo ) :
+
+    def initialize ( self ) :
+        sc = Algo.initialize ( self )
+        self.filler      = Filler ( VARIABLES )
+        self.differences = 0
+        self.candidates  = 0
+        return sc
+
+    def analyse ( self ) :
+        particles = self.select ( 'B' , PALL )
+        if particles.empty () : return SUCCESS
+        #
+        columns = self.filler ( particles )
+        for v in VARIABLES :
+            fun = getattr ( F , v )
+            for i , p in enumerate ( particles ) :
+                if bits ( columns [ v ] [ i ] ) == bits ( fun ( p ) ) : continue
+                self.differences += 1
+                self.Error ( '%s: candidate %d, column %r, functor %r' %
+                             ( v , i , columns [ v ] [ i ] , fun ( p ) ) )
+        self.candidates += particles.size ()
+        return SUCCESS
+
+# =============================================================================
+## configure the job as HOP_Ntuples.py
+def configure ( inputdata , evtmax = 500 ) :
+    from Configurables import DaVinci
+    DaVinci ( InputType  = 'DST'                    ,
+              DataType   = '2011'                   ,
+              Simulation = True                     ,
+              EvtMax     = evtmax                   ,
+              CondDBtag  = 'sim-20130522-vc-md100'  ,
+              DDDBtag    = 'dddb-20130929'          )
+    setData ( inputdata )
+    gaudi = appMgr ()
+    alg   = HOPTupleColumns ( 'HOPTupleColumns' ,
+                              Inputs = [ '/Event/AllStreams/Phys/Bu2LLK_eeLine2/Particles' ] )
+    gaudi.setAlgorithms ( [ alg ] )
+    return alg
+
+# =============================================================================
+if '__main__' == __name__ :
+
+    inputdata = sys.argv [ 1 : ] or [
+        'root://eoslhcb.cern.ch//eos/lhcb/user/s/simone/RD/DST/MC11_Bd2KstEE.dst' ]
+    alg = configure ( inputdata )
+    run ( -1 )
+    ok = 0 < alg.candidates and 0 == alg.differences
+    print ( 'candidates %d, differences %d: %s' % ( alg.candidates , alg.differences ,
+                                                   'OK' if ok else 'FAILED' ) )
+    sys.exit ( 0 if ok else 1 )
+
+# =============================================================================
+# The END
+# =============================================================================
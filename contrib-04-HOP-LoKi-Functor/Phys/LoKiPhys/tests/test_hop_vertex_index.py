@@ -0,0 +1,107 @@
+#!/usr/bin/env python
+# =============================================================================
+## @file test_hop_vertex_index.py
+#  The best vertex from the z-sorted index of the primary vertices is the
+#  vertex of the relator: with the index in the verification mode each
+#  association is compared with the relator, and the values of the BPV
+#  functors with the index are identical to the ones with the relator.
+#
+#  It runs the Bender algorithm on the input of HOP_Ntuples.py, e.g.
+#  @code
+#   lb-run Bender/latest python tests/test_hop_vertex_index.py [input.dst]
+#  @endcode
+#
+#  @see LoKi::Particles::BestVertexIndex
+# =============================================================================
+import sys
+
+from Bender.Main import *
+
+Memo        = cpp.LoKi.Particles.Memo
+Index       = cpp.LoKi.Particles.BestVertexIndex
+Diagnostics = cpp.LoKi.Particles.Diagnostics
+
+# =============================================================================
+## the functors to compare
+def functors () :
+    Particles = cpp.LoKi.Particles
+    return { 'BPVHOPM'     : lambda : Particles.BremMCorrectedWithBestVertex () ,
+             'BPVHOPMERR'  : lambda : Particles.HOPMassErrorWithBestVertex   () ,
+             'BPVPTFLIGHT' : lambda : Particles.PtFlightWithBestVertex       () }
+
+# =============================================================================
+## @class HOPVertexIndex
+#  Compares the association from the index with the relator, event by event
+class HOPVertexIndex ( Algo ) :
+
+    def initialize ( self ) :
+        sc = Algo.initialize ( self )
+        self.differences = 0
+        self.mismatches  = 0
+        self.candidates  = 0
+        return sc
+
+    def analyse ( self ) :
+        particles = self.select ( 'B' , PALL )
+        if particles.empty () : return SUCCESS
+        #
+        Memo.enable ( False )
+        for name , make in functors ().items () :
+            # the relator
+            Index.enable ( False )
+            fun      = make ()
+            relator  = [ fun ( p ) for p in particles ]
+            # the index, each association verified with the relator
+            Index.enable ( True  )
+            Index.verify ( True  )
+            fun      = make ()
+            index    = [ fun ( p ) for p in particles ]
+            Index.verify ( False )
+            Index.enable ( False )
+            #
+            d = sum ( 1 for a , b in zip ( relator , index ) if a != b and a == a )
+            m = fun.diagnostics ().counter ( Diagnostics.VertexMismatch )
+            if d or m : self.Error ( '%s: %d values differ, %d vertices differ' % ( name , d , m ) )
+            self.differences += d
+            self.mismatches  += m
+        Memo.enable ( True  )
+        self.candidates += len ( particles )
+        return SUCCESS
+
+    def finalize ( self ) :
+        self.Print ( 'candidates %d, differences %d, vertex mismatches %d' %
+                     ( self.candidates , self.differences , self.mismatches ) )
+        return Algo.finalize ( self )
+
+# =============================================================================
+## configure the job as HOP_Ntuples.py
+def configure ( inputdata , evtmax = 500 ) :
+    from Configurables import DaVinci
+    DaVinci ( InputType  = 'DST'                    ,
+              DataType   = '2011'                   ,
+              Simulation = True                     ,
+              EvtMax     = evtmax                   ,
+              CondDBtag  = 'sim-20130522-vc-md100'  ,
+              DDDBtag    = 'dddb-20130929'          )
+    setData ( inputdata )
+    gaudi = appMgr ()
+    alg   = HOPVertexIndex ( 'HOPVertexIndex' ,
+                             Inputs = [ '/Event/AllStreams/Phys/Bu2LLK_eeLine2/Particles' ] )
+    gaudi.setAlgorithms ( [ alg ] )
+    return alg
+
+# =============================================================================
+if '__main__' == __name__ :
+
+    inputdata = sys.argv [ 1 : ] or [
+        'root://eoslhcb.cern.ch//eos/lhcb/user/s/simone/RD/DST/MC11_Bd2KstEE.dst' ]
+    alg = configure ( inputdata )
+    run ( -1 )
+    ok = 0 < alg.candidates and 0 == alg.differences and 0 == alg.mismatches
+    print ( 'candidates %d, differences %d, vertex mismatches %d: %s' %
+            ( alg.candidates , alg.differences , alg.mismatches , 'OK' if ok else 'FAILED' ) )
+    sys.exit ( 0 if ok else 1 )
+
+# =============================================================================
+# The END
+# =============================================================================